@@ -11,6 +11,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <math.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -19,6 +20,7 @@
 #include <windows.h>
 #endif
 
+#include <GL/glew.h>
 #include "glut_wrap.h"
 
 #ifdef XMESA
@@ -56,6 +58,8 @@ static int fog = 1;
 static int bfcull = 1;
 static int usetex = 1;
 static int poutline = 0;
+static int usevbo = 1;
+static int uselod = 1;
 static int help = 1;
 static int joyavailable = 0;
 static int joyactive = 0;
@@ -245,8 +249,12 @@ printhelp(void)
    printstring(GLUT_BITMAP_TIMES_ROMAN_24, "a - Increase velocity");
    glRasterPos2i(60, 180);
    printstring(GLUT_BITMAP_TIMES_ROMAN_24, "z - Decrease velocity");
-
    glRasterPos2i(60, 150);
+   printstring(GLUT_BITMAP_TIMES_ROMAN_24, "v - Toggle VBO chunks");
+   glRasterPos2i(60, 120);
+   printstring(GLUT_BITMAP_TIMES_ROMAN_24, "l - Toggle chunk level of detail");
+
+   glRasterPos2i(60, 90);
    if (joyavailable)
       printstring(GLUT_BITMAP_TIMES_ROMAN_24,
 		  "j - Toggle jostick control (Joystick control available)");
@@ -255,18 +263,423 @@ printhelp(void)
 		  "(No Joystick control available)");
 }
 
+/*
+ * Chunked VBO renderer.  terrain[] is cut into CHUNKSIZE x CHUNKSIZE
+ * chunks of full resolution vertices, uploaded once.  Each frame every
+ * chunk is frustum culled and drawn with the index list of the coarsest
+ * geomipmapping level whose height error projects to at most LODPIXELS.
+ * The terrain repeats like in drawstrips(): each chunk is drawn at its
+ * copy nearest to the observer.
+ */
+
+#define MAPSIZE 256			/* samples per side of terrain[] */
+#define CHUNKSIZE 32			/* cells per side of a chunk */
+#define CHUNKVERTS (CHUNKSIZE + 1)
+#define NUMCHUNKS (MAPSIZE / CHUNKSIZE)
+#define MAXLEVEL 5			/* log2(CHUNKSIZE) */
+#define MAPSTEP (stepXmnt / TSCALE)	/* distance between samples */
+#define MAPORIGIN (lenghtXmnt / 2 * TSCALE)	/* sample at world x, z = 0 */
+#define LODPIXELS 4.0
+
+/* sides of a chunk next to a chunk one level coarser */
+#define NORTH 1				/* z = 0 */
+#define EAST  2				/* x = CHUNKSIZE */
+#define SOUTH 4				/* z = CHUNKSIZE */
+#define WEST  8				/* x = 0 */
+
+struct chunkvertex
+{
+   GLfloat x, y, z;
+   GLfloat s, t;
+   GLubyte color[4];
+};
+
+#define VOFFSET(base, f) \
+   ((const GLvoid *) ((base) + offsetof(struct chunkvertex, f)))
+
+struct chunk
+{
+   GLfloat miny, maxy;
+   GLfloat error[MAXLEVEL + 1];		/* max height error of each level */
+   GLfloat offset[2];			/* x, z translation of this frame */
+   int level;
+   int visible;
+};
+
+static struct chunk chunks[NUMCHUNKS * NUMCHUNKS];
+static GLuint chunkvbo, chunkibo;
+/* index lists of each level and combination of stitched sides */
+static GLsizei lodcount[MAXLEVEL + 1][16];
+static GLintptr lodoffset[MAXLEVEL + 1][16];
+static int chunksdrawn, trisdrawn;
+
+static struct chunk *
+chunkat(int cx, int cz)
+{
+   cx = (cx + NUMCHUNKS) % NUMCHUNKS;
+   cz = (cz + NUMCHUNKS) % NUMCHUNKS;
+   return &chunks[cz * NUMCHUNKS + cx];
+}
+
+static GLfloat
+mapheight(int x, int z)
+{
+   return terrain[(z & (MAPSIZE - 1)) * MAPSIZE + (x & (MAPSIZE - 1))];
+}
+
+/*
+ * Largest height difference between the chunk at x0, z0 and its mesh of
+ * every step-th vertex, with the cells split like in buildlods().
+ */
+static GLfloat
+levelerror(int x0, int z0, int step)
+{
+   GLfloat err = 0.0;
+   int x, z;
+
+   for (z = 0; z <= CHUNKSIZE; z++) {
+      for (x = 0; x <= CHUNKSIZE; x++) {
+	 int cx = x / step * step, cz = z / step * step;
+	 GLfloat u, v, h, ha, hb, hc, hd;
+
+	 if (cx == CHUNKSIZE)
+	    cx -= step;
+	 if (cz == CHUNKSIZE)
+	    cz -= step;
+	 u = (GLfloat) (x - cx) / step;
+	 v = (GLfloat) (z - cz) / step;
+
+	 ha = mapheight(x0 + cx, z0 + cz);
+	 hb = mapheight(x0 + cx, z0 + cz + step);
+	 hc = mapheight(x0 + cx + step, z0 + cz);
+	 hd = mapheight(x0 + cx + step, z0 + cz + step);
+	 if (u + v <= 1.0)
+	    h = ha + u * (hc - ha) + v * (hb - ha);
+	 else
+	    h = hd + (1.0 - u) * (hb - hd) + (1.0 - v) * (hc - hd);
+
+	 h = fabs(h - mapheight(x0 + x, z0 + z));
+	 if (h > err)
+	    err = h;
+      }
+   }
+   return err;
+}
+
+/*
+ * Index of the chunk vertex at x, z in a level of the given step.  On the
+ * sides next to a coarser chunk the odd vertices move onto the even ones
+ * before them, so the side has the neighbor's vertices and no cracks.
+ */
+static GLushort
+lodvertex(int x, int z, int step, int stitch)
+{
+   if ((stitch & NORTH) && z == 0 && (x / step) % 2)
+      x -= step;
+   if ((stitch & SOUTH) && z == CHUNKSIZE && (x / step) % 2)
+      x -= step;
+   if ((stitch & WEST) && x == 0 && (z / step) % 2)
+      z -= step;
+   if ((stitch & EAST) && x == CHUNKSIZE && (z / step) % 2)
+      z -= step;
+   return z * CHUNKVERTS + x;
+}
+
+static GLsizei
+addtriangle(GLushort *indices, GLsizei n, GLushort a, GLushort b, GLushort c)
+{
+   if (a != b && b != c && c != a) {
+      indices[n++] = a;
+      indices[n++] = b;
+      indices[n++] = c;
+   }
+   return n;
+}
+
+/*
+ * Build the index lists of every level, for each combination of sides
+ * to stitch, into one element array buffer shared by all the chunks.
+ */
 static void
-drawterrain(void)
+buildlods(void)
 {
-   int h, i, idx, ox, oy;
-   float j, k, start, end;
+   GLushort *indices;
+   GLsizei n = 0, first;
+   int level, stitch, x, z;
 
-   ox = (int) (obs[0] / stepXmnt);
-   oy = (int) (obs[2] / stepYmnt);
-   GlobalMnt = ((ox * TSCALE) & 255) + ((oy * TSCALE) & 255) * 256;
+   indices = malloc(16 * 6 * 2 * CHUNKSIZE * CHUNKSIZE * sizeof(GLushort));
+   if (!indices) {
+      fprintf(stderr, "Error allocating the terrain indices\n");
+      exit(-1);
+   }
 
-   glPushMatrix();
-   glTranslatef((float) ox * stepXmnt, 0, (float) oy * stepYmnt);
+   for (level = 0; level <= MAXLEVEL; level++) {
+      const int step = 1 << level;
+
+      for (stitch = 0; stitch < 16; stitch++) {
+	 if (level == MAXLEVEL && stitch) {
+	    /* nothing is coarser */
+	    lodoffset[level][stitch] = lodoffset[level][0];
+	    lodcount[level][stitch] = lodcount[level][0];
+	    continue;
+	 }
+
+	 first = n;
+	 for (z = 0; z < CHUNKSIZE; z += step) {
+	    for (x = 0; x < CHUNKSIZE; x += step) {
+	       GLushort a = lodvertex(x, z, step, stitch);
+	       GLushort b = lodvertex(x, z + step, step, stitch);
+	       GLushort c = lodvertex(x + step, z, step, stitch);
+	       GLushort d = lodvertex(x + step, z + step, step, stitch);
+
+	       /* same split and winding as the triangle strips */
+	       n = addtriangle(indices, n, a, b, c);
+	       n = addtriangle(indices, n, c, b, d);
+	    }
+	 }
+	 lodoffset[level][stitch] = first * sizeof(GLushort);
+	 lodcount[level][stitch] = n - first;
+      }
+   }
+
+   glGenBuffers(1, &chunkibo);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunkibo);
+   glBufferData(GL_ELEMENT_ARRAY_BUFFER, n * sizeof(GLushort), indices,
+		GL_STATIC_DRAW);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+   free(indices);
+}
+
+static void
+initchunks(void)
+{
+   struct chunkvertex *verts, *v;
+   int cx, cz, x, z, level;
+
+   if (!GLEW_VERSION_1_5) {
+      usevbo = 0;
+      return;
+   }
+
+   verts = malloc(NUMCHUNKS * NUMCHUNKS * CHUNKVERTS * CHUNKVERTS *
+		  sizeof(struct chunkvertex));
+   if (!verts) {
+      fprintf(stderr, "Error allocating the terrain chunks\n");
+      exit(-1);
+   }
+
+   v = verts;
+   for (cz = 0; cz < NUMCHUNKS; cz++) {
+      for (cx = 0; cx < NUMCHUNKS; cx++) {
+	 struct chunk *c = chunkat(cx, cz);
+
+	 c->miny = heightMnt;
+	 c->maxy = 0.0;
+	 for (z = 0; z <= CHUNKSIZE; z++) {
+	    for (x = 0; x <= CHUNKSIZE; x++, v++) {
+	       const int mx = cx * CHUNKSIZE + x, mz = cz * CHUNKSIZE + z;
+	       const int idx = (mz & (MAPSIZE - 1)) * MAPSIZE +
+		  (mx & (MAPSIZE - 1));
+
+	       v->x = mx * MAPSTEP;
+	       v->y = terrain[idx];
+	       v->z = mz * MAPSTEP;
+	       /* the texture repeats every 8 cells of drawstrips() */
+	       v->s = mx / (8.0 * TSCALE);
+	       v->t = mz / (8.0 * TSCALE);
+	       v->color[0] = terraincolor[idx][0] * 255.0 + 0.5;
+	       v->color[1] = terraincolor[idx][1] * 255.0 + 0.5;
+	       v->color[2] = terraincolor[idx][2] * 255.0 + 0.5;
+	       v->color[3] = 255;
+
+	       if (v->y < c->miny)
+		  c->miny = v->y;
+	       if (v->y > c->maxy)
+		  c->maxy = v->y;
+	    }
+	 }
+
+	 c->error[0] = 0.0;
+	 for (level = 1; level <= MAXLEVEL; level++) {
+	    c->error[level] = levelerror(cx * CHUNKSIZE, cz * CHUNKSIZE,
+					 1 << level);
+	    if (c->error[level] < c->error[level - 1])
+	       c->error[level] = c->error[level - 1];
+	 }
+      }
+   }
+
+   glGenBuffers(1, &chunkvbo);
+   glBindBuffer(GL_ARRAY_BUFFER, chunkvbo);
+   glBufferData(GL_ARRAY_BUFFER, (v - verts) * sizeof(struct chunkvertex),
+		verts, GL_STATIC_DRAW);
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   free(verts);
+
+   buildlods();
+}
+
+/*
+ * Place, cull and pick the level of every chunk for this frame's
+ * modelview and projection.  Neighbors differ by at most one level.
+ */
+static void
+selectlods(void)
+{
+   const GLfloat period = MAPSIZE * MAPSTEP;
+   /* pixels per unit of height error at distance 1, gluPerspective(50.0) */
+   const GLfloat pixels = scrheight / (2.0 * tan(25.0 * M_PI / 180.0));
+   GLfloat p[16], m[16], clip[16], planes[6][4];
+   int cx, cz, i, j, changed;
+
+   glGetFloatv(GL_PROJECTION_MATRIX, p);
+   glGetFloatv(GL_MODELVIEW_MATRIX, m);
+   for (i = 0; i < 4; i++) {
+      for (j = 0; j < 4; j++) {
+	 clip[i * 4 + j] = p[j] * m[i * 4] + p[4 + j] * m[i * 4 + 1] +
+	    p[8 + j] * m[i * 4 + 2] + p[12 + j] * m[i * 4 + 3];
+      }
+   }
+   for (i = 0; i < 6; i++) {
+      /* left, right, bottom, top, near, far: row 3 +/- row i / 2 */
+      const GLfloat sign = (i & 1) ? -1.0 : 1.0;
+      for (j = 0; j < 4; j++)
+	 planes[i][j] = clip[j * 4 + 3] + sign * clip[j * 4 + i / 2];
+   }
+
+   for (cz = 0; cz < NUMCHUNKS; cz++) {
+      for (cx = 0; cx < NUMCHUNKS; cx++) {
+	 struct chunk *c = chunkat(cx, cz);
+	 GLfloat lo[3], hi[3], center, dist = 0.0;
+
+	 /* the copy of the chunk with its center nearest to the observer */
+	 center = ((cx + 0.5) * CHUNKSIZE - MAPORIGIN) * MAPSTEP;
+	 c->offset[0] = floor((obs[0] - center) / period + 0.5) * period -
+	    MAPORIGIN * MAPSTEP;
+	 center = ((cz + 0.5) * CHUNKSIZE - MAPORIGIN) * MAPSTEP;
+	 c->offset[1] = floor((obs[2] - center) / period + 0.5) * period -
+	    MAPORIGIN * MAPSTEP;
+
+	 lo[0] = cx * CHUNKSIZE * MAPSTEP + c->offset[0];
+	 lo[1] = c->miny;
+	 lo[2] = cz * CHUNKSIZE * MAPSTEP + c->offset[1];
+	 hi[0] = lo[0] + CHUNKSIZE * MAPSTEP;
+	 hi[1] = c->maxy;
+	 hi[2] = lo[2] + CHUNKSIZE * MAPSTEP;
+
+	 c->visible = 1;
+	 for (i = 0; i < 6 && c->visible; i++) {
+	    if (planes[i][0] * (planes[i][0] > 0.0 ? hi[0] : lo[0]) +
+		planes[i][1] * (planes[i][1] > 0.0 ? hi[1] : lo[1]) +
+		planes[i][2] * (planes[i][2] > 0.0 ? hi[2] : lo[2]) +
+		planes[i][3] < 0.0)
+	       c->visible = 0;
+	 }
+
+	 for (i = 0; i < 3; i++) {
+	    GLfloat d = obs[i] < lo[i] ? lo[i] - obs[i] :
+	       obs[i] > hi[i] ? obs[i] - hi[i] : 0.0;
+	    dist += d * d;
+	 }
+	 dist = sqrt(dist);
+	 if (dist < 1.0)
+	    dist = 1.0;
+
+	 c->level = 0;
+	 while (uselod && c->level < MAXLEVEL &&
+		c->error[c->level + 1] * pixels / dist <= LODPIXELS)
+	    c->level++;
+      }
+   }
+
+   do {
+      changed = 0;
+      for (cz = 0; cz < NUMCHUNKS; cz++) {
+	 for (cx = 0; cx < NUMCHUNKS; cx++) {
+	    struct chunk *c = chunkat(cx, cz);
+	    const struct chunk *n[4];
+
+	    n[0] = chunkat(cx, cz - 1);
+	    n[1] = chunkat(cx + 1, cz);
+	    n[2] = chunkat(cx, cz + 1);
+	    n[3] = chunkat(cx - 1, cz);
+	    for (i = 0; i < 4; i++) {
+	       if (c->level > n[i]->level + 1) {
+		  c->level = n[i]->level + 1;
+		  changed = 1;
+	       }
+	    }
+	 }
+      }
+   } while (changed);
+}
+
+static void
+drawchunks(void)
+{
+   int cx, cz;
+
+   selectlods();
+
+   glBindBuffer(GL_ARRAY_BUFFER, chunkvbo);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunkibo);
+   glEnableClientState(GL_VERTEX_ARRAY);
+   glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+   glEnableClientState(GL_COLOR_ARRAY);
+
+   chunksdrawn = trisdrawn = 0;
+   for (cz = 0; cz < NUMCHUNKS; cz++) {
+      for (cx = 0; cx < NUMCHUNKS; cx++) {
+	 const struct chunk *c = chunkat(cx, cz);
+	 const int level = c->level;
+	 GLintptr base;
+	 int stitch = 0;
+
+	 if (!c->visible)
+	    continue;
+
+	 if (chunkat(cx, cz - 1)->level > level)
+	    stitch |= NORTH;
+	 if (chunkat(cx + 1, cz)->level > level)
+	    stitch |= EAST;
+	 if (chunkat(cx, cz + 1)->level > level)
+	    stitch |= SOUTH;
+	 if (chunkat(cx - 1, cz)->level > level)
+	    stitch |= WEST;
+
+	 base = (cz * NUMCHUNKS + cx) * CHUNKVERTS * CHUNKVERTS *
+	    sizeof(struct chunkvertex);
+	 glVertexPointer(3, GL_FLOAT, sizeof(struct chunkvertex),
+			 VOFFSET(base, x));
+	 glTexCoordPointer(2, GL_FLOAT, sizeof(struct chunkvertex),
+			   VOFFSET(base, s));
+	 glColorPointer(3, GL_UNSIGNED_BYTE, sizeof(struct chunkvertex),
+			VOFFSET(base, color));
+
+	 glPushMatrix();
+	 glTranslatef(c->offset[0], 0.0, c->offset[1]);
+	 glDrawElements(GL_TRIANGLES, lodcount[level][stitch],
+			GL_UNSIGNED_SHORT,
+			(const GLvoid *) lodoffset[level][stitch]);
+	 glPopMatrix();
+
+	 chunksdrawn++;
+	 trisdrawn += lodcount[level][stitch] / 3;
+      }
+   }
+
+   glDisableClientState(GL_VERTEX_ARRAY);
+   glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+   glDisableClientState(GL_COLOR_ARRAY);
+   glBindBuffer(GL_ARRAY_BUFFER, 0);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+static void
+drawstrips(int ox, int oy)
+{
+   int h, i, idx;
+   float j, k, start, end;
 
    for (h = 0, k = -(lenghtYmnt * stepYmnt) / 2; h < lenghtYmnt;
 	k += stepYmnt, h++) {
@@ -290,6 +703,25 @@ drawterrain(void)
       }
       glEnd();
    }
+}
+
+static void
+drawterrain(void)
+{
+   int ox, oy;
+
+   ox = (int) (obs[0] / stepXmnt);
+   oy = (int) (obs[2] / stepYmnt);
+   GlobalMnt = ((ox * TSCALE) & 255) + ((oy * TSCALE) & 255) * 256;
+
+   if (usevbo)
+      drawchunks();
+
+   glPushMatrix();
+   glTranslatef((float) ox * stepXmnt, 0, (float) oy * stepYmnt);
+
+   if (!usevbo)
+      drawstrips(ox, oy);
 
    glDisable(GL_CULL_FACE);
    glDisable(GL_TEXTURE_2D);
@@ -424,7 +856,11 @@ drawscene(void)
       if (t - T0 >= 2000) {
          GLfloat seconds = (t - T0) / 1000.0;
          GLfloat fps = Frames / seconds;
-         sprintf(frbuf, "Frame rate: %f", fps);
+         if (usevbo)
+            sprintf(frbuf, "Frame rate: %f  chunks: %d  triangles: %d",
+                    fps, chunksdrawn, trisdrawn);
+         else
+            sprintf(frbuf, "Frame rate: %f", fps);
          printf("%s\n", frbuf);
          fflush(stdout);
          T0 = t;
@@ -468,6 +904,12 @@ key(unsigned char k, int x, int y)
    case 't':
       usetex = (!usetex);
       break;
+   case 'v':
+      usevbo = (!usevbo && chunkvbo);
+      break;
+   case 'l':
+      uselod = (!uselod);
+      break;
    case 'b':
       if (bfcull) {
 	 glDisable(GL_CULL_FACE);
@@ -638,8 +1080,11 @@ main(int ac, char **av)
       return -1;
    }
 
+   glewInit();
+
    ModZMnt = 0.0f;
    loadpic();
+   initchunks();
 
    init();
 
@@ -12,9 +12,24 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <ctype.h>
+#include <stdint.h>
 #include "glm.h"
 #include "readtex.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#define GLM_HAVE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef PTHREADS
+#include <pthread.h>
+#endif
+
 
 typedef unsigned char boolean;
 #define TRUE 1
@@ -34,16 +49,6 @@ typedef unsigned char boolean;
 enum { X, Y, Z, W };			/* elements of a vertex */
 
 
-/* typedefs */
-
-/* _GLMnode: general purpose node
- */
-typedef struct _GLMnode {
-  uint           index;
-  boolean        averaged;
-  struct _GLMnode* next;
-} GLMnode;
-
 /* strdup is actually not a standard ANSI C or POSIX routine
    so implement a private one.  OpenVMS does not have a strdup; Linux's
    standard libc doesn't declare strdup by default (unless BSD or SVID
@@ -151,46 +156,328 @@ _glmEqual(float* u, float* v, float epsilon)
   return FALSE;
 }
 
+/* _glmNumThreads: number of threads to use for a job of the given
+ * size, one per CPU but no more than make a piece of at least minsize
+ * each.
+ *
+ * size    - size of the job
+ * minsize - smallest piece worth a thread
+ */
+static uint
+_glmNumThreads(size_t size, size_t minsize)
+{
+  uint numthreads = 1;
+
+#if defined(PTHREADS) && defined(_SC_NPROCESSORS_ONLN)
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (cpus > 1)
+    numthreads = cpus;
+#endif
+  if (numthreads > size / minsize + 1)
+    numthreads = size / minsize + 1;
+  return numthreads;
+}
+
+/* _glmRunThreads: run func on each of an array of jobs, one thread per
+ * job (the first job on the calling thread), and wait for them all.
+ * Runs the jobs in turn without PTHREADS, or if a thread can't be
+ * created.
+ *
+ * func    - function to run, with a pointer to its job
+ * jobs    - array of jobs
+ * jobsize - size of a job in bytes
+ * numjobs - number of jobs
+ */
+static void
+_glmRunThreads(void* (*func)(void*), void* jobs, size_t jobsize,
+               uint numjobs)
+{
+  char* job = (char*)jobs;
+  uint i;
+
+#ifdef PTHREADS
+  if (numjobs > 1) {
+    pthread_t* threads = (pthread_t*)malloc(numjobs * sizeof(pthread_t));
+    boolean* started = (boolean*)calloc(numjobs, sizeof(boolean));
+
+    for (i = 1; i < numjobs; i++) {
+      if (pthread_create(&threads[i], NULL, func, job + i * jobsize) == 0)
+        started[i] = TRUE;
+      else
+        func(job + i * jobsize);	/* run it here instead */
+    }
+    func(job);
+    for (i = 1; i < numjobs; i++) {
+      if (started[i])
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    free(started);
+    return;
+  }
+#endif
+
+  for (i = 0; i < numjobs; i++)
+    func(job + i * jobsize);
+}
+
+/* GLMweldentry: a vector in the spatial hash, with a copy of its
+ * coordinates so searching a bucket doesn't jump around in memory.
+ */
+typedef struct {
+  uint  index;
+  float v[3];
+} GLMweldentry;
+
+/* GLMweldgrid: spatial hash of vectors.  Space is divided into cells
+ * of twice epsilon size, so the vectors within epsilon of a vector are
+ * in its cell or in the neighbor cell on the nearer side, 8 cells in
+ * all.  The cells are hashed into buckets and the vectors of each
+ * bucket are listed in ascending order.
+ */
+typedef struct {
+  double  scale;			/* 1 / (2 * epsilon) */
+  uint    mask;				/* number of buckets - 1 */
+  uint*   start;			/* first entry of each bucket */
+  GLMweldentry* entries;		/* vectors by bucket */
+} GLMweldgrid;
+
+/* GLMweldjob: candidate search over a range of vectors, for a thread.
+ */
+typedef struct {
+  const GLMweldgrid* grid;
+  const float* vectors;
+  float        epsilon;
+  uint         first, last;		/* range of vectors to do */
+  uint*        match;			/* lowest matching index, 0 = none */
+} GLMweldjob;
+
+/* _glmWeldClamp: cell coordinate from a scaled vector component,
+ * clamped so tiny epsilons and huge coordinates don't overflow.
+ */
+static int64_t
+_glmWeldClamp(double c)
+{
+  if (c > 4.0e18)
+    return (int64_t)4e18;
+  if (c < -4.0e18 || c != c)
+    return (int64_t)-4e18;
+  return (int64_t)c;
+}
+
+static uint
+_glmWeldHash(const GLMweldgrid* grid, int64_t x, int64_t y, int64_t z)
+{
+  uint64_t h = (uint64_t)x * 73856093u ^ (uint64_t)y * 19349663u ^
+               (uint64_t)z * 83492791u;
+  return (uint)(h ^ (h >> 32)) & grid->mask;
+}
+
+/* _glmWeldGrid: build the spatial hash of vectors 1..numvectors.
+ */
+static void
+_glmWeldGrid(GLMweldgrid* grid, const float* vectors, uint numvectors,
+             float epsilon)
+{
+  uint* bucket;
+  uint buckets, i;
+
+  buckets = 1024;
+  while (buckets < numvectors && buckets < 0x80000000u)
+    buckets *= 2;
+
+  grid->scale = 0.5 / epsilon;
+  grid->mask = buckets - 1;
+  grid->start = (uint*)calloc(buckets + 1, sizeof(uint));
+  grid->entries = (GLMweldentry*)malloc(sizeof(GLMweldentry) *
+                                        (numvectors + 1));
+  bucket = (uint*)malloc(sizeof(uint) * (numvectors + 1));
+
+  /* counting sort of the vectors by bucket, keeping them in order */
+  for (i = 1; i <= numvectors; i++) {
+    const float* v = &vectors[3 * i];
+    bucket[i] = _glmWeldHash(grid,
+                             _glmWeldClamp(floor(v[0] * grid->scale)),
+                             _glmWeldClamp(floor(v[1] * grid->scale)),
+                             _glmWeldClamp(floor(v[2] * grid->scale)));
+    grid->start[bucket[i] + 1]++;
+  }
+  for (i = 0; i < buckets; i++)
+    grid->start[i + 1] += grid->start[i];
+  for (i = 1; i <= numvectors; i++) {
+    GLMweldentry* e = &grid->entries[grid->start[bucket[i]]++];
+    e->index = i;
+    memcpy(e->v, &vectors[3 * i], sizeof(e->v));
+  }
+  /* start[b] is now the end of bucket b, shift back */
+  for (i = buckets; i > 0; i--)
+    grid->start[i] = grid->start[i - 1];
+  grid->start[0] = 0;
+
+  free(bucket);
+}
+
+/* _glmWeldFind: find the lowest index below i of a vector within
+ * epsilon of vector i.  Returns 0 if there is none.
+ *
+ * keep - if not NULL, only consider vectors with keep[k] == k
+ */
+static uint
+_glmWeldFind(const GLMweldgrid* grid, const float* vectors, float epsilon,
+             uint i, const uint* keep)
+{
+  const float* v = &vectors[3 * i];
+  int64_t lo[3], hi[3];
+  int64_t x, y, z;
+  uint best = i;
+  int c;
+
+  /* the cells covered by v +/- epsilon; probe both neighbors when v is
+     so close to the middle of its cell that rounding could matter */
+  for (c = 0; c < 3; c++) {
+    double t = v[c] * grid->scale;
+    double f = t - floor(t);
+    lo[c] = hi[c] = _glmWeldClamp(floor(t));
+    if (f < 0.5 + 1e-4)
+      lo[c]--;
+    if (f > 0.5 - 1e-4)
+      hi[c]++;
+  }
+
+  for (z = lo[2]; z <= hi[2]; z++) {
+    for (y = lo[1]; y <= hi[1]; y++) {
+      for (x = lo[0]; x <= hi[0]; x++) {
+        uint b = _glmWeldHash(grid, x, y, z);
+        uint e;
+
+        /* entries are ascending, so stop at the first one found */
+        for (e = grid->start[b]; e < grid->start[b + 1]; e++) {
+          const GLMweldentry* entry = &grid->entries[e];
+          uint k = entry->index;
+          if (k >= best)
+            break;
+          if ((!keep || keep[k] == k) &&
+              _glmEqual((float*)entry->v, (float*)v, epsilon)) {
+            best = k;
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  return best < i ? best : 0;
+}
+
+static void*
+_glmWeldJob(void* arg)
+{
+  GLMweldjob* job = (GLMweldjob*)arg;
+  uint i;
+
+  for (i = job->first; i < job->last; i++)
+    job->match[i] = _glmWeldFind(job->grid, job->vectors, job->epsilon,
+                                 i, NULL);
+  return NULL;
+}
+
 /* _glmWeldVectors: eliminate (weld) vectors that are within an
- * epsilon of each other.
+ * epsilon of each other.  Vectors are kept in order and each vector is
+ * welded to the first kept vector within epsilon, if any.
+ *
+ * The vectors are put in a spatial hash with cells of twice epsilon,
+ * so only the 8 cells on the near side of a vector (a few more when it
+ * lies right at a cell's middle) need to be searched.  The search
+ * for the first matching vector of any kind is done in parallel; only
+ * when that one was itself welded away is the search repeated
+ * serially, among kept vectors.  So the result is the same for any
+ * number of threads.
  *
  * vectors    - array of float[3]'s to be welded
  * numvectors - number of float[3]'s in vectors
  * epsilon    - maximum difference between vectors 
+ * numthreads - number of threads to use, 0 = one per CPU
  *
  */
 static float*
-_glmWeldVectors(float* vectors, uint* numvectors, float epsilon)
+_glmWeldVectors(float* vectors, uint* numvectors, float epsilon,
+                uint numthreads)
 {
+  GLMweldgrid grid;
+  GLMweldjob* jobs;
   float* copies;
+  uint*  match;
+  uint*  keep;
   uint   copied;
-  uint   i, j;
+  uint   n = *numvectors;
+  uint   i;
 
-  copies = (float*)malloc(sizeof(float) * 3 * (*numvectors + 1));
-  memcpy(copies, vectors, (sizeof(float) * 3 * (*numvectors + 1)));
+  copies = (float*)malloc(sizeof(float) * 3 * (n + 1));
+  memcpy(copies, vectors, (sizeof(float) * 3 * (n + 1)));
 
-  copied = 1;
-  for (i = 1; i <= *numvectors; i++) {
-    for (j = 1; j <= copied; j++) {
-      if (_glmEqual(&vectors[3 * i], &copies[3 * j], epsilon)) {
-	goto duplicate;
-      }
-    }
+  /* nothing is within a non-positive epsilon */
+  if (!(epsilon > 0.0)) {
+    for (i = 1; i <= n; i++)
+      vectors[3 * i + 0] = (float)i;
+    return copies;
+  }
+
+  _glmWeldGrid(&grid, vectors, n, epsilon);
+  match = (uint*)malloc(sizeof(uint) * (n + 1));
+  keep = (uint*)malloc(sizeof(uint) * (n + 1));
+
+  /* find the first matching vector of each vector */
+  if (numthreads == 0)
+    numthreads = _glmNumThreads(n, 64 * 1024);
+#ifndef PTHREADS
+  numthreads = 1;
+#endif
+  jobs = (GLMweldjob*)calloc(numthreads, sizeof(GLMweldjob));
+  for (i = 0; i < numthreads; i++) {
+    jobs[i].grid = &grid;
+    jobs[i].vectors = vectors;
+    jobs[i].epsilon = epsilon;
+    jobs[i].first = 1 + (uint)((uint64_t)n * i / numthreads);
+    jobs[i].last = 1 + (uint)((uint64_t)n * (i + 1) / numthreads);
+    jobs[i].match = match;
+  }
 
-    /* must not be any duplicates -- add to the copies array */
-    copies[3 * copied + 0] = vectors[3 * i + 0];
-    copies[3 * copied + 1] = vectors[3 * i + 1];
-    copies[3 * copied + 2] = vectors[3 * i + 2];
-    j = copied;				/* pass this along for below */
-    copied++;
+  _glmRunThreads(_glmWeldJob, jobs, sizeof(GLMweldjob), numthreads);
+  free(jobs);
+
+  /* decide which vectors are kept, in order.  The first match is the
+     answer unless it was welded itself, then look among kept ones. */
+  for (i = 1; i <= n; i++) {
+    uint k = match[i];
+    if (k && keep[k] != k)
+      k = _glmWeldFind(&grid, vectors, epsilon, i, keep);
+    keep[i] = k ? k : i;
+  }
 
-  duplicate:
-    /* set the first component of this vector to point at the correct
-       index into the new copies array */
-    vectors[3 * i + 0] = (float)j;
+  /* copy the kept vectors and renumber, reusing match[] for the new
+     index of each kept vector */
+  copied = 0;
+  for (i = 1; i <= n; i++) {
+    if (keep[i] == i) {
+      copied++;
+      copies[3 * copied + 0] = vectors[3 * i + 0];
+      copies[3 * copied + 1] = vectors[3 * i + 1];
+      copies[3 * copied + 2] = vectors[3 * i + 2];
+      match[i] = copied;
+    }
   }
 
-  *numvectors = copied-1;
+  /* set the first component of each vector to point at the correct
+     index into the new copies array */
+  for (i = 1; i <= n; i++)
+    vectors[3 * i + 0] = (float)match[keep[i]];
+
+  free(match);
+  free(keep);
+  free(grid.start);
+  free(grid.entries);
+
+  *numvectors = copied;
   return copies;
 }
 
@@ -227,6 +514,9 @@ _glmAddGroup(GLMmodel* model, char* name)
     group->material = 0;
     group->numtriangles = 0;
     group->triangles = NULL;
+    group->triIndexes = NULL;
+    memset(group->lodTriangles, 0, sizeof(group->lodTriangles));
+    memset(group->lodDataOffset, 0, sizeof(group->lodDataOffset));
     group->next = model->groups;
     model->groups = group;
     model->numgroups++;
@@ -280,6 +570,30 @@ _glmDirName(char* path)
 }
 
 
+/* _glmMTLPath: return the path of a material library, which is
+ * relative to the model file
+ *
+ * modelpath - path of the model file
+ * name      - name of the material library
+ *
+ * The return value should be free'd.
+ */
+static char*
+_glmMTLPath(char* modelpath, const char* name)
+{
+  char* dir;
+  char* filename;
+
+  dir = _glmDirName(modelpath);
+  filename = (char*)malloc(sizeof(char) * (strlen(dir) + strlen(name) + 1));
+  strcpy(filename, dir);
+  strcat(filename, name);
+  free(dir);
+
+  return filename;
+}
+
+
 /* _glmReadMTL: read a wavefront material library file
  *
  * model - properly initialized GLMmodel structure
@@ -289,17 +603,12 @@ static void
 _glmReadMTL(GLMmodel* model, char* name)
 {
   FILE* file;
-  char* dir;
   char* filename;
   char  buf[128], buf2[128];
   uint nummaterials, i;
   GLMmaterial *mat;
 
-  dir = _glmDirName(model->pathname);
-  filename = (char*)malloc(sizeof(char) * (strlen(dir) + strlen(name) + 1));
-  strcpy(filename, dir);
-  strcat(filename, name);
-  free(dir);
+  filename = _glmMTLPath(model->pathname, name);
 
   /* open the file */
   file = fopen(filename, "r");
@@ -480,384 +789,708 @@ _glmWriteMTL(GLMmodel* model, char* modelpath, char* mtllibname)
 }
 
 
-/* _glmFirstPass: first pass at a Wavefront OBJ file that gets all the
- * statistics of the model (such as #vertices, #normals, etc)
+/* _glmGrow: make sure a growable array has room for at least 'needed'
+ * elements of 'size' bytes, doubling its capacity as required.
  *
- * model - properly initialized GLMmodel structure
- * file  - (fopen'd) file descriptor 
+ * array    - pointer to the array pointer (may point at NULL)
+ * capacity - current capacity in elements, updated
+ * needed   - number of elements required
+ * size     - size of one element in bytes
  */
 static void
-_glmFirstPass(GLMmodel* model, FILE* file) 
+_glmGrow(void** array, uint* capacity, uint needed, size_t size)
 {
-  uint    numvertices;		/* number of vertices in model */
-  uint    numnormals;			/* number of normals in model */
-  uint    numtexcoords;		/* number of texcoords in model */
-  uint    numtriangles;		/* number of triangles in model */
-  GLMgroup* group;			/* current group */
-  unsigned  v, n, t;
-  char      buf[128];
+  uint cap = *capacity;
 
-  /* make a default group */
-  group = _glmAddGroup(model, "default");
+  if (needed <= cap)
+    return;
 
-  numvertices = numnormals = numtexcoords = numtriangles = 0;
-  while(fscanf(file, "%s", buf) != EOF) {
-    switch(buf[0]) {
-    case '#':				/* comment */
-      /* eat up rest of line */
-      fgets(buf, sizeof(buf), file);
-      break;
-    case 'v':				/* v, vn, vt */
-      switch(buf[1]) {
-      case '\0':			/* vertex */
-	/* eat up rest of line */
-	fgets(buf, sizeof(buf), file);
-	numvertices++;
-	break;
-      case 'n':				/* normal */
-	/* eat up rest of line */
-	fgets(buf, sizeof(buf), file);
-	numnormals++;
-	break;
-      case 't':				/* texcoord */
-	/* eat up rest of line */
-	fgets(buf, sizeof(buf), file);
-	numtexcoords++;
-	break;
-      default:
-	printf("_glmFirstPass(): Unknown token \"%s\".\n", buf);
-	exit(1);
-	break;
-      }
-      break;
-    case 'm':
-      fgets(buf, sizeof(buf), file);
-      sscanf(buf, "%s %s", buf, buf);
-      model->mtllibname = stralloc(buf);
-      _glmReadMTL(model, buf);
-      break;
-    case 'u':
-      /* eat up rest of line */
-      fgets(buf, sizeof(buf), file);
-      break;
-    case 'g':				/* group */
-      /* eat up rest of line */
-      fgets(buf, sizeof(buf), file);
-      sscanf(buf, "%s", buf);
-      group = _glmAddGroup(model, buf);
-      break;
-    case 'f':				/* face */
-      v = n = t = 0;
-      fscanf(file, "%s", buf);
-      /* can be one of %d, %d//%d, %d/%d, %d/%d/%d %d//%d */
-      if (strstr(buf, "//")) {
-	/* v//n */
-	sscanf(buf, "%u//%u", &v, &n);
-	fscanf(file, "%u//%u", &v, &n);
-	fscanf(file, "%u//%u", &v, &n);
-	numtriangles++;
-	group->numtriangles++;
-	while(fscanf(file, "%u//%u", &v, &n) > 0) {
-	  numtriangles++;
-	  group->numtriangles++;
-	}
-      } else if (sscanf(buf, "%u/%u/%u", &v, &t, &n) == 3) {
-	/* v/t/n */
-	fscanf(file, "%u/%u/%u", &v, &t, &n);
-	fscanf(file, "%u/%u/%u", &v, &t, &n);
-	numtriangles++;
-	group->numtriangles++;
-	while(fscanf(file, "%u/%u/%u", &v, &t, &n) > 0) {
-	  numtriangles++;
-	  group->numtriangles++;
-	}
-      } else if (sscanf(buf, "%u/%u", &v, &t) == 2) {
-	/* v/t */
-	fscanf(file, "%u/%u", &v, &t);
-	fscanf(file, "%u/%u", &v, &t);
-	numtriangles++;
-	group->numtriangles++;
-	while(fscanf(file, "%u/%u", &v, &t) > 0) {
-	  numtriangles++;
-	  group->numtriangles++;
-	}
-      } else {
-	/* v */
-	fscanf(file, "%u", &v);
-	fscanf(file, "%u", &v);
-	numtriangles++;
-	group->numtriangles++;
-	while(fscanf(file, "%u", &v) > 0) {
-	  numtriangles++;
-	  group->numtriangles++;
-	}
-      }
-      break;
+  if (cap < 64)
+    cap = 64;
+  while (cap < needed)
+    cap *= 2;
 
-    default:
-      /* eat up rest of line */
-      fgets(buf, sizeof(buf), file);
-      break;
+  *array = realloc(*array, cap * size);
+  if (!*array) {
+    fprintf(stderr, "glmReadOBJ() failed: out of memory.\n");
+    exit(1);
+  }
+  *capacity = cap;
+}
+
+/* _glmAddGroupTriangle: append a triangle index to a group.  The group
+ * array capacity is implied by numtriangles (the next power of two
+ * >= 64), so no extra bookkeeping is needed in GLMgroup.
+ */
+static void
+_glmAddGroupTriangle(GLMgroup* group, uint triangle)
+{
+  uint n = group->numtriangles;
+
+  if (n == 0 || (n >= 64 && (n & (n - 1)) == 0)) {
+    uint cap = n < 64 ? 64 : 2 * n;
+    group->triangles = (uint*)realloc(group->triangles, cap * sizeof(uint));
+    if (!group->triangles) {
+      fprintf(stderr, "glmReadOBJ() failed: out of memory.\n");
+      exit(1);
     }
   }
+  group->triangles[group->numtriangles++] = triangle;
+}
 
-#if 0
-  /* announce the model statistics */
-  printf(" Vertices: %d\n", numvertices);
-  printf(" Normals: %d\n", numnormals);
-  printf(" Texcoords: %d\n", numtexcoords);
-  printf(" Triangles: %d\n", numtriangles);
-  printf(" Groups: %d\n", model->numgroups);
-#endif
+/* _glmSkipSpace: skip blanks, but not line ends */
+static const char*
+_glmSkipSpace(const char* p, const char* end)
+{
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+    p++;
+  return p;
+}
 
-  /* set the stats in the model structure */
-  model->numvertices  = numvertices;
-  model->numnormals   = numnormals;
-  model->numtexcoords = numtexcoords;
-  model->numtriangles = numtriangles;
+/* _glmSkipLine: skip past the end of the current line */
+static const char*
+_glmSkipLine(const char* p, const char* end)
+{
+  p = memchr(p, '\n', end - p);
+  return p ? p + 1 : end;
+}
 
-  /* allocate memory for the triangles in each group */
-  group = model->groups;
-  while(group) {
-    group->triangles = (uint*)malloc(sizeof(uint) * group->numtriangles);
-    group->numtriangles = 0;
-    group = group->next;
+/* _glmToken: copy the next blank-delimited word of the current line
+ * into buf (truncated to size - 1 characters).  Returns a pointer past
+ * the word; buf is empty if the line has no more words.
+ */
+static const char*
+_glmToken(const char* p, const char* end, char* buf, uint size)
+{
+  uint n = 0;
+
+  p = _glmSkipSpace(p, end);
+  while (p < end && !isspace((unsigned char)*p)) {
+    if (n < size - 1)
+      buf[n++] = *p;
+    p++;
   }
+  buf[n] = '\0';
+  return p;
 }
 
-/* _glmSecondPass: second pass at a Wavefront OBJ file that gets all
- * the data.
- *
- * model - properly initialized GLMmodel structure
- * file  - (fopen'd) file descriptor 
+/* _glmParseFloat: parse a decimal floating point number.  Handles the
+ * plain [-+]digits[.digits][e[-+]digits] forms found in .obj files
+ * without going through the locale-aware libc routines, and falls back
+ * to strtod() for anything else (inf, nan, hex floats).  Returns a
+ * pointer past the number, or p itself if there is none.
  */
-static void
-_glmSecondPass(GLMmodel* model, FILE* file) 
-{
-  uint    numvertices;		/* number of vertices in model */
-  uint    numnormals;			/* number of normals in model */
-  uint    numtexcoords;		/* number of texcoords in model */
-  uint    numtriangles;		/* number of triangles in model */
-  float*  vertices;			/* array of vertices  */
-  float*  normals;			/* array of normals */
-  float*  texcoords;			/* array of texture coordinates */
-  GLMgroup* group;			/* current group pointer */
-  uint    material;			/* current material */
-  uint    v, n, t;
-  char      buf[128];
-
-  /* set the pointer shortcuts */
-  vertices     = model->vertices;
-  normals      = model->normals;
-  texcoords    = model->texcoords;
-  group        = model->groups;
-
-  /* on the second pass through the file, read all the data into the
-     allocated arrays */
-  numvertices = numnormals = numtexcoords = 1;
-  numtriangles = 0;
-  material = 0;
-  while(fscanf(file, "%s", buf) != EOF) {
-    switch(buf[0]) {
-    case '#':				/* comment */
-      /* eat up rest of line */
-      fgets(buf, sizeof(buf), file);
-      break;
-    case 'v':				/* v, vn, vt */
-      switch(buf[1]) {
-      case '\0':			/* vertex */
-	fscanf(file, "%f %f %f", 
-	       &vertices[3 * numvertices + X], 
-	       &vertices[3 * numvertices + Y], 
-	       &vertices[3 * numvertices + Z]);
-	numvertices++;
-	break;
-      case 'n':				/* normal */
-	fscanf(file, "%f %f %f", 
-	       &normals[3 * numnormals + X],
-	       &normals[3 * numnormals + Y], 
-	       &normals[3 * numnormals + Z]);
-	numnormals++;
-	break;
-      case 't':				/* texcoord */
-	fscanf(file, "%f %f", 
-	       &texcoords[2 * numtexcoords + X],
-	       &texcoords[2 * numtexcoords + Y]);
-	numtexcoords++;
-	break;
-      }
-      break;
-    case 'u':
-      fgets(buf, sizeof(buf), file);
-      sscanf(buf, "%s %s", buf, buf);
-      material = _glmFindMaterial(model, buf);
-      if (!group->material)
-         group->material = material;
-      /*printf("material %s = %u\n", buf, material);*/
-      break;
-    case 'g':				/* group */
-      /* eat up rest of line */
-      fgets(buf, sizeof(buf), file);
-      sscanf(buf, "%s", buf);
-      group = _glmFindGroup(model, buf);
-      group->material = material;
-      /*printf("GROUP %s  material %u\n", buf, material);*/
-      break;
-    case 'f':				/* face */
-      v = n = t = 0;
-      fscanf(file, "%s", buf);
-      /* can be one of %d, %d//%d, %d/%d, %d/%d/%d %d//%d */
-      if (strstr(buf, "//")) {
-	/* v//n */
-	sscanf(buf, "%u//%u", &v, &n);
-	T(numtriangles).vindices[0] = v;
-	T(numtriangles).nindices[0] = n;
-	fscanf(file, "%u//%u", &v, &n);
-	T(numtriangles).vindices[1] = v;
-	T(numtriangles).nindices[1] = n;
-	fscanf(file, "%u//%u", &v, &n);
-	T(numtriangles).vindices[2] = v;
-	T(numtriangles).nindices[2] = n;
-	group->triangles[group->numtriangles++] = numtriangles;
-	numtriangles++;
-	while(fscanf(file, "%u//%u", &v, &n) > 0) {
-	  T(numtriangles).vindices[0] = T(numtriangles-1).vindices[0];
-	  T(numtriangles).nindices[0] = T(numtriangles-1).nindices[0];
-	  T(numtriangles).vindices[1] = T(numtriangles-1).vindices[2];
-	  T(numtriangles).nindices[1] = T(numtriangles-1).nindices[2];
-	  T(numtriangles).vindices[2] = v;
-	  T(numtriangles).nindices[2] = n;
-	  group->triangles[group->numtriangles++] = numtriangles;
-	  numtriangles++;
-	}
-      } else if (sscanf(buf, "%u/%u/%u", &v, &t, &n) == 3) {
-	/* v/t/n */
-	T(numtriangles).vindices[0] = v;
-	T(numtriangles).tindices[0] = t;
-	T(numtriangles).nindices[0] = n;
-	fscanf(file, "%u/%u/%u", &v, &t, &n);
-	T(numtriangles).vindices[1] = v;
-	T(numtriangles).tindices[1] = t;
-	T(numtriangles).nindices[1] = n;
-	fscanf(file, "%u/%u/%u", &v, &t, &n);
-	T(numtriangles).vindices[2] = v;
-	T(numtriangles).tindices[2] = t;
-	T(numtriangles).nindices[2] = n;
-	group->triangles[group->numtriangles++] = numtriangles;
-	numtriangles++;
-	while(fscanf(file, "%u/%u/%u", &v, &t, &n) > 0) {
-	  T(numtriangles).vindices[0] = T(numtriangles-1).vindices[0];
-	  T(numtriangles).tindices[0] = T(numtriangles-1).tindices[0];
-	  T(numtriangles).nindices[0] = T(numtriangles-1).nindices[0];
-	  T(numtriangles).vindices[1] = T(numtriangles-1).vindices[2];
-	  T(numtriangles).tindices[1] = T(numtriangles-1).tindices[2];
-	  T(numtriangles).nindices[1] = T(numtriangles-1).nindices[2];
-	  T(numtriangles).vindices[2] = v;
-	  T(numtriangles).tindices[2] = t;
-	  T(numtriangles).nindices[2] = n;
-	  group->triangles[group->numtriangles++] = numtriangles;
-	  numtriangles++;
-	}
-      } else if (sscanf(buf, "%u/%u", &v, &t) == 2) {
-	/* v/t */
-	T(numtriangles).vindices[0] = v;
-	T(numtriangles).tindices[0] = t;
-	fscanf(file, "%u/%u", &v, &t);
-	T(numtriangles).vindices[1] = v;
-	T(numtriangles).tindices[1] = t;
-	fscanf(file, "%u/%u", &v, &t);
-	T(numtriangles).vindices[2] = v;
-	T(numtriangles).tindices[2] = t;
-	group->triangles[group->numtriangles++] = numtriangles;
-	numtriangles++;
-	while(fscanf(file, "%u/%u", &v, &t) > 0) {
-	  T(numtriangles).vindices[0] = T(numtriangles-1).vindices[0];
-	  T(numtriangles).tindices[0] = T(numtriangles-1).tindices[0];
-	  T(numtriangles).vindices[1] = T(numtriangles-1).vindices[2];
-	  T(numtriangles).tindices[1] = T(numtriangles-1).tindices[2];
-	  T(numtriangles).vindices[2] = v;
-	  T(numtriangles).tindices[2] = t;
-	  group->triangles[group->numtriangles++] = numtriangles;
-	  numtriangles++;
-	}
-      } else {
-	/* v */
-	sscanf(buf, "%u", &v);
-	T(numtriangles).vindices[0] = v;
-	fscanf(file, "%u", &v);
-	T(numtriangles).vindices[1] = v;
-	fscanf(file, "%u", &v);
-	T(numtriangles).vindices[2] = v;
-	group->triangles[group->numtriangles++] = numtriangles;
-	numtriangles++;
-	while(fscanf(file, "%u", &v) > 0) {
-	  T(numtriangles).vindices[0] = T(numtriangles-1).vindices[0];
-	  T(numtriangles).vindices[1] = T(numtriangles-1).vindices[2];
-	  T(numtriangles).vindices[2] = v;
-	  group->triangles[group->numtriangles++] = numtriangles;
-	  numtriangles++;
-	}
-      }
-      break;
-
-    default:
-      /* eat up rest of line */
-      fgets(buf, sizeof(buf), file);
-      break;
+static const char*
+_glmParseFloat(const char* p, const char* end, float* f)
+{
+  static const double pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+  const char* start;
+  double mantissa = 0.0;
+  int exponent = 0, digits = 0;
+  boolean negative = FALSE;
+
+  p = _glmSkipSpace(p, end);
+  start = p;
+
+  if (p < end && (*p == '-' || *p == '+'))
+    negative = *p++ == '-';
+
+  while (p < end && *p >= '0' && *p <= '9') {
+    mantissa = mantissa * 10.0 + (*p++ - '0');
+    digits++;
+  }
+  if (p < end && *p == '.') {
+    p++;
+    while (p < end && *p >= '0' && *p <= '9') {
+      mantissa = mantissa * 10.0 + (*p++ - '0');
+      exponent--;
+      digits++;
     }
   }
 
-#if 0
-  /* announce the memory requirements */
-  printf(" Memory: %d bytes\n",
-	 numvertices  * 3*sizeof(float) +
-	 numnormals   * 3*sizeof(float) * (numnormals ? 1 : 0) +
-	 numtexcoords * 3*sizeof(float) * (numtexcoords ? 1 : 0) +
-	 numtriangles * sizeof(GLMtriangle));
-#endif
-}
+  if (digits == 0) {
+    /* not a plain decimal number */
+    char buf[64];
+    char* stop;
 
+    _glmToken(start, end, buf, sizeof(buf));
+    *f = (float)strtod(buf, &stop);
+    if (stop == buf)
+      return start;
+    return _glmSkipSpace(start, end) + (stop - buf);
+  }
 
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char* q = p + 1;
+    boolean negexp = FALSE;
+    int e = 0;
+
+    if (q < end && (*q == '-' || *q == '+'))
+      negexp = *q++ == '-';
+    if (q < end && *q >= '0' && *q <= '9') {
+      while (q < end && *q >= '0' && *q <= '9') {
+        if (e < 10000)
+          e = e * 10 + (*q - '0');
+        q++;
+      }
+      exponent += negexp ? -e : e;
+      p = q;
+    }
+  }
 
+  while (exponent < -22) {
+    mantissa /= 1e22;
+    exponent += 22;
+  }
+  while (exponent > 22) {
+    mantissa *= 1e22;
+    exponent -= 22;
+  }
+  if (exponent < 0)
+    mantissa /= pow10[-exponent];
+  else
+    mantissa *= pow10[exponent];
 
-/* public functions */
+  *f = (float)(negative ? -mantissa : mantissa);
+  return p;
+}
 
-/* glmUnitize: "unitize" a model by translating it to the origin and
- * scaling it to fit in a unit cube around the origin.  Returns the
- * scalefactor used.
+/* _glmParseIndex: parse a (possibly negative, i.e. relative) .obj
+ * index.  Relative indices are resolved against the number of elements
+ * read so far in the current chunk and flagged, so they can be rebased
+ * once the counts of the preceding chunks are known.  Returns a pointer
+ * past the number, or p itself if there is none.
  *
- * model - properly initialized GLMmodel structure 
+ * count    - number of elements read so far in this chunk
+ * relative - set to TRUE if the index was relative
  */
-float
-glmUnitize(GLMmodel* model)
+static const char*
+_glmParseIndex(const char* p, const char* end, uint count, uint* index,
+               boolean* relative)
 {
-  uint  i;
-  float maxx, minx, maxy, miny, maxz, minz;
-  float cx, cy, cz, w, h, d;
-  float scale;
-
-  assert(model);
-  assert(model->vertices);
+  const char* start = p;
+  boolean negative = FALSE;
+  uint i = 0;
 
-  /* get the max/mins */
-  maxx = minx = model->vertices[3 + X];
-  maxy = miny = model->vertices[3 + Y];
-  maxz = minz = model->vertices[3 + Z];
-  for (i = 1; i <= model->numvertices; i++) {
-    if (maxx < model->vertices[3 * i + X])
-      maxx = model->vertices[3 * i + X];
-    if (minx > model->vertices[3 * i + X])
-      minx = model->vertices[3 * i + X];
+  if (p < end && *p == '-') {
+    negative = TRUE;
+    p++;
+  }
+  if (p == end || *p < '0' || *p > '9')
+    return start;
+  while (p < end && *p >= '0' && *p <= '9')
+    i = i * 10 + (*p++ - '0');
+
+  *index = negative ? count + 1 - i : i;
+  *relative = negative;
+  return p;
+}
 
-    if (maxy < model->vertices[3 * i + Y])
-      maxy = model->vertices[3 * i + Y];
-    if (miny > model->vertices[3 * i + Y])
-      miny = model->vertices[3 * i + Y];
+/* _glmMapFile: read a whole file into memory, with mmap() if possible.
+ * Returns NULL if the file can't be opened or there isn't enough
+ * memory to read it.
+ *
+ * filename - name of the file
+ * size     - returns the size of the file
+ * mapped   - returns TRUE if the memory must be released with munmap()
+ *            rather than free()
+ */
+static char*
+_glmMapFile(const char* filename, size_t* size, boolean* mapped)
+{
+  FILE* file;
+  char* data;
+  long  len;
 
-    if (maxz < model->vertices[3 * i + Z])
-      maxz = model->vertices[3 * i + Z];
-    if (minz > model->vertices[3 * i + Z])
-      minz = model->vertices[3 * i + Z];
+#ifdef GLM_HAVE_MMAP
+  {
+    struct stat st;
+    int fd = open(filename, O_RDONLY);
+
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+      data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        madvise(data, st.st_size, MADV_SEQUENTIAL);
+        close(fd);
+        *size = st.st_size;
+        *mapped = TRUE;
+        return data;
+      }
+    }
+    if (fd >= 0)
+      close(fd);
+  }
+#endif
+
+  /* fall back to reading the file */
+  *mapped = FALSE;
+  file = fopen(filename, "rb");
+  if (!file)
+    return NULL;
+
+  fseek(file, 0, SEEK_END);
+  len = ftell(file);
+  rewind(file);
+  if (len < 0)
+    len = 0;
+
+  data = (char*)malloc(len + 1);
+  if (!data) {
+    fclose(file);
+    return NULL;
+  }
+  *size = fread(data, 1, len, file);
+  fclose(file);
+  return data;
+}
+
+/* _glmUnmapFile: release memory returned by _glmMapFile() */
+static void
+_glmUnmapFile(char* data, size_t size, boolean mapped)
+{
+#ifdef GLM_HAVE_MMAP
+  if (mapped) {
+    munmap(data, size);
+    return;
+  }
+#endif
+  free(data);
+}
+
+
+/* Everything in an OBJ file that depends on state built up by earlier
+ * lines (groups, materials) is recorded as an event while parsing, and
+ * replayed in file order by _glmStitchChunks().  That way chunks of the
+ * file can be parsed independently.
+ */
+enum { GLM_EV_FACES, GLM_EV_GROUP, GLM_EV_USEMTL, GLM_EV_MTLLIB };
+
+typedef struct {
+  uint  type;
+  uint  count;				/* triangles, for GLM_EV_FACES */
+  char* name;				/* group/material/library name */
+} GLMevent;
+
+/* GLMchunk: the data parsed from one piece of an OBJ file.  Element 0
+ * of vertices, normals and texcoords is unused, as in GLMmodel, and
+ * triangle indices are 1-based within the chunk (absolute indices are
+ * left as they are).  The findex of each triangle holds a bit per
+ * relative index, see _glmRebaseTriangles().
+ */
+typedef struct {
+  const char*  start;			/* text to parse */
+  const char*  end;
+
+  uint         numvertices, maxvertices;
+  float*       vertices;
+  uint         numnormals, maxnormals;
+  float*       normals;
+  uint         numtexcoords, maxtexcoords;
+  float*       texcoords;
+  uint         numtriangles, maxtriangles;
+  GLMtriangle* triangles;
+  uint         numevents, maxevents;
+  GLMevent*    events;
+} GLMchunk;
+
+/* _glmAddEvent: append an event to a chunk */
+static void
+_glmAddEvent(GLMchunk* chunk, uint type, const char* name)
+{
+  GLMevent* ev;
+
+  _glmGrow((void**)&chunk->events, &chunk->maxevents,
+           chunk->numevents + 1, sizeof(GLMevent));
+  ev = &chunk->events[chunk->numevents++];
+  ev->type = type;
+  ev->count = 0;
+  ev->name = name ? stralloc(name) : NULL;
+}
+
+/* _glmParseChunk: parse the v/vn/vt/f/g/usemtl/mtllib lines of a piece
+ * of an OBJ file into a chunk.
+ *
+ * chunk - chunk with start/end set and everything else zeroed
+ */
+static void
+_glmParseChunk(GLMchunk* chunk)
+{
+  const char* p = chunk->start;
+  const char* end = chunk->end;
+  char buf[128];
+
+  /* element 0 is unused, .obj indices are 1-based */
+  _glmGrow((void**)&chunk->vertices, &chunk->maxvertices, 1,
+           3 * sizeof(float));
+
+  while (p < end) {
+    p = _glmSkipSpace(p, end);
+    if (p == end)
+      break;
+
+    switch (*p) {
+    case 'v':				/* v, vn, vt */
+      if (p + 1 < end && (p[1] == ' ' || p[1] == '\t')) {
+        /* vertex */
+        float* v;
+        uint n = chunk->numvertices + 1;
+
+        _glmGrow((void**)&chunk->vertices, &chunk->maxvertices, n + 1,
+                 3 * sizeof(float));
+        v = &chunk->vertices[3 * n];
+        v[X] = v[Y] = v[Z] = 0.0;
+        p = _glmParseFloat(p + 1, end, &v[X]);
+        p = _glmParseFloat(p, end, &v[Y]);
+        p = _glmParseFloat(p, end, &v[Z]);
+        chunk->numvertices = n;
+      }
+      else if (p + 1 < end && p[1] == 'n') {
+        /* normal */
+        float* v;
+        uint n = chunk->numnormals + 1;
+
+        _glmGrow((void**)&chunk->normals, &chunk->maxnormals, n + 1,
+                 3 * sizeof(float));
+        v = &chunk->normals[3 * n];
+        v[X] = v[Y] = v[Z] = 0.0;
+        p = _glmParseFloat(p + 2, end, &v[X]);
+        p = _glmParseFloat(p, end, &v[Y]);
+        p = _glmParseFloat(p, end, &v[Z]);
+        chunk->numnormals = n;
+      }
+      else if (p + 1 < end && p[1] == 't') {
+        /* texcoord */
+        float* v;
+        uint n = chunk->numtexcoords + 1;
+
+        _glmGrow((void**)&chunk->texcoords, &chunk->maxtexcoords, n + 1,
+                 2 * sizeof(float));
+        v = &chunk->texcoords[2 * n];
+        v[X] = v[Y] = 0.0;
+        p = _glmParseFloat(p + 2, end, &v[X]);
+        p = _glmParseFloat(p, end, &v[Y]);
+        chunk->numtexcoords = n;
+      }
+      else {
+        _glmToken(p, end, buf, sizeof(buf));
+        printf("_glmParseChunk(): Unknown token \"%s\".\n", buf);
+        exit(1);
+      }
+      break;
+
+    case 'f':				/* face */
+      {
+        /* can be one of %d, %d//%d, %d/%d, %d/%d/%d; polygons are
+           triangulated as a fan around the first vertex */
+        uint vi[3], ti[3], ni[3];
+        uint rel[3];			/* relative index bits per corner */
+        uint count = 0;
+
+        p++;
+        for (;;) {
+          uint v = 0, t = 0, n = 0, c;
+          boolean vrel = FALSE, trel = FALSE, nrel = FALSE;
+          const char* q;
+
+          p = _glmSkipSpace(p, end);
+          q = _glmParseIndex(p, end, chunk->numvertices, &v, &vrel);
+          if (q == p)
+            break;
+          p = q;
+          if (p < end && *p == '/') {
+            p = _glmParseIndex(p + 1, end, chunk->numtexcoords, &t, &trel);
+            if (p < end && *p == '/')
+              p = _glmParseIndex(p + 1, end, chunk->numnormals, &n, &nrel);
+          }
+
+          if (count >= 3) {
+            vi[1] = vi[2]; ti[1] = ti[2]; ni[1] = ni[2];
+            rel[1] = rel[2];
+          }
+          c = count < 2 ? count : 2;
+          vi[c] = v;
+          ti[c] = t;
+          ni[c] = n;
+          rel[c] = vrel | (trel << 1) | (nrel << 2);
+          count++;
+
+          if (count >= 3) {
+            GLMtriangle* tri;
+
+            _glmGrow((void**)&chunk->triangles, &chunk->maxtriangles,
+                     chunk->numtriangles + 1, sizeof(GLMtriangle));
+            tri = &chunk->triangles[chunk->numtriangles++];
+            memcpy(tri->vindices, vi, sizeof(vi));
+            memcpy(tri->tindices, ti, sizeof(ti));
+            memcpy(tri->nindices, ni, sizeof(ni));
+            tri->findex = rel[0] | (rel[1] << 3) | (rel[2] << 6);
+
+            if (!chunk->numevents ||
+                chunk->events[chunk->numevents - 1].type != GLM_EV_FACES)
+              _glmAddEvent(chunk, GLM_EV_FACES, NULL);
+            chunk->events[chunk->numevents - 1].count++;
+          }
+        }
+      }
+      break;
+
+    case 'm':				/* mtllib */
+      p = _glmToken(p, end, buf, sizeof(buf));
+      p = _glmToken(p, end, buf, sizeof(buf));
+      _glmAddEvent(chunk, GLM_EV_MTLLIB, buf);
+      break;
+
+    case 'u':				/* usemtl */
+      p = _glmToken(p, end, buf, sizeof(buf));
+      p = _glmToken(p, end, buf, sizeof(buf));
+      _glmAddEvent(chunk, GLM_EV_USEMTL, buf);
+      break;
+
+    case 'g':				/* group */
+      p = _glmToken(p + 1, end, buf, sizeof(buf));
+      _glmAddEvent(chunk, GLM_EV_GROUP, buf[0] ? buf : "default");
+      break;
+
+    default:				/* comment, or unsupported */
+      break;
+    }
+
+    p = _glmSkipLine(p, end);
+  }
+}
+
+/* _glmRebaseTriangles: turn the chunk-relative indices of a chunk's
+ * triangles into model indices and clear the relative index bits.
+ *
+ * voffset, toffset, noffset - number of vertices/texcoords/normals in
+ *                             the chunks before this one
+ */
+static void
+_glmRebaseTriangles(GLMchunk* chunk, uint voffset, uint toffset,
+                    uint noffset)
+{
+  uint i, j;
+
+  for (i = 0; i < chunk->numtriangles; i++) {
+    GLMtriangle* tri = &chunk->triangles[i];
+
+    if (!tri->findex)
+      continue;
+    for (j = 0; j < 3; j++) {
+      const uint rel = tri->findex >> (3 * j);
+      if (rel & 1)
+        tri->vindices[j] += voffset;
+      if (rel & 2)
+        tri->tindices[j] += toffset;
+      if (rel & 4)
+        tri->nindices[j] += noffset;
+    }
+    tri->findex = 0;
+  }
+}
+
+/* _glmAppend: append the elements 1..count of a chunk array to a model
+ * array of total elements 1..total, taking over the first chunk's
+ * array instead of copying it.
+ *
+ * dst    - model array, NULL before the first chunk
+ * offset - number of elements already in the model array
+ */
+static void
+_glmAppend(float** dst, float** src, uint offset, uint count, uint total,
+           uint size)
+{
+  if (!*dst) {
+    *dst = (float*)realloc(*src, (total + 1) * size * sizeof(float));
+    *src = NULL;
+  }
+  else if (count) {
+    memcpy(*dst + size * (offset + 1), *src + size,
+           count * size * sizeof(float));
+  }
+}
+
+/* _glmStitchChunks: combine parsed chunks into the model, replaying the
+ * group and material events in file order.
+ *
+ * model     - properly initialized GLMmodel structure
+ * chunks    - parsed chunks, in file order
+ * numchunks - number of chunks
+ */
+static void
+_glmStitchChunks(GLMmodel* model, GLMchunk* chunks, uint numchunks)
+{
+  uint numvertices = 0, numnormals = 0, numtexcoords = 0, numtriangles = 0;
+  GLMgroup* group;			/* current group */
+  uint    material = 0;			/* current material */
+  uint    c, e, i;
+
+  for (c = 0; c < numchunks; c++) {
+    numvertices  += chunks[c].numvertices;
+    numnormals   += chunks[c].numnormals;
+    numtexcoords += chunks[c].numtexcoords;
+    numtriangles += chunks[c].numtriangles;
+  }
+
+  /* make a default group */
+  group = _glmAddGroup(model, "default");
+
+  model->triangles = (GLMtriangle*)malloc(sizeof(GLMtriangle) *
+                                          (numtriangles + 1));
+
+  for (c = 0; c < numchunks; c++) {
+    GLMchunk* chunk = &chunks[c];
+    uint tri = model->numtriangles;
+
+    _glmAppend(&model->vertices, &chunk->vertices, model->numvertices,
+               chunk->numvertices, numvertices, 3);
+    if (numnormals)
+      _glmAppend(&model->normals, &chunk->normals, model->numnormals,
+                 chunk->numnormals, numnormals, 3);
+    if (numtexcoords)
+      _glmAppend(&model->texcoords, &chunk->texcoords, model->numtexcoords,
+                 chunk->numtexcoords, numtexcoords, 2);
+
+    _glmRebaseTriangles(chunk, model->numvertices, model->numtexcoords,
+                        model->numnormals);
+    if (chunk->numtriangles)
+      memcpy(&T(model->numtriangles), chunk->triangles,
+             chunk->numtriangles * sizeof(GLMtriangle));
+
+    model->numvertices  += chunk->numvertices;
+    model->numnormals   += chunk->numnormals;
+    model->numtexcoords += chunk->numtexcoords;
+    model->numtriangles += chunk->numtriangles;
+
+    for (e = 0; e < chunk->numevents; e++) {
+      GLMevent* ev = &chunk->events[e];
+
+      switch (ev->type) {
+      case GLM_EV_FACES:
+        for (i = 0; i < ev->count; i++)
+          _glmAddGroupTriangle(group, tri++);
+        break;
+      case GLM_EV_GROUP:
+        group = _glmAddGroup(model, ev->name);
+        group->material = material;
+        break;
+      case GLM_EV_USEMTL:
+        material = _glmFindMaterial(model, ev->name);
+        if (!group->material)
+          group->material = material;
+        break;
+      case GLM_EV_MTLLIB:
+        if (model->mtllibname)
+          free(model->mtllibname);
+        model->mtllibname = stralloc(ev->name);
+        _glmReadMTL(model, ev->name);
+        break;
+      }
+      free(ev->name);
+    }
+
+    free(chunk->vertices);
+    free(chunk->normals);
+    free(chunk->texcoords);
+    free(chunk->triangles);
+    free(chunk->events);
+  }
+}
+
+static void*
+_glmParseThread(void* chunk)
+{
+  _glmParseChunk((GLMchunk*)chunk);
+  return NULL;
+}
+
+/* _glmParseOBJ: read all the data of a Wavefront OBJ file.  The file
+ * is split at line boundaries into one chunk per thread, the chunks are
+ * parsed in parallel and then stitched together in file order, so the
+ * result doesn't depend on the number of threads.
+ *
+ * model      - properly initialized GLMmodel structure
+ * p          - file contents
+ * end        - end of the file contents
+ * numthreads - number of threads to use, 0 = one per CPU
+ */
+static void
+_glmParseOBJ(GLMmodel* model, const char* p, const char* end,
+             uint numthreads)
+{
+  /* smaller chunks aren't worth a thread */
+  const size_t minchunk = 1 << 20;
+  GLMchunk* chunks;
+  uint i;
+
+  if (numthreads == 0)
+    numthreads = _glmNumThreads(end - p, minchunk);
+#ifndef PTHREADS
+  numthreads = 1;
+#endif
+
+  chunks = (GLMchunk*)calloc(numthreads, sizeof(GLMchunk));
+  for (i = 0; i < numthreads; i++) {
+    const char* split = p + (end - p) * (i + 1) / numthreads;
+
+    /* split after a line end */
+    if (i + 1 < numthreads && split > p)
+      split = _glmSkipLine(split - 1, end);
+    else
+      split = end;
+    chunks[i].start = i ? chunks[i - 1].end : p;
+    chunks[i].end = split;
+  }
+
+  _glmRunThreads(_glmParseThread, chunks, sizeof(GLMchunk), numthreads);
+
+  _glmStitchChunks(model, chunks, numthreads);
+  free(chunks);
+}
+
+
+
+/* public functions */
+
+/* glmUnitize: "unitize" a model by translating it to the origin and
+ * scaling it to fit in a unit cube around the origin.  Returns the
+ * scalefactor used.
+ *
+ * model - properly initialized GLMmodel structure 
+ */
+float
+glmUnitize(GLMmodel* model)
+{
+  uint  i;
+  float maxx, minx, maxy, miny, maxz, minz;
+  float cx, cy, cz, w, h, d;
+  float scale;
+
+  assert(model);
+  assert(model->vertices);
+
+  /* get the max/mins */
+  maxx = minx = model->vertices[3 + X];
+  maxy = miny = model->vertices[3 + Y];
+  maxz = minz = model->vertices[3 + Z];
+  for (i = 1; i <= model->numvertices; i++) {
+    if (maxx < model->vertices[3 * i + X])
+      maxx = model->vertices[3 * i + X];
+    if (minx > model->vertices[3 * i + X])
+      minx = model->vertices[3 * i + X];
+
+    if (maxy < model->vertices[3 * i + Y])
+      maxy = model->vertices[3 * i + Y];
+    if (miny > model->vertices[3 * i + Y])
+      miny = model->vertices[3 * i + Y];
+
+    if (maxz < model->vertices[3 * i + Z])
+      maxz = model->vertices[3 * i + Z];
+    if (minz > model->vertices[3 * i + Z])
+      minz = model->vertices[3 * i + Z];
   }
 
   /* calculate model width, height, and depth */
@@ -1039,6 +1672,118 @@ glmFacetNormals(GLMmodel* model)
   }
 }
 
+/* GLMnormaljob: vertex normal generation for a range of vertices, for
+ * a thread.
+ */
+typedef struct {
+  GLMmodel* model;
+  const uint* start;			/* first corner of each vertex */
+  const uint* corners;			/* triangles of each vertex */
+  uint*     first;			/* first new normal of each vertex */
+  float     cos_angle;
+  uint      begin, end;			/* range of vertices to do */
+  boolean   count;			/* count the normals, don't make them */
+} GLMnormaljob;
+
+/* _glmVertexNormalsJob: make the normals of a range of vertices.  In
+ * the counting pass first[i] is set to the number of normals vertex i
+ * needs, in the other pass the normals are written starting at first[i]
+ * and the triangles are pointed at them.
+ */
+static void*
+_glmVertexNormalsJob(void* arg)
+{
+  GLMnormaljob* job = (GLMnormaljob*)arg;
+  GLMmodel* model = job->model;
+  const float* facetnorms = model->facetnorms;
+  float average[3];
+  uint i, c;
+
+  for (i = job->begin; i < job->end; i++) {
+    const uint* tris = &job->corners[job->start[i]];
+    const uint count = job->start[i + 1] - job->start[i];
+    const float* ref;
+    uint n, avg;
+
+    if (count == 0) {
+      if (job->count)
+        job->first[i] = 0;
+      continue;
+    }
+
+    /* only average if the dot product of the angle between the two
+       facet normals is greater than the cosine of the threshold angle
+       -- or, said another way, the angle between the two facet
+       normals is less than (or equal to) the threshold angle.  The
+       reference is the facet normal of the first triangle listed. */
+    ref = &facetnorms[3 * T(tris[0]).findex];
+
+    if (job->count) {
+      n = 0;
+      avg = 0;
+      for (c = 0; c < count; c++) {
+        const float* fn = &facetnorms[3 * T(tris[c]).findex];
+        if (_glmDot((float*)fn, (float*)ref) > job->cos_angle)
+          avg = 1;
+        else
+          n++;
+      }
+      job->first[i] = n + avg;
+      continue;
+    }
+
+    average[0] = 0.0; average[1] = 0.0; average[2] = 0.0;
+    avg = 0;
+    for (c = 0; c < count; c++) {
+      const float* fn = &facetnorms[3 * T(tris[c]).findex];
+      if (_glmDot((float*)fn, (float*)ref) > job->cos_angle) {
+        average[0] += fn[0];
+        average[1] += fn[1];
+        average[2] += fn[2];
+        avg = 1;			/* we averaged at least one normal! */
+      }
+    }
+
+    n = job->first[i];
+    if (avg) {
+      /* normalize the averaged normal */
+      _glmNormalize(average);
+
+      /* add the normal to the vertex normals list */
+      model->normals[3 * n + 0] = average[0];
+      model->normals[3 * n + 1] = average[1];
+      model->normals[3 * n + 2] = average[2];
+      avg = n++;
+    }
+
+    /* set the normal of this vertex in each triangle it is in */
+    for (c = 0; c < count; c++) {
+      GLMtriangle* tri = &T(tris[c]);
+      const float* fn = &facetnorms[3 * tri->findex];
+      uint nindex;
+
+      if (_glmDot((float*)fn, (float*)ref) > job->cos_angle) {
+        /* if this one was averaged, use the average normal */
+        nindex = avg;
+      } else {
+        /* if this one wasn't averaged, use the facet normal */
+        model->normals[3 * n + 0] = fn[0];
+        model->normals[3 * n + 1] = fn[1];
+        model->normals[3 * n + 2] = fn[2];
+        nindex = n++;
+      }
+      if (tri->vindices[0] == i)
+        tri->nindices[0] = nindex;
+      else if (tri->vindices[1] == i)
+        tri->nindices[1] = nindex;
+      else if (tri->vindices[2] == i)
+        tri->nindices[2] = nindex;
+    }
+  }
+
+  return NULL;
+}
+
 /* glmVertexNormals: Generates smooth vertex normals for a model.
  * First builds a list of all the triangles each vertex is in.  Then
  * loops through each vertex in the list averaging all the facet
@@ -1052,20 +1797,24 @@ glmFacetNormals(GLMmodel* model)
  * the facet normal.  This tends to preserve hard edges.  The angle to
  * use depends on the model, but 90 degrees is usually a good start.
  *
+ * The lists are flat arrays (counting sort of the triangle corners by
+ * vertex), the normals are counted before they are made so they are
+ * allocated just once, and both passes over the vertices are split
+ * between threads.
+ *
  * model - initialized GLMmodel structure
  * angle - maximum angle (in degrees) to smooth across
  */
 void
 glmVertexNormals(GLMmodel* model, float angle)
 {
-  GLMnode*  node;
-  GLMnode*  tail;
-  GLMnode** members;
-  float*  normals;
-  uint    numnormals;
-  float   average[3];
-  float   dot, cos_angle;
-  uint    i, avg;
+  GLMnormaljob* jobs;
+  uint*   start;
+  uint*   corners;
+  uint*   first;
+  uint    numnormals, numthreads;
+  float   cos_angle;
+  uint    i, j;
 
   assert(model);
   assert(model->facetnorms);
@@ -1077,131 +1826,67 @@ glmVertexNormals(GLMmodel* model, float angle)
   if (model->normals)
     free(model->normals);
 
-  /* allocate space for new normals */
-  model->numnormals = model->numtriangles * 3; /* 3 normals per triangle */
-  model->normals = (float*)malloc(sizeof(float)* 3* (model->numnormals+1));
-
-  /* allocate a structure that will hold a linked list of triangle
-     indices for each vertex */
-  members = (GLMnode**)malloc(sizeof(GLMnode*) * (model->numvertices + 1));
-  for (i = 1; i <= model->numvertices; i++)
-    members[i] = NULL;
-  
-  /* for every triangle, create a node for each vertex in it */
+  /* list the triangles each vertex is in: count the corners of each
+     vertex, then fill the lists.  Triangles are listed last one
+     first. */
+  start = (uint*)calloc(model->numvertices + 2, sizeof(uint));
+  corners = (uint*)malloc(sizeof(uint) * (3 * model->numtriangles + 1));
   for (i = 0; i < model->numtriangles; i++) {
-    node = (GLMnode*)malloc(sizeof(GLMnode));
-    node->index = i;
-    node->next  = members[T(i).vindices[0]];
-    members[T(i).vindices[0]] = node;
-
-    node = (GLMnode*)malloc(sizeof(GLMnode));
-    node->index = i;
-    node->next  = members[T(i).vindices[1]];
-    members[T(i).vindices[1]] = node;
-
-    node = (GLMnode*)malloc(sizeof(GLMnode));
-    node->index = i;
-    node->next  = members[T(i).vindices[2]];
-    members[T(i).vindices[2]] = node;
+    start[T(i).vindices[0] + 1]++;
+    start[T(i).vindices[1] + 1]++;
+    start[T(i).vindices[2] + 1]++;
+  }
+  for (i = 1; i <= model->numvertices; i++)
+    start[i + 1] += start[i];
+  for (i = model->numtriangles; i-- > 0; ) {
+    for (j = 0; j < 3; j++)
+      corners[start[T(i).vindices[j]]++] = i;
   }
+  /* start[v] is now the end of the list of v, shift back */
+  for (i = model->numvertices + 1; i > 0; i--)
+    start[i] = start[i - 1];
+  start[0] = 0;
+
+  /* count the normals of each vertex, in parallel */
+  first = (uint*)malloc(sizeof(uint) * (model->numvertices + 1));
+  numthreads = _glmNumThreads(model->numvertices, 64 * 1024);
+  jobs = (GLMnormaljob*)calloc(numthreads, sizeof(GLMnormaljob));
+  for (i = 0; i < numthreads; i++) {
+    jobs[i].model = model;
+    jobs[i].start = start;
+    jobs[i].corners = corners;
+    jobs[i].first = first;
+    jobs[i].cos_angle = cos_angle;
+    jobs[i].begin = 1 + (uint)((uint64_t)model->numvertices * i / numthreads);
+    jobs[i].end = 1 + (uint)((uint64_t)model->numvertices * (i + 1) /
+                             numthreads);
+    jobs[i].count = TRUE;
+  }
+  _glmRunThreads(_glmVertexNormalsJob, jobs, sizeof(GLMnormaljob),
+                 numthreads);
 
-  /* calculate the average normal for each vertex */
+  /* number the normals in vertex order */
   numnormals = 1;
   for (i = 1; i <= model->numvertices; i++) {
-    /* calculate an average normal for this vertex by averaging the
-       facet normal of every triangle this vertex is in */
-    node = members[i];
-    if (!node)
+    uint n = first[i];
+    if (start[i] == start[i + 1])
       fprintf(stderr, "glmVertexNormals(): vertex w/o a triangle\n");
-    average[0] = 0.0; average[1] = 0.0; average[2] = 0.0;
-    avg = 0;
-    while (node) {
-      /* only average if the dot product of the angle between the two
-         facet normals is greater than the cosine of the threshold
-         angle -- or, said another way, the angle between the two
-         facet normals is less than (or equal to) the threshold angle */
-      dot = _glmDot(&model->facetnorms[3 * T(node->index).findex],
- 		    &model->facetnorms[3 * T(members[i]->index).findex]);
-      if (dot > cos_angle) {
-	node->averaged = TRUE;
-	average[0] += model->facetnorms[3 * T(node->index).findex + 0];
-	average[1] += model->facetnorms[3 * T(node->index).findex + 1];
-	average[2] += model->facetnorms[3 * T(node->index).findex + 2];
-	avg = 1;			/* we averaged at least one normal! */
-      } else {
-	node->averaged = FALSE;
-      }
-      node = node->next;
-    }
-
-    if (avg) {
-      /* normalize the averaged normal */
-      _glmNormalize(average);
-
-      /* add the normal to the vertex normals list */
-      model->normals[3 * numnormals + 0] = average[0];
-      model->normals[3 * numnormals + 1] = average[1];
-      model->normals[3 * numnormals + 2] = average[2];
-      avg = numnormals;
-      numnormals++;
-    }
-
-    /* set the normal of this vertex in each triangle it is in */
-    node = members[i];
-    while (node) {
-      if (node->averaged) {
-	/* if this node was averaged, use the average normal */
-	if (T(node->index).vindices[0] == i)
-	  T(node->index).nindices[0] = avg;
-	else if (T(node->index).vindices[1] == i)
-	  T(node->index).nindices[1] = avg;
-	else if (T(node->index).vindices[2] == i)
-	  T(node->index).nindices[2] = avg;
-      } else {
-	/* if this node wasn't averaged, use the facet normal */
-	model->normals[3 * numnormals + 0] = 
-	  model->facetnorms[3 * T(node->index).findex + 0];
-	model->normals[3 * numnormals + 1] = 
-	  model->facetnorms[3 * T(node->index).findex + 1];
-	model->normals[3 * numnormals + 2] = 
-	  model->facetnorms[3 * T(node->index).findex + 2];
-	if (T(node->index).vindices[0] == i)
-	  T(node->index).nindices[0] = numnormals;
-	else if (T(node->index).vindices[1] == i)
-	  T(node->index).nindices[1] = numnormals;
-	else if (T(node->index).vindices[2] == i)
-	  T(node->index).nindices[2] = numnormals;
-	numnormals++;
-      }
-      node = node->next;
-    }
+    first[i] = numnormals;
+    numnormals += n;
   }
-  
   model->numnormals = numnormals - 1;
+  model->normals = (float*)malloc(sizeof(float)* 3* (model->numnormals+1));
 
-  /* free the member information */
-  for (i = 1; i <= model->numvertices; i++) {
-    node = members[i];
-    while (node) {
-      tail = node;
-      node = node->next;
-      free(tail);
-    }
-  }
-  free(members);
+  /* make them, in parallel */
+  for (i = 0; i < numthreads; i++)
+    jobs[i].count = FALSE;
+  _glmRunThreads(_glmVertexNormalsJob, jobs, sizeof(GLMnormaljob),
+                 numthreads);
 
-  /* pack the normals array (we previously allocated the maximum
-     number of normals that could possibly be created (numtriangles *
-     3), so get rid of some of them (usually alot unless none of the
-     facet normals were averaged)) */
-  normals = model->normals;
-  model->normals = (float*)malloc(sizeof(float)* 3* (model->numnormals+1));
-  for (i = 1; i <= model->numnormals; i++) {
-    model->normals[3 * i + 0] = normals[3 * i + 0];
-    model->normals[3 * i + 1] = normals[3 * i + 1];
-    model->normals[3 * i + 2] = normals[3 * i + 2];
-  }
-  free(normals);
+  free(jobs);
+  free(first);
+  free(corners);
+  free(start);
 
   printf("glmVertexNormals(): %d normals generated\n", model->numnormals);
 }
@@ -1353,9 +2038,28 @@ glmDelete(GLMmodel* model)
   if (model->texcoords)  free(model->texcoords);
   if (model->facetnorms) free(model->facetnorms);
   if (model->triangles)  free(model->triangles);
+  for (i = 0; i < model->numbatches; i++) {
+    free(model->batches[i].counts);
+    free((void*)model->batches[i].offsets);
+    free(model->batches[i].baseVertex);
+  }
+  free(model->batches);
+  free(model->clusters);
+  free(model->visible.counts);
+  free((void*)model->visible.offsets);
+  free(model->visible.baseVertex);
+  if (model->cacheData) {
+    _glmUnmapFile(model->cacheData, model->cacheSize, model->cacheMapped);
+  }
+  else {
+    free(model->vertexData);
+    free(model->indexData);
+  }
   if (model->materials) {
-    for (i = 0; i < model->nummaterials; i++)
+    for (i = 0; i < model->nummaterials; i++) {
       free(model->materials[i].name);
+      free(model->materials[i].map_kd);
+    }
   }
   free(model->materials);
   while(model->groups) {
@@ -1363,6 +2067,7 @@ glmDelete(GLMmodel* model)
     model->groups = model->groups->next;
     free(group->name);
     free(group->triangles);
+    free(group->triIndexes);
     free(group);
   }
 
@@ -1399,13 +2104,27 @@ glmDefaultMaterial(void)
 GLMmodel* 
 glmReadOBJ(char* filename)
 {
-  GLMmodel* model;
-  FILE*     file;
+  return glmReadOBJThreads(filename, 0);
+}
 
-  /* open the file */
-  file = fopen(filename, "r");
-  if (!file) {
-    fprintf(stderr, "glmReadOBJ() failed: can't open data file \"%s\".\n",
+/* glmReadOBJThreads: Like glmReadOBJ(), but parses the file with the
+ * given number of threads.
+ *
+ * filename   - name of the file containing the Wavefront .OBJ format data.
+ * numthreads - number of threads, 0 = one per CPU (for large files)
+ */
+GLMmodel* 
+glmReadOBJThreads(char* filename, uint numthreads)
+{
+  GLMmodel* model;
+  char*     data;
+  size_t    size;
+  boolean   mapped;
+
+  /* map the file */
+  data = _glmMapFile(filename, &size, &mapped);
+  if (!data) {
+    fprintf(stderr, "glmReadOBJ() failed: can't read data file \"%s\".\n",
 	    filename);
     exit(1);
   }
@@ -1437,32 +2156,25 @@ glmReadOBJ(char* filename)
   model->position[1]   = 0.0;
   model->position[2]   = 0.0;
   model->scale         = 1.0;
-
-  /* make a first pass through the file to get a count of the number
-     of vertices, normals, texcoords & triangles */
-  _glmFirstPass(model, file);
-
-  /* allocate memory */
-  model->vertices = (float*)malloc(sizeof(float) *
-				     3 * (model->numvertices + 1));
-  model->triangles = (GLMtriangle*)malloc(sizeof(GLMtriangle) *
-					  model->numtriangles);
-  if (model->numnormals) {
-    model->normals = (float*)malloc(sizeof(float) *
-				      3 * (model->numnormals + 1));
-  }
-  if (model->numtexcoords) {
-    model->texcoords = (float*)malloc(sizeof(float) *
-					2 * (model->numtexcoords + 1));
-  }
-
-  /* rewind to beginning of file and read in the data this pass */
-  rewind(file);
-
-  _glmSecondPass(model, file);
-
-  /* close the file */
-  fclose(file);
+  model->numbatches    = 0;
+  model->batches       = NULL;
+  model->numclusters   = 0;
+  model->clusters      = NULL;
+  memset(&model->visible, 0, sizeof(model->visible));
+  model->numlods       = 0;
+  model->lodPixels     = 1.0;
+  model->lod           = 0;
+  model->vertexData    = NULL;
+  model->indexData     = NULL;
+  model->numindices    = 0;
+  model->cacheData     = NULL;
+  model->cacheSize     = 0;
+  model->cacheMapped   = FALSE;
+
+  /* read all the data */
+  _glmParseOBJ(model, data, data + size, numthreads);
+
+  _glmUnmapFile(data, size, mapped);
 
   if (!model->materials) {
      model->materials = glmDefaultMaterial();
@@ -1669,10 +2381,10 @@ glmWeld(GLMmodel* model, float epsilon)
   /* vertices */
   numvectors = model->numvertices;
   vectors    = model->vertices;
-  copies = _glmWeldVectors(vectors, &numvectors, epsilon);
+  copies = _glmWeldVectors(vectors, &numvectors, epsilon, 0);
 
   printf("glmWeld(): %d redundant vertices.\n", 
-	 model->numvertices - numvectors - 1);
+	 model->numvertices - numvectors);
 
   for (i = 0; i < model->numtriangles; i++) {
     T(i).vindices[0] = (uint)vectors[3 * T(i).vindices[0] + 0];
@@ -1772,6 +2484,2169 @@ glmReIndex(GLMmodel *model)
 
 
 
+/* Post-transform vertex cache optimization.  GLM_VCACHE_SIZE is the
+ * size of the simulated cache, both for ordering triangles and for
+ * measuring the result.
+ */
+#define GLM_VCACHE_SIZE 32
+
+/* _glmCacheMisses: count the misses of a FIFO vertex cache over a
+ * stream of indices.  stamp[] holds, for each vertex, the miss count
+ * when it was last loaded (0 = never) and carries the cache state from
+ * one call to the next.
+ *
+ * unique - incremented for each vertex seen for the first time
+ */
+static uint
+_glmCacheMisses(const uint* indices, uint numindices, uint* stamp,
+                uint* misses, uint* unique)
+{
+  uint i, n = 0;
+
+  for (i = 0; i < numindices; i++) {
+    uint v = indices[i];
+    if (stamp[v] == 0)
+      (*unique)++;
+    if (stamp[v] == 0 || *misses - stamp[v] >= GLM_VCACHE_SIZE) {
+      (*misses)++;
+      stamp[v] = *misses;
+      n++;
+    }
+  }
+  return n;
+}
+
+/* _glmCacheStats: ACMR (cache misses per triangle) and ATVR (cache
+ * misses per vertex used) of the index data of a model, drawn group by
+ * group.  1.0 is the best possible ATVR, for ACMR it's about 0.5 for a
+ * closed mesh.
+ */
+static void
+_glmCacheStats(GLMmodel* model, float* acmr, float* atvr)
+{
+  GLMgroup* group;
+  uint* stamp;
+  uint misses = 0, unique = 0, triangles = 0;
+
+  stamp = (uint*)calloc(model->numvertices + 1, sizeof(uint));
+  for (group = model->groups; group; group = group->next) {
+    _glmCacheMisses(group->triIndexes, 3 * group->numtriangles, stamp,
+                    &misses, &unique);
+    triangles += group->numtriangles;
+  }
+  free(stamp);
+
+  *acmr = triangles ? (float)misses / triangles : 0.0;
+  *atvr = unique ? (float)misses / unique : 0.0;
+}
+
+/* GLMscores: tables of Forsyth's vertex scores.  The score of a vertex
+ * is the sum of a score for its position in the cache and one for the
+ * number of triangles it still has to be drawn in.  The last triangle's
+ * vertices get a fixed score so the next triangle doesn't just reuse
+ * one of them, and vertices with few triangles left get a bonus to get
+ * rid of them.
+ */
+#define GLM_MAX_VALENCE 64
+
+typedef struct {
+  float cache[GLM_VCACHE_SIZE];
+  float valence[GLM_MAX_VALENCE];
+} GLMscores;
+
+static void
+_glmInitScores(GLMscores* scores)
+{
+  uint i;
+
+  for (i = 0; i < GLM_VCACHE_SIZE; i++) {
+    if (i < 3)
+      scores->cache[i] = 0.75;
+    else
+      scores->cache[i] = pow(1.0 - (i - 3) * (1.0 / (GLM_VCACHE_SIZE - 3)),
+                             1.5);
+  }
+  for (i = 1; i < GLM_MAX_VALENCE; i++)
+    scores->valence[i] = 2.0 / sqrt((float)i);
+}
+
+/* _glmVertexScore: score of a vertex, from its position in the cache
+ * (-1 = not in it) and the number of triangles it's still in.
+ */
+static float
+_glmVertexScore(const GLMscores* scores, int cachepos, uint remaining)
+{
+  float score;
+
+  if (remaining == 0)
+    return -1.0;
+
+  score = cachepos >= 0 ? scores->cache[cachepos] : 0.0;
+  if (remaining < GLM_MAX_VALENCE)
+    return score + scores->valence[remaining];
+  return score + 2.0 / sqrt((float)remaining);
+}
+
+/* GLMrun: a run of triangles of a group, for overdraw ordering.
+ */
+typedef struct {
+  uint  first, count;			/* triangle range */
+  float key;				/* how much it faces outwards */
+} GLMrun;
+
+static int
+_glmRunCompare(const void* a, const void* b)
+{
+  const GLMrun* ca = (const GLMrun*)a;
+  const GLMrun* cb = (const GLMrun*)b;
+
+  /* outer clusters first, keep order otherwise */
+  if (ca->key != cb->key)
+    return ca->key > cb->key ? -1 : 1;
+  return ca->first < cb->first ? -1 : (ca->first > cb->first);
+}
+
+/* _glmOverdrawOrder: split the (cache ordered) triangles of a group at
+ * the points where the cache order starts afresh and sort the pieces
+ * so those facing away from the center of the group come first.  Near
+ * triangles then tend to be drawn before the ones behind them, from
+ * any viewpoint, without hurting the cache much.
+ *
+ * local   - local vertex index of each index
+ * numlocal - number of local vertices
+ */
+static void
+_glmOverdrawOrder(GLMmodel* model, uint* indices, const uint* local,
+                  uint numtriangles, uint numlocal)
+{
+  GLMrun* clusters;
+  uint* stamp;
+  uint* sorted;
+  float center[3], area;
+  uint numclusters, misses, unique, i, c;
+
+  /* split where a triangle misses on all its vertices */
+  clusters = (GLMrun*)malloc(sizeof(GLMrun) * numtriangles);
+  stamp = (uint*)calloc(numlocal, sizeof(uint));
+  numclusters = 0;
+  misses = unique = 0;
+  for (i = 0; i < numtriangles; i++) {
+    if (_glmCacheMisses(&local[3 * i], 3, stamp, &misses, &unique) == 3 &&
+        (numclusters == 0 || clusters[numclusters - 1].count >= 32)) {
+      clusters[numclusters].first = i;
+      clusters[numclusters].count = 0;
+      numclusters++;
+    }
+    if (numclusters == 0) {
+      clusters[0].first = 0;
+      clusters[0].count = 0;
+      numclusters = 1;
+    }
+    clusters[numclusters - 1].count++;
+  }
+  free(stamp);
+
+  if (numclusters < 2) {
+    free(clusters);
+    return;
+  }
+
+  /* area weighted center of the group */
+  center[0] = center[1] = center[2] = 0.0;
+  area = 0.0;
+  for (i = 0; i < numtriangles; i++) {
+    float* p0 = &model->vertices[3 * indices[3 * i + 0]];
+    float* p1 = &model->vertices[3 * indices[3 * i + 1]];
+    float* p2 = &model->vertices[3 * indices[3 * i + 2]];
+    float u[3], v[3], n[3], a;
+
+    u[0] = p1[0] - p0[0]; u[1] = p1[1] - p0[1]; u[2] = p1[2] - p0[2];
+    v[0] = p2[0] - p0[0]; v[1] = p2[1] - p0[1]; v[2] = p2[2] - p0[2];
+    _glmCross(u, v, n);
+    a = sqrt(_glmDot(n, n));
+    center[0] += a * (p0[0] + p1[0] + p2[0]) / 3.0;
+    center[1] += a * (p0[1] + p1[1] + p2[1]) / 3.0;
+    center[2] += a * (p0[2] + p1[2] + p2[2]) / 3.0;
+    area += a;
+  }
+  if (area > 0.0) {
+    center[0] /= area; center[1] /= area; center[2] /= area;
+  }
+
+  /* key of a cluster: its center relative to the group center, along
+     its average normal */
+  for (c = 0; c < numclusters; c++) {
+    float ccenter[3], cnormal[3], carea = 0.0, len;
+
+    ccenter[0] = ccenter[1] = ccenter[2] = 0.0;
+    cnormal[0] = cnormal[1] = cnormal[2] = 0.0;
+    for (i = clusters[c].first; i < clusters[c].first + clusters[c].count;
+         i++) {
+      float* p0 = &model->vertices[3 * indices[3 * i + 0]];
+      float* p1 = &model->vertices[3 * indices[3 * i + 1]];
+      float* p2 = &model->vertices[3 * indices[3 * i + 2]];
+      float u[3], v[3], n[3], a;
+
+      u[0] = p1[0] - p0[0]; u[1] = p1[1] - p0[1]; u[2] = p1[2] - p0[2];
+      v[0] = p2[0] - p0[0]; v[1] = p2[1] - p0[1]; v[2] = p2[2] - p0[2];
+      _glmCross(u, v, n);
+      a = sqrt(_glmDot(n, n));
+      ccenter[0] += a * (p0[0] + p1[0] + p2[0]) / 3.0;
+      ccenter[1] += a * (p0[1] + p1[1] + p2[1]) / 3.0;
+      ccenter[2] += a * (p0[2] + p1[2] + p2[2]) / 3.0;
+      cnormal[0] += n[0]; cnormal[1] += n[1]; cnormal[2] += n[2];
+      carea += a;
+    }
+    clusters[c].key = 0.0;
+    len = sqrt(_glmDot(cnormal, cnormal));
+    if (carea > 0.0 && len > 0.0) {
+      ccenter[0] = ccenter[0] / carea - center[0];
+      ccenter[1] = ccenter[1] / carea - center[1];
+      ccenter[2] = ccenter[2] / carea - center[2];
+      clusters[c].key = _glmDot(ccenter, cnormal) / len;
+    }
+  }
+
+  qsort(clusters, numclusters, sizeof(GLMrun), _glmRunCompare);
+
+  sorted = (uint*)malloc(sizeof(uint) * 3 * numtriangles);
+  for (c = 0, i = 0; c < numclusters; c++) {
+    memcpy(&sorted[3 * i], &indices[3 * clusters[c].first],
+           sizeof(uint) * 3 * clusters[c].count);
+    i += clusters[c].count;
+  }
+  memcpy(indices, sorted, sizeof(uint) * 3 * numtriangles);
+
+  free(sorted);
+  free(clusters);
+}
+
+/* _glmCacheOrder: reorder the triangles of a group for the vertex
+ * cache, after Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".
+ * Each step draws the best scoring triangle among those of the
+ * vertices in the cache; if there is none, the next undrawn triangle
+ * in the original order.
+ *
+ * indices - 3 * numtriangles vertex indices, reordered in place
+ * local   - scratch array, ~0 for each vertex of the model, restored
+ */
+static void
+_glmCacheOrder(GLMmodel* model, uint* indices, uint numtriangles,
+               uint* local, boolean overdraw)
+{
+  const uint numindices = 3 * numtriangles;
+  uint* verts;				/* model vertex of each local one */
+  uint* idx;				/* local vertex of each index */
+  uint* start;				/* first triangle of each vertex */
+  uint* adj;				/* triangles of each vertex */
+  uint* remaining;			/* number of undrawn triangles */
+  int*  cachepos;
+  float* vscore;
+  float* tscore;
+  boolean* drawn;
+  uint* out;
+  uint cache[GLM_VCACHE_SIZE + 3], newcache[GLM_VCACHE_SIZE + 3];
+  uint cachelen = 0, numverts = 0, cursor = 0;
+  GLMscores scores;
+  int best;
+  uint i, j, k, n;
+
+  if (numtriangles < 2)
+    return;
+
+  /* local vertex numbers */
+  verts = (uint*)malloc(sizeof(uint) * numindices);
+  idx = (uint*)malloc(sizeof(uint) * numindices);
+  for (i = 0; i < numindices; i++) {
+    uint v = indices[i];
+    if (local[v] == ~0u) {
+      local[v] = numverts;
+      verts[numverts++] = v;
+    }
+    idx[i] = local[v];
+  }
+
+  /* triangles of each vertex */
+  start = (uint*)calloc(numverts + 1, sizeof(uint));
+  adj = (uint*)malloc(sizeof(uint) * numindices);
+  remaining = (uint*)malloc(sizeof(uint) * numverts);
+  for (i = 0; i < numindices; i++)
+    start[idx[i] + 1]++;
+  for (i = 0; i < numverts; i++) {
+    start[i + 1] += start[i];
+    remaining[i] = 0;
+  }
+  for (i = 0; i < numindices; i++) {
+    uint v = idx[i];
+    adj[start[v] + remaining[v]++] = i / 3;
+  }
+
+  /* initial scores */
+  _glmInitScores(&scores);
+  cachepos = (int*)malloc(sizeof(int) * numverts);
+  vscore = (float*)malloc(sizeof(float) * numverts);
+  for (i = 0; i < numverts; i++) {
+    cachepos[i] = -1;
+    vscore[i] = _glmVertexScore(&scores, -1, remaining[i]);
+  }
+  tscore = (float*)malloc(sizeof(float) * numtriangles);
+  drawn = (boolean*)calloc(numtriangles, sizeof(boolean));
+  best = 0;
+  for (i = 0; i < numtriangles; i++) {
+    tscore[i] = vscore[idx[3 * i]] + vscore[idx[3 * i + 1]] +
+                vscore[idx[3 * i + 2]];
+    if (tscore[i] > tscore[best])
+      best = i;
+  }
+
+  out = (uint*)malloc(sizeof(uint) * numindices);
+  for (n = 0; n < numtriangles; n++) {
+    uint newlen = 0, numnew;
+    float bestscore;
+
+    if (best < 0) {
+      /* dead end, continue with the next triangle in original order */
+      while (drawn[cursor])
+        cursor++;
+      best = cursor;
+    }
+
+    /* draw it */
+    drawn[best] = TRUE;
+    for (j = 0; j < 3; j++) {
+      uint v = idx[3 * best + j];
+      uint* list = &adj[start[v]];
+
+      out[3 * n + j] = indices[3 * best + j];
+
+      /* remove the triangle from the undrawn ones of the vertex */
+      for (k = 0; k < remaining[v]; k++) {
+        if (list[k] == (uint)best) {
+          list[k] = list[--remaining[v]];
+          break;
+        }
+      }
+
+      /* its vertices go to the front of the cache */
+      for (k = 0; k < newlen && newcache[k] != v; k++)
+        ;
+      if (k == newlen)
+        newcache[newlen++] = v;
+    }
+    numnew = newlen;
+    for (k = 0; k < cachelen; k++) {
+      uint v = cache[k];
+      for (j = 0; j < numnew && newcache[j] != v; j++)
+        ;
+      if (j == numnew)
+        newcache[newlen++] = v;
+    }
+
+    /* update the scores of the vertices in the cache and of those that
+       just fell out of it, and of their triangles */
+    bestscore = -1.0;
+    best = -1;
+    for (k = 0; k < newlen; k++) {
+      uint v = newcache[k];
+      cachepos[v] = k < GLM_VCACHE_SIZE ? (int)k : -1;
+      vscore[v] = _glmVertexScore(&scores, cachepos[v], remaining[v]);
+    }
+    for (k = 0; k < newlen; k++) {
+      uint v = newcache[k];
+      for (j = 0; j < remaining[v]; j++) {
+        uint t = adj[start[v] + j];
+        tscore[t] = vscore[idx[3 * t]] + vscore[idx[3 * t + 1]] +
+                    vscore[idx[3 * t + 2]];
+        if (tscore[t] > bestscore) {
+          bestscore = tscore[t];
+          best = t;
+        }
+      }
+    }
+
+    cachelen = newlen < GLM_VCACHE_SIZE ? newlen : GLM_VCACHE_SIZE;
+    memcpy(cache, newcache, sizeof(uint) * cachelen);
+  }
+
+  memcpy(indices, out, sizeof(uint) * numindices);
+
+  if (overdraw) {
+    for (i = 0; i < numindices; i++)
+      idx[i] = local[indices[i]];
+    _glmOverdrawOrder(model, indices, idx, numtriangles, numverts);
+  }
+
+  for (i = 0; i < numverts; i++)
+    local[verts[i]] = ~0u;
+
+  free(out);
+  free(drawn);
+  free(tscore);
+  free(vscore);
+  free(cachepos);
+  free(remaining);
+  free(adj);
+  free(start);
+  free(idx);
+  free(verts);
+}
+
+/* _glmFetchOrder: renumber the vertices in the order the index data
+ * uses them, so vertex fetches go through memory in order.  Vertices
+ * that aren't used go last.
+ */
+static void
+_glmFetchOrder(GLMmodel* model)
+{
+  GLMgroup* group;
+  uint* remap;
+  float* arrays[3];
+  uint sizes[3];
+  uint numused = 0, i, a;
+
+  remap = (uint*)malloc(sizeof(uint) * (model->numvertices + 1));
+  for (i = 0; i <= model->numvertices; i++)
+    remap[i] = 0;
+
+  for (group = model->groups; group; group = group->next) {
+    for (i = 0; i < 3 * group->numtriangles; i++) {
+      uint v = group->triIndexes[i];
+      if (remap[v] == 0)
+        remap[v] = ++numused;
+    }
+  }
+  for (i = 1; i <= model->numvertices; i++) {
+    if (remap[i] == 0)
+      remap[i] = ++numused;
+  }
+
+  /* move the per vertex data */
+  arrays[0] = model->vertices;  sizes[0] = 3;
+  arrays[1] = model->numnormals ? model->normals : NULL;  sizes[1] = 3;
+  arrays[2] = model->numtexcoords ? model->texcoords : NULL;  sizes[2] = 2;
+  for (a = 0; a < 3; a++) {
+    float* old = arrays[a];
+    float* moved;
+
+    if (!old)
+      continue;
+    moved = (float*)malloc(sizeof(float) * sizes[a] *
+                           (model->numvertices + 1));
+    memcpy(moved, old, sizeof(float) * sizes[a]);	/* unused element 0 */
+    for (i = 1; i <= model->numvertices; i++)
+      memcpy(&moved[sizes[a] * remap[i]], &old[sizes[a] * i],
+             sizeof(float) * sizes[a]);
+    free(old);
+    if (a == 0)
+      model->vertices = moved;
+    else if (a == 1)
+      model->normals = moved;
+    else
+      model->texcoords = moved;
+  }
+
+  /* and point everything at the new numbers */
+  for (i = 0; i < model->numtriangles; i++) {
+    uint j;
+    for (j = 0; j < 3; j++) {
+      T(i).vindices[j] = remap[T(i).vindices[j]];
+      T(i).nindices[j] = T(i).vindices[j];
+      T(i).tindices[j] = T(i).vindices[j];
+    }
+  }
+  for (group = model->groups; group; group = group->next) {
+    group->minIndex = 10000000;
+    group->maxIndex = 0;
+    for (i = 0; i < 3 * group->numtriangles; i++) {
+      uint v = remap[group->triIndexes[i]];
+      group->triIndexes[i] = v;
+      if (v > group->maxIndex)
+        group->maxIndex = v;
+      if (v < group->minIndex)
+        group->minIndex = v;
+    }
+  }
+
+  free(remap);
+}
+
+/* glmOptimize: Reorders the index data of a model for faster drawing
+ * with glmDrawVBO(), without changing what is drawn.  The triangles of
+ * each group are ordered for the post-transform vertex cache, then
+ * (optionally) runs of them are ordered to reduce overdraw, and finally
+ * the vertices are renumbered in the order they are used.  Prints the
+ * ACMR and ATVR before and after.  Requires glmReIndex() to have been
+ * called, and must be called before glmBuildVBOData().
+ *
+ * model    - initialized GLMmodel structure
+ * overdraw - also reorder to reduce overdraw
+ */
+void
+glmOptimize(GLMmodel* model, int overdraw)
+{
+  GLMgroup* group;
+  uint* local;
+  float acmr[2], atvr[2];
+  uint i;
+
+  assert(model);
+  assert(!model->vertexData);
+
+  _glmCacheStats(model, &acmr[0], &atvr[0]);
+
+  local = (uint*)malloc(sizeof(uint) * (model->numvertices + 1));
+  for (i = 0; i <= model->numvertices; i++)
+    local[i] = ~0u;
+  for (group = model->groups; group; group = group->next) {
+    if (group->triIndexes)
+      _glmCacheOrder(model, group->triIndexes, group->numtriangles, local,
+                     overdraw);
+  }
+  free(local);
+
+  _glmFetchOrder(model);
+
+  _glmCacheStats(model, &acmr[1], &atvr[1]);
+  printf("glmOptimize(): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+         acmr[0], acmr[1], atvr[0], atvr[1]);
+}
+
+
+/* GLMgroupref: a group and its place in the model's list, for sorting.
+ */
+typedef struct {
+  GLMgroup* group;
+  uint      pos;
+} GLMgroupref;
+
+/* _glmGroupMaterialCompare: order groups by material, then by their
+ * place in the list.
+ */
+static int
+_glmGroupMaterialCompare(const void* a, const void* b)
+{
+  const GLMgroupref* ga = (const GLMgroupref*)a;
+  const GLMgroupref* gb = (const GLMgroupref*)b;
+
+  if (ga->group->material != gb->group->material)
+    return ga->group->material < gb->group->material ? -1 : 1;
+  return ga->pos < gb->pos ? -1 : (ga->pos > gb->pos);
+}
+
+/* glmBuildVBOData: Builds the interleaved vertex data and the index
+ * data that glmMakeVBOs() uploads, and the offset of each group's
+ * indexes.  Requires glmReIndex() to have been called, and
+ * glmOptimize() if that is wanted.
+ *
+ * model - initialized GLMmodel structure
+ */
+void
+glmBuildVBOData(GLMmodel *model)
+{
+  uint vertexFloats, i, n;
+  float *buffer;
+  uint *ib;
+  GLMgroup* group;
+  GLMgroupref* groups;
+
+  if (model->vertexData)
+    return;
+
+  /*
+   * Vertex data
+   */
+  vertexFloats = 3;
+  model->posOffset = 0;
+
+  if (model->numnormals > 0) {
+    assert(model->numnormals == model->numvertices);
+    model->normOffset = vertexFloats * sizeof(float);
+    vertexFloats += 3;
+  }
+
+  if (model->numtexcoords > 0) {
+    assert(model->numtexcoords == model->numvertices);
+    model->texOffset = vertexFloats * sizeof(float);
+    vertexFloats += 2;
+  }
+
+  model->vertexSize = vertexFloats;
+
+  /* element 0 is unused, like in the model arrays */
+  buffer = (float *) calloc((model->numvertices + 1) * vertexFloats,
+                            sizeof(float));
+  for (i = 1; i <= model->numvertices; i++) {
+    /* copy vertex pos */
+    uint j = 0;
+    buffer[i * vertexFloats + j++] = model->vertices[i * 3 + 0];
+    buffer[i * vertexFloats + j++] = model->vertices[i * 3 + 1];
+    buffer[i * vertexFloats + j++] = model->vertices[i * 3 + 2];
+    if (model->numnormals > 0) {
+      buffer[i * vertexFloats + j++] = model->normals[i * 3 + 0];
+      buffer[i * vertexFloats + j++] = model->normals[i * 3 + 1];
+      buffer[i * vertexFloats + j++] = model->normals[i * 3 + 2];
+    }
+    if (model->numtexcoords > 0) {
+      buffer[i * vertexFloats + j++] = model->texcoords[i * 2 + 0];
+      buffer[i * vertexFloats + j++] = model->texcoords[i * 2 + 1];
+    }
+  }
+  model->vertexData = buffer;
+
+  /*
+   * Index data
+   */
+  model->numindices = 0;
+  for (group = model->groups; group; group = group->next)
+    model->numindices += 3 * group->numtriangles;
+
+  /* the groups of a material go next to each other, so they can be
+     drawn together */
+  groups = (GLMgroupref*)malloc(sizeof(GLMgroupref) * (model->numgroups + 1));
+  n = 0;
+  for (group = model->groups; group; group = group->next) {
+    groups[n].group = group;
+    groups[n].pos = n;
+    n++;
+  }
+  qsort(groups, n, sizeof(GLMgroupref), _glmGroupMaterialCompare);
+
+  ib = model->indexData = (uint *) malloc(model->numindices * sizeof(uint) + 1);
+  for (i = 0; i < n; i++) {
+    group = groups[i].group;
+    group->indexDataOffset = (ib - model->indexData) * sizeof(uint);
+    group->indexVboOffset = group->indexDataOffset;
+    if (group->numtriangles > 0) {
+      memcpy(ib, group->triIndexes, 3 * group->numtriangles * sizeof(uint));
+      ib += 3 * group->numtriangles;
+    }
+  }
+  free(groups);
+}
+
+
+/* GLMsplit: the triangles of a group being split into clusters.
+ */
+typedef struct {
+  const float* centroids;		/* of each triangle of the group */
+  uint*        order;			/* triangles, split in place */
+} GLMsplit;
+
+/* _glmSplitLess: whether triangle a of a split comes before triangle b
+ * along an axis.  Ties go by triangle number, so splits are the same
+ * on every run.
+ */
+static int
+_glmSplitLess(const GLMsplit* split, uint axis, uint a, uint b)
+{
+  float ka = split->centroids[3 * a + axis];
+  float kb = split->centroids[3 * b + axis];
+
+  return ka < kb || (ka == kb && a < b);
+}
+
+/* _glmSplitSelect: partially sort split->order[first..last) along an
+ * axis so the triangle that belongs at nth is there, with the ones
+ * before it in front and the ones after it behind (quickselect).
+ */
+static void
+_glmSplitSelect(GLMsplit* split, uint axis, uint first, uint last, uint nth)
+{
+  uint* order = split->order;
+  uint mid, pivot, store, i, t;
+
+#define GLM_SWAP(a, b) (t = order[a], order[a] = order[b], order[b] = t)
+
+  while (last - first > 2) {
+    /* median of three as the pivot, moved to the end */
+    mid = first + (last - first) / 2;
+    if (_glmSplitLess(split, axis, order[mid], order[first]))
+      GLM_SWAP(mid, first);
+    if (_glmSplitLess(split, axis, order[last - 1], order[first]))
+      GLM_SWAP(last - 1, first);
+    if (_glmSplitLess(split, axis, order[last - 1], order[mid]))
+      GLM_SWAP(last - 1, mid);
+    GLM_SWAP(mid, last - 1);
+    pivot = order[last - 1];
+
+    store = first;
+    for (i = first; i < last - 1; i++) {
+      if (_glmSplitLess(split, axis, order[i], pivot)) {
+        GLM_SWAP(i, store);
+        store++;
+      }
+    }
+    GLM_SWAP(store, last - 1);
+
+    if (nth == store)
+      return;
+    if (nth < store)
+      last = store;
+    else
+      first = store + 1;
+  }
+  if (last - first == 2 &&
+      _glmSplitLess(split, axis, order[first + 1], order[first]))
+    GLM_SWAP(first, first + 1);
+
+#undef GLM_SWAP
+}
+
+static int
+_glmUintCompare(const void* a, const void* b)
+{
+  uint ua = *(const uint*)a;
+  uint ub = *(const uint*)b;
+
+  return ua < ub ? -1 : (ua > ub);
+}
+
+/* _glmSplitGroup: halve split->order[first..last) at the median of the
+ * triangle centroids along their longest axis until the parts have at
+ * most maxtriangles, and put the triangles of each part back in their
+ * original (vertex cache) order.
+ */
+static void
+_glmSplitGroup(GLMsplit* split, uint first, uint last, uint maxtriangles)
+{
+  float min[3], max[3];
+  uint i, j, axis, mid;
+
+  if (last - first <= maxtriangles) {
+    qsort(split->order + first, last - first, sizeof(uint), _glmUintCompare);
+    return;
+  }
+
+  for (j = 0; j < 3; j++)
+    min[j] = max[j] = split->centroids[3 * split->order[first] + j];
+  for (i = first + 1; i < last; i++) {
+    const float* c = &split->centroids[3 * split->order[i]];
+    for (j = 0; j < 3; j++) {
+      if (c[j] < min[j]) min[j] = c[j];
+      if (c[j] > max[j]) max[j] = c[j];
+    }
+  }
+  axis = 0;
+  for (j = 1; j < 3; j++) {
+    if (max[j] - min[j] > max[axis] - min[axis])
+      axis = j;
+  }
+
+  mid = first + (last - first) / 2;
+  _glmSplitSelect(split, axis, first, last, mid);
+  _glmSplitGroup(split, first, mid, maxtriangles);
+  _glmSplitGroup(split, mid, last, maxtriangles);
+}
+
+/* _glmSplitEnd: the end of the part of a split of count triangles
+ * that has triangle i, by doing the halving of _glmSplitGroup() again.
+ */
+static uint
+_glmSplitEnd(uint count, uint i, uint maxtriangles)
+{
+  uint first = 0, last = count, mid;
+
+  while (last - first > maxtriangles) {
+    mid = first + (last - first) / 2;
+    if (i < mid)
+      last = mid;
+    else
+      first = mid;
+  }
+  return last;
+}
+
+/* _glmClusterBounds: compute the bounding sphere and the normal cone
+ * of a cluster from its triangles in the vertex and index data.
+ */
+static void
+_glmClusterBounds(GLMmodel* model, GLMcluster* cluster)
+{
+  const uint* indices = model->indexData + cluster->firstIndex;
+  const float* data = model->vertexData;
+  const uint stride = model->vertexSize;
+  float min[3], max[3], u[3], v[3], n[3];
+  float r2, d2, mincos;
+  uint i, j;
+
+  /* sphere around the bounding box */
+  for (j = 0; j < 3; j++)
+    min[j] = max[j] = data[indices[0] * stride + j];
+  for (i = 1; i < cluster->numIndices; i++) {
+    const float* p = &data[indices[i] * stride];
+    for (j = 0; j < 3; j++) {
+      if (p[j] < min[j]) min[j] = p[j];
+      if (p[j] > max[j]) max[j] = p[j];
+    }
+  }
+  for (j = 0; j < 3; j++)
+    cluster->center[j] = 0.5 * (min[j] + max[j]);
+  r2 = 0.0;
+  for (i = 0; i < cluster->numIndices; i++) {
+    const float* p = &data[indices[i] * stride];
+    d2 = 0.0;
+    for (j = 0; j < 3; j++)
+      d2 += (p[j] - cluster->center[j]) * (p[j] - cluster->center[j]);
+    if (d2 > r2)
+      r2 = d2;
+  }
+  cluster->radius = sqrt(r2);
+
+  /* cone around the mean facet normal; degenerate triangles can't be
+     seen, so they don't count */
+  cluster->axis[0] = cluster->axis[1] = cluster->axis[2] = 0.0;
+  for (i = 0; i < cluster->numIndices; i += 3) {
+    const float* p0 = &data[indices[i + 0] * stride];
+    const float* p1 = &data[indices[i + 1] * stride];
+    const float* p2 = &data[indices[i + 2] * stride];
+    for (j = 0; j < 3; j++) {
+      u[j] = p1[j] - p0[j];
+      v[j] = p2[j] - p0[j];
+    }
+    _glmCross(u, v, n);
+    if (_glmDot(n, n) > 0.0) {
+      _glmNormalize(n);
+      for (j = 0; j < 3; j++)
+        cluster->axis[j] += n[j];
+    }
+  }
+
+  cluster->coneCos = 0.0;
+  cluster->coneSin = 1.0;
+  if (_glmDot(cluster->axis, cluster->axis) < 1e-12)
+    return;
+  _glmNormalize(cluster->axis);
+
+  mincos = 1.0;
+  for (i = 0; i < cluster->numIndices; i += 3) {
+    const float* p0 = &data[indices[i + 0] * stride];
+    const float* p1 = &data[indices[i + 1] * stride];
+    const float* p2 = &data[indices[i + 2] * stride];
+    for (j = 0; j < 3; j++) {
+      u[j] = p1[j] - p0[j];
+      v[j] = p2[j] - p0[j];
+    }
+    _glmCross(u, v, n);
+    if (_glmDot(n, n) > 0.0) {
+      _glmNormalize(n);
+      d2 = _glmDot(n, cluster->axis);
+      if (d2 < mincos)
+        mincos = d2;
+    }
+  }
+  /* widen it a little for rounding */
+  mincos -= 1e-4;
+  if (mincos > 0.0) {
+    cluster->coneCos = mincos;
+    cluster->coneSin = sqrt(1.0 - mincos * mincos);
+  }
+}
+
+static int
+_glmClusterIndexCompare(const void* a, const void* b)
+{
+  const GLMcluster* ca = (const GLMcluster*)a;
+  const GLMcluster* cb = (const GLMcluster*)b;
+
+  return ca->firstIndex < cb->firstIndex ? -1 :
+    (ca->firstIndex > cb->firstIndex);
+}
+
+/* glmMakeClusters: Splits each group into clusters of at most
+ * maxtriangles nearby triangles for culling, by halving the group at
+ * the median triangle along its longest axis until the parts are small
+ * enough.  The triangles of each cluster are made contiguous in the
+ * index data.  That breaks up the runs of glmOptimize(), so each
+ * cluster is ordered for the vertex cache and overdraw again, and the
+ * vertices are renumbered in the new order of use (the vertex and index
+ * data are rebuilt).  Prints the ACMR before and after.  Computes the
+ * bounding sphere and normal cone of each cluster.  Requires
+ * glmBuildVBOData() to have been called, and must be called before
+ * glmMakeLODs().
+ *
+ * model        - initialized GLMmodel structure
+ * maxtriangles - most triangles in a cluster
+ */
+void
+glmMakeClusters(GLMmodel* model, uint maxtriangles)
+{
+  GLMgroup* group;
+  GLMsplit split;
+  float* centroids;
+  uint* indices;
+  uint* order;
+  uint* scratch;
+  uint* local;
+  float acmr[2], atvr[2];
+  uint maxgroup, capacity, i, j, k;
+
+  assert(model);
+  assert(model->indexData && !model->cacheData);
+  assert(model->numlods == 0);
+  assert(maxtriangles > 0);
+
+  _glmCacheStats(model, &acmr[0], &atvr[0]);
+
+  free(model->clusters);
+  model->clusters = NULL;
+  model->numclusters = 0;
+
+  maxgroup = 0;
+  capacity = 0;
+  for (group = model->groups; group; group = group->next) {
+    if (group->numtriangles > maxgroup)
+      maxgroup = group->numtriangles;
+    capacity += (group->numtriangles + maxtriangles - 1) / maxtriangles * 2;
+  }
+  model->clusters = (GLMcluster*)calloc(capacity + 1, sizeof(GLMcluster));
+
+  centroids = (float*)malloc(sizeof(float) * 3 * (maxgroup + 1));
+  order = (uint*)malloc(sizeof(uint) * (maxgroup + 1));
+  scratch = (uint*)malloc(sizeof(uint) * 3 * (maxgroup + 1));
+  split.centroids = centroids;
+  split.order = order;
+  local = (uint*)malloc(sizeof(uint) * (model->numvertices + 1));
+  for (i = 0; i <= model->numvertices; i++)
+    local[i] = ~0u;
+
+  for (group = model->groups; group; group = group->next) {
+    if (group->numtriangles == 0)
+      continue;
+    indices = model->indexData + group->indexDataOffset / sizeof(uint);
+
+    for (i = 0; i < group->numtriangles; i++) {
+      for (j = 0; j < 3; j++) {
+        centroids[3 * i + j] =
+          (model->vertexData[indices[3 * i + 0] * model->vertexSize + j] +
+           model->vertexData[indices[3 * i + 1] * model->vertexSize + j] +
+           model->vertexData[indices[3 * i + 2] * model->vertexSize + j]) /
+          3.0;
+      }
+      order[i] = i;
+    }
+    _glmSplitGroup(&split, 0, group->numtriangles, maxtriangles);
+
+    /* reorder the triangles */
+    for (i = 0; i < group->numtriangles; i++) {
+      for (j = 0; j < 3; j++)
+        scratch[3 * i + j] = indices[3 * order[i] + j];
+    }
+    memcpy(indices, scratch, sizeof(uint) * 3 * group->numtriangles);
+
+    for (i = 0; i < group->numtriangles; i = k) {
+      k = _glmSplitEnd(group->numtriangles, i, maxtriangles);
+      _glmCacheOrder(model, &indices[3 * i], k - i, local, TRUE);
+      assert(model->numclusters < capacity);
+      model->clusters[model->numclusters].material = group->material;
+      model->clusters[model->numclusters].firstIndex =
+        group->indexDataOffset / sizeof(uint) + 3 * i;
+      model->clusters[model->numclusters].numIndices = 3 * (k - i);
+      _glmClusterBounds(model, &model->clusters[model->numclusters]);
+      model->numclusters++;
+    }
+
+    assert(group->triIndexes);
+    memcpy(group->triIndexes, indices,
+           sizeof(uint) * 3 * group->numtriangles);
+  }
+
+  free(centroids);
+  free(order);
+  free(scratch);
+  free(local);
+
+  /* renumber the vertices for the new order; the groups keep their
+     place in the index data, so the clusters stay valid */
+  _glmFetchOrder(model);
+  free(model->vertexData);
+  free(model->indexData);
+  model->vertexData = NULL;
+  model->indexData = NULL;
+  glmBuildVBOData(model);
+  _glmCacheStats(model, &acmr[1], &atvr[1]);
+
+  /* in index data order, which is by material */
+  qsort(model->clusters, model->numclusters, sizeof(GLMcluster),
+        _glmClusterIndexCompare);
+
+  printf("glmMakeClusters(): %u clusters of up to %u triangles, "
+         "ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+         model->numclusters, maxtriangles, acmr[0], acmr[1], atvr[0],
+         atvr[1]);
+}
+
+
+/* GLMquadric: the error quadric of a vertex for simplification, the
+ * area weighted sum of the squared distances to the planes of its
+ * triangles, as a symmetric 4x4 matrix.
+ */
+typedef struct {
+  double a2, b2, c2, ab, ac, bc, ad, bd, cd, d2;
+  double w;				/* total area */
+} GLMquadric;
+
+/* GLMcollapse: the cheapest edge collapse of a vertex, into another.
+ */
+typedef struct {
+  float cost;
+  uint  from, to;
+} GLMcollapse;
+
+static void
+_glmQuadricAdd(GLMquadric* q, const float* p0, const float* p1,
+               const float* p2)
+{
+  double u[3], v[3], n[3], len, d, w;
+  uint j;
+
+  for (j = 0; j < 3; j++) {
+    u[j] = p1[j] - p0[j];
+    v[j] = p2[j] - p0[j];
+  }
+  n[0] = u[1] * v[2] - u[2] * v[1];
+  n[1] = u[2] * v[0] - u[0] * v[2];
+  n[2] = u[0] * v[1] - u[1] * v[0];
+  len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+  if (len == 0.0)
+    return;
+  for (j = 0; j < 3; j++)
+    n[j] /= len;
+  d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+  w = 0.5 * len;
+
+  q->a2 += w * n[0] * n[0];
+  q->b2 += w * n[1] * n[1];
+  q->c2 += w * n[2] * n[2];
+  q->ab += w * n[0] * n[1];
+  q->ac += w * n[0] * n[2];
+  q->bc += w * n[1] * n[2];
+  q->ad += w * n[0] * d;
+  q->bd += w * n[1] * d;
+  q->cd += w * n[2] * d;
+  q->d2 += w * d * d;
+  q->w  += w;
+}
+
+static void
+_glmQuadricMerge(GLMquadric* q, const GLMquadric* r)
+{
+  q->a2 += r->a2; q->b2 += r->b2; q->c2 += r->c2;
+  q->ab += r->ab; q->ac += r->ac; q->bc += r->bc;
+  q->ad += r->ad; q->bd += r->bd; q->cd += r->cd;
+  q->d2 += r->d2;
+  q->w  += r->w;
+}
+
+/* _glmQuadricError: the mean squared distance of a point to the planes
+ * of a quadric.
+ */
+static double
+_glmQuadricError(const GLMquadric* q, const float* p)
+{
+  const double x = p[0], y = p[1], z = p[2];
+  double e;
+
+  if (q->w == 0.0)
+    return 0.0;
+  e = q->a2 * x * x + q->b2 * y * y + q->c2 * z * z +
+    2.0 * (q->ab * x * y + q->ac * x * z + q->bc * y * z +
+           q->ad * x + q->bd * y + q->cd * z) + q->d2;
+  return e > 0.0 ? e / q->w : 0.0;
+}
+
+static int
+_glmCollapseCompare(const void* a, const void* b)
+{
+  const GLMcollapse* ca = (const GLMcollapse*)a;
+  const GLMcollapse* cb = (const GLMcollapse*)b;
+
+  if (ca->cost != cb->cost)
+    return ca->cost < cb->cost ? -1 : 1;
+  return ca->from < cb->from ? -1 : (ca->from > cb->from);
+}
+
+/* GLMposref: a vertex and its position, for finding shared positions.
+ */
+typedef struct {
+  float p[3];
+  uint  index;
+} GLMposref;
+
+static int
+_glmPositionCompare(const void* a, const void* b)
+{
+  const GLMposref* pa = (const GLMposref*)a;
+  const GLMposref* pb = (const GLMposref*)b;
+  uint j;
+
+  for (j = 0; j < 3; j++) {
+    if (pa->p[j] != pb->p[j])
+      return pa->p[j] < pb->p[j] ? -1 : 1;
+  }
+  return 0;
+}
+
+/* _glmTriangleAdjacency: the triangles using each vertex, in CSR form:
+ * those of vertex v are adj[start[v]..start[v + 1]).
+ */
+static void
+_glmTriangleAdjacency(const uint* tris, uint numtris, uint numvertices,
+                      uint* start, uint* adj)
+{
+  uint i;
+
+  memset(start, 0, sizeof(uint) * (numvertices + 2));
+  for (i = 0; i < 3 * numtris; i++)
+    start[tris[i] + 1]++;
+  for (i = 1; i <= numvertices + 1; i++)
+    start[i] += start[i - 1];
+  for (i = 0; i < 3 * numtris; i++)
+    adj[start[tris[i]]++] = i / 3;
+  for (i = numvertices + 1; i > 0; i--)
+    start[i] = start[i - 1];
+  start[0] = 0;
+}
+
+/* _glmLockVertices: mark the vertices a simplification must keep: those
+ * sharing their position with another vertex (UV and normal seams),
+ * those used by more than one group, and those on open borders.
+ */
+static void
+_glmLockVertices(GLMmodel* model, const uint* tris, const uint* tgroup,
+                 uint numtris, const uint* start, const uint* adj,
+                 boolean* locked)
+{
+  const uint stride = model->vertexSize;
+  GLMposref* refs;
+  uint* firstgroup;
+  uint* ring;
+  uint maxvalence, i, j, k, n;
+
+  /* seams */
+  refs = (GLMposref*)malloc(sizeof(GLMposref) * (model->numvertices + 1));
+  for (i = 1; i <= model->numvertices; i++) {
+    memcpy(refs[i - 1].p, &model->vertexData[i * stride], 3 * sizeof(float));
+    refs[i - 1].index = i;
+  }
+  qsort(refs, model->numvertices, sizeof(GLMposref), _glmPositionCompare);
+  for (i = 1; i < model->numvertices; i++) {
+    if (_glmPositionCompare(&refs[i - 1], &refs[i]) == 0)
+      locked[refs[i - 1].index] = locked[refs[i].index] = TRUE;
+  }
+  free(refs);
+
+  /* group boundaries */
+  firstgroup = (uint*)malloc(sizeof(uint) * (model->numvertices + 1));
+  for (i = 0; i <= model->numvertices; i++)
+    firstgroup[i] = ~0u;
+  for (i = 0; i < 3 * numtris; i++) {
+    if (firstgroup[tris[i]] == ~0u)
+      firstgroup[tris[i]] = tgroup[i / 3];
+    else if (firstgroup[tris[i]] != tgroup[i / 3])
+      locked[tris[i]] = TRUE;
+  }
+  free(firstgroup);
+
+  /* borders: around an inner vertex each neighbour is in two of its
+     triangles */
+  maxvalence = 0;
+  for (i = 1; i <= model->numvertices; i++) {
+    if (start[i + 1] - start[i] > maxvalence)
+      maxvalence = start[i + 1] - start[i];
+  }
+  ring = (uint*)malloc(sizeof(uint) * (2 * maxvalence + 1));
+  for (i = 1; i <= model->numvertices; i++) {
+    if (locked[i])
+      continue;
+    n = 0;
+    for (j = start[i]; j < start[i + 1]; j++) {
+      const uint* t = &tris[3 * adj[j]];
+      for (k = 0; k < 3; k++) {
+        if (t[k] != i)
+          ring[n++] = t[k];
+      }
+    }
+    qsort(ring, n, sizeof(uint), _glmUintCompare);
+    for (j = 0; j < n; j = k) {
+      for (k = j + 1; k < n && ring[k] == ring[j]; k++)
+        ;
+      if (k - j != 2) {
+        locked[i] = TRUE;
+        break;
+      }
+    }
+  }
+  free(ring);
+}
+
+/* _glmCollapseFlips: whether collapsing vertex a into b would turn a
+ * triangle around a over.
+ */
+static boolean
+_glmCollapseFlips(GLMmodel* model, const uint* tris, const uint* start,
+                  const uint* adj, uint a, uint b)
+{
+  const uint stride = model->vertexSize;
+  const float* pb = &model->vertexData[b * stride];
+  uint i, j, k;
+
+  for (i = start[a]; i < start[a + 1]; i++) {
+    const uint* t = &tris[3 * adj[i]];
+    const float* p[3];
+    float u[3], v[3], n0[3], n1[3];
+
+    if (t[0] == b || t[1] == b || t[2] == b)
+      continue;				/* goes away */
+
+    for (k = 0; k < 3; k++)
+      p[k] = &model->vertexData[t[k] * stride];
+    for (j = 0; j < 3; j++) {
+      u[j] = p[1][j] - p[0][j];
+      v[j] = p[2][j] - p[0][j];
+    }
+    _glmCross(u, v, n0);
+
+    for (k = 0; k < 3; k++) {
+      if (t[k] == a)
+        p[k] = pb;
+    }
+    for (j = 0; j < 3; j++) {
+      u[j] = p[1][j] - p[0][j];
+      v[j] = p[2][j] - p[0][j];
+    }
+    _glmCross(u, v, n1);
+
+    if (_glmDot(n0, n1) <= 0.0)
+      return TRUE;
+  }
+  return FALSE;
+}
+
+/* _glmSimplify: collapse edges of the triangles until there are at
+ * most target of them, or no edge can be collapsed.  Each pass finds
+ * the cheapest collapse of each unlocked vertex, costed with the sum of
+ * the quadrics of both ends, and does the cheapest of those that don't
+ * turn a triangle over, until about half the triangles left to remove
+ * are gone.  A collapse locks the vertices of the triangles around the
+ * collapsed vertex for the rest of the pass, since the triangles they
+ * would be checked against have changed.  Degenerate triangles are
+ * removed, keeping the order of the rest.  Returns the new number of
+ * triangles.
+ *
+ * remap - the vertex each vertex was collapsed into, itself if none;
+ *         updated
+ */
+static uint
+_glmSimplify(GLMmodel* model, uint* tris, uint* tgroup, uint numtris,
+             uint target, GLMquadric* quadrics, const boolean* locked,
+             uint* start, uint* adj, uint* remap)
+{
+  const uint stride = model->vertexSize;
+  GLMcollapse* collapses;
+  boolean* touched;
+  uint numcollapses, goal, removed, done, i, j, k, n;
+
+  collapses = (GLMcollapse*)malloc(sizeof(GLMcollapse) *
+                                   (model->numvertices + 1));
+  touched = (boolean*)malloc(model->numvertices + 1);
+
+  while (numtris > target) {
+    _glmTriangleAdjacency(tris, numtris, model->numvertices, start, adj);
+
+    /* the cheapest collapse of each vertex, along one of its edges */
+    numcollapses = 0;
+    for (i = 1; i <= model->numvertices; i++) {
+      GLMcollapse best;
+
+      if (locked[i] || start[i] == start[i + 1])
+        continue;
+      best.cost = HUGE_VAL;
+      best.from = i;
+      best.to = 0;
+      for (j = start[i]; j < start[i + 1]; j++) {
+        for (k = 0; k < 3; k++) {
+          const uint v = tris[3 * adj[j] + k];
+          GLMquadric q;
+          float cost;
+          if (v == i)
+            continue;
+          q = quadrics[i];
+          _glmQuadricMerge(&q, &quadrics[v]);
+          cost = _glmQuadricError(&q, &model->vertexData[v * stride]);
+          if (cost < best.cost || (cost == best.cost && v < best.to)) {
+            best.cost = cost;
+            best.to = v;
+          }
+        }
+      }
+      if (best.to)
+        collapses[numcollapses++] = best;
+    }
+    qsort(collapses, numcollapses, sizeof(GLMcollapse), _glmCollapseCompare);
+
+    /* only do the cheaper half or so of what's left in one pass, so
+       the rest can be chosen again from what the mesh has become */
+    goal = (numtris - target) / 2 + 64;
+    if (goal > numtris - target)
+      goal = numtris - target;
+
+    memset(touched, 0, model->numvertices + 1);
+    removed = done = 0;
+    for (i = 0; i < numcollapses && removed < goal; i++) {
+      const uint a = collapses[i].from, b = collapses[i].to;
+
+      if (touched[a] || touched[b] ||
+          _glmCollapseFlips(model, tris, start, adj, a, b))
+        continue;
+
+      for (j = start[a]; j < start[a + 1]; j++) {
+        const uint* t = &tris[3 * adj[j]];
+        if (t[0] == b || t[1] == b || t[2] == b)
+          removed++;
+        touched[t[0]] = touched[t[1]] = touched[t[2]] = TRUE;
+      }
+      remap[a] = b;
+      _glmQuadricMerge(&quadrics[b], &quadrics[a]);
+      done++;
+    }
+    if (done == 0)
+      break;
+
+    /* move the collapsed vertices, dropping degenerate triangles */
+    n = 0;
+    for (i = 0; i < numtris; i++) {
+      const uint v0 = remap[tris[3 * i + 0]];
+      const uint v1 = remap[tris[3 * i + 1]];
+      const uint v2 = remap[tris[3 * i + 2]];
+      if (v0 == v1 || v1 == v2 || v2 == v0)
+        continue;
+      tris[3 * n + 0] = v0;
+      tris[3 * n + 1] = v1;
+      tris[3 * n + 2] = v2;
+      tgroup[n] = tgroup[i];
+      n++;
+    }
+    numtris = n;
+  }
+
+  free(collapses);
+  free(touched);
+  return numtris;
+}
+
+/* _glmPointTriangleDistance: the distance of point p to triangle
+ * (a, b, c), after Ericson's "Real-Time Collision Detection", 5.1.5.
+ */
+static double
+_glmPointTriangleDistance(const float* p, const float* a, const float* b,
+                          const float* c)
+{
+  double ab[3], ac[3], ap[3], bp[3], cp[3], q[3], len2;
+  double d1, d2, d3, d4, d5, d6, va, vb, vc, v, w, denom;
+  uint j;
+
+  for (j = 0; j < 3; j++) {
+    ab[j] = b[j] - a[j];
+    ac[j] = c[j] - a[j];
+    ap[j] = p[j] - a[j];
+    bp[j] = p[j] - b[j];
+    cp[j] = p[j] - c[j];
+  }
+#define GLM_DOT3(u, v) ((u)[0] * (v)[0] + (u)[1] * (v)[1] + (u)[2] * (v)[2])
+  d1 = GLM_DOT3(ab, ap);
+  d2 = GLM_DOT3(ac, ap);
+  d3 = GLM_DOT3(ab, bp);
+  d4 = GLM_DOT3(ac, bp);
+  d5 = GLM_DOT3(ab, cp);
+  d6 = GLM_DOT3(ac, cp);
+#undef GLM_DOT3
+  vc = d1 * d4 - d3 * d2;
+  vb = d5 * d2 - d1 * d6;
+  va = d3 * d6 - d5 * d4;
+
+  if (d1 <= 0.0 && d2 <= 0.0) {		/* vertex a */
+    v = w = 0.0;
+  }
+  else if (d3 >= 0.0 && d4 <= d3) {		/* vertex b */
+    v = 1.0; w = 0.0;
+  }
+  else if (d6 >= 0.0 && d5 <= d6) {		/* vertex c */
+    v = 0.0; w = 1.0;
+  }
+  else if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) {	/* edge ab */
+    v = d1 / (d1 - d3); w = 0.0;
+  }
+  else if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) {	/* edge ac */
+    v = 0.0; w = d2 / (d2 - d6);
+  }
+  else if (va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0) {	/* edge bc */
+    w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+    v = 1.0 - w;
+  }
+  else {					/* inside */
+    denom = va + vb + vc;
+    if (denom == 0.0) {
+      v = w = 0.0;
+    }
+    else {
+      v = vb / denom;
+      w = vc / denom;
+    }
+  }
+
+  len2 = 0.0;
+  for (j = 0; j < 3; j++) {
+    q[j] = a[j] + v * ab[j] + w * ac[j] - p[j];
+    len2 += q[j] * q[j];
+  }
+  return sqrt(len2);
+}
+
+/* _glmLevelError: how far the vertices of the full detail mesh are from
+ * a simplified one: the largest distance of a vertex to the nearest
+ * triangle around the vertex it was collapsed into or around one of
+ * that vertex's neighbours.  The nearest of those isn't always the
+ * nearest of all, so this can only overestimate the distance of the
+ * vertices to the simplified surface.
+ *
+ * start, adj - scratch for the adjacency of the simplified triangles
+ */
+static float
+_glmLevelError(GLMmodel* model, const uint* tris, uint numtris,
+               const uint* remap, const boolean* used, uint* start,
+               uint* adj)
+{
+  const uint stride = model->vertexSize;
+  double error = 0.0;
+  uint i, j, k, m, r;
+
+  _glmTriangleAdjacency(tris, numtris, model->numvertices, start, adj);
+
+  for (i = 1; i <= model->numvertices; i++) {
+    const float* p = &model->vertexData[i * stride];
+    double nearest = HUGE_VAL;
+
+    if (!used[i])
+      continue;
+    for (r = i; remap[r] != r; r = remap[r])
+      ;
+    if (r == i)
+      continue;				/* still a vertex of the mesh */
+
+    for (j = start[r]; j < start[r + 1]; j++) {
+      for (k = 0; k < 3; k++) {
+        const uint n = tris[3 * adj[j] + k];
+        for (m = start[n]; m < start[n + 1]; m++) {
+          const uint* t = &tris[3 * adj[m]];
+          double d = _glmPointTriangleDistance(p,
+                                   &model->vertexData[t[0] * stride],
+                                   &model->vertexData[t[1] * stride],
+                                   &model->vertexData[t[2] * stride]);
+          if (d < nearest)
+            nearest = d;
+        }
+      }
+    }
+    if (nearest != HUGE_VAL && nearest > error)
+      error = nearest;
+  }
+  return error;
+}
+
+/* glmMakeLODs: Makes up to numlods (at most GLM_MAX_LODS) simplified
+ * levels of detail of a model with quadric error edge collapses, level
+ * l having about 1/2^l of the triangles.  Each level is made from the
+ * one before and its indexes are appended to the index data, group by
+ * group in index data order, in vertex cache order.  Collapses only
+ * move a vertex onto a neighbouring one, so all levels use the model's
+ * vertex data, and vertices on seams, borders and group boundaries are
+ * never moved.  The error of a level is the largest distance of a full
+ * detail vertex to the level's triangles, see _glmLevelError().  Stops
+ * early when a level can't be simplified further.
+ * Requires glmBuildVBOData() to have been called.
+ *
+ * model   - initialized GLMmodel structure
+ * numlods - number of levels wanted
+ */
+void
+glmMakeLODs(GLMmodel* model, uint numlods)
+{
+  const uint stride = model->vertexSize;
+  GLMgroup** groups;			/* by place in the list */
+  GLMgroup* group;
+  GLMquadric* quadrics;
+  boolean* locked;
+  boolean* used;
+  uint* remap;
+  uint* tris;
+  uint* tgroup;
+  uint* start;
+  uint* adj;
+  uint* local;
+  uint* lodtris[GLM_MAX_LODS];
+  uint lodcount[GLM_MAX_LODS];
+  uint numtris, basetris, total, pos, g, i, j, l;
+  float min[3], max[3], r2, error;
+
+  assert(model);
+  assert(model->indexData && !model->cacheData);
+  assert(model->numlods == 0);
+
+  if (numlods > GLM_MAX_LODS)
+    numlods = GLM_MAX_LODS;
+
+  /* the triangles in index data order, and the group of each */
+  basetris = model->numindices / 3;
+  tris = (uint*)malloc(sizeof(uint) * (model->numindices + 1));
+  memcpy(tris, model->indexData, sizeof(uint) * model->numindices);
+  tgroup = (uint*)malloc(sizeof(uint) * (basetris + 1));
+  groups = (GLMgroup**)malloc(sizeof(GLMgroup*) * (model->numgroups + 1));
+  for (group = model->groups, g = 0; group; group = group->next, g++) {
+    groups[g] = group;
+    for (i = 0; i < group->numtriangles; i++)
+      tgroup[group->indexDataOffset / sizeof(uint) / 3 + i] = g;
+  }
+  numtris = basetris;
+
+  start = (uint*)malloc(sizeof(uint) * (model->numvertices + 2));
+  adj = (uint*)malloc(sizeof(uint) * (model->numindices + 1));
+  _glmTriangleAdjacency(tris, numtris, model->numvertices, start, adj);
+
+  locked = (boolean*)calloc(model->numvertices + 1, sizeof(boolean));
+  _glmLockVertices(model, tris, tgroup, numtris, start, adj, locked);
+
+  used = (boolean*)calloc(model->numvertices + 1, sizeof(boolean));
+  for (i = 0; i < 3 * numtris; i++)
+    used[tris[i]] = TRUE;
+  remap = (uint*)malloc(sizeof(uint) * (model->numvertices + 1));
+  for (i = 0; i <= model->numvertices; i++)
+    remap[i] = i;
+
+  quadrics = (GLMquadric*)calloc(model->numvertices + 1, sizeof(GLMquadric));
+  for (i = 0; i < numtris; i++) {
+    const float* p0 = &model->vertexData[tris[3 * i + 0] * stride];
+    const float* p1 = &model->vertexData[tris[3 * i + 1] * stride];
+    const float* p2 = &model->vertexData[tris[3 * i + 2] * stride];
+    GLMquadric q;
+
+    memset(&q, 0, sizeof(q));
+    _glmQuadricAdd(&q, p0, p1, p2);
+    for (j = 0; j < 3; j++)
+      _glmQuadricMerge(&quadrics[tris[3 * i + j]], &q);
+  }
+
+  /* the levels */
+  for (l = 0; l < numlods; l++) {
+    uint n = _glmSimplify(model, tris, tgroup, numtris, basetris >> (l + 1),
+                          quadrics, locked, start, adj, remap);
+    if (n > numtris - numtris / 8)
+      break;				/* not worth a level */
+    numtris = n;
+
+    error = _glmLevelError(model, tris, numtris, remap, used, start, adj);
+    if (l > 0 && error < model->lodError[l - 1])
+      error = model->lodError[l - 1];	/* keep the levels in order */
+
+    lodtris[l] = (uint*)malloc(sizeof(uint) * 3 * numtris + 1);
+    memcpy(lodtris[l], tris, sizeof(uint) * 3 * numtris);
+    lodcount[l] = numtris;
+    model->lodError[l] = error;
+    /* offsets within the level for now */
+    for (group = model->groups; group; group = group->next) {
+      group->lodTriangles[l] = 0;
+      group->lodDataOffset[l] = 0;
+    }
+    for (i = 0; i < numtris; i++) {
+      group = groups[tgroup[i]];
+      if (group->lodTriangles[l]++ == 0)
+        group->lodDataOffset[l] = 3 * i * sizeof(uint);
+    }
+  }
+  model->numlods = l;
+
+  /* append the levels to the index data, each group's part in vertex
+     cache order */
+  total = model->numindices;
+  for (l = 0; l < model->numlods; l++)
+    total += 3 * lodcount[l];
+  model->indexData = (uint*)realloc(model->indexData,
+                                    sizeof(uint) * total + 1);
+
+  local = (uint*)malloc(sizeof(uint) * (model->numvertices + 1));
+  for (i = 0; i <= model->numvertices; i++)
+    local[i] = ~0u;
+  pos = model->numindices;
+  for (l = 0; l < model->numlods; l++) {
+    memcpy(model->indexData + pos, lodtris[l], sizeof(uint) * 3 * lodcount[l]);
+    for (group = model->groups; group; group = group->next) {
+      group->lodDataOffset[l] += pos * sizeof(uint);
+      _glmCacheOrder(model,
+                     model->indexData + group->lodDataOffset[l] / sizeof(uint),
+                     group->lodTriangles[l], local, FALSE);
+    }
+    free(lodtris[l]);
+    pos += 3 * lodcount[l];
+  }
+  free(local);
+  model->numindices = total;
+
+  /* bounding sphere of the model, for choosing a level */
+  for (j = 0; j < 3; j++)
+    min[j] = max[j] = model->vertexData[stride + j];
+  for (i = 2; i <= model->numvertices; i++) {
+    for (j = 0; j < 3; j++) {
+      if (model->vertexData[i * stride + j] < min[j])
+        min[j] = model->vertexData[i * stride + j];
+      if (model->vertexData[i * stride + j] > max[j])
+        max[j] = model->vertexData[i * stride + j];
+    }
+  }
+  for (j = 0; j < 3; j++)
+    model->lodCenter[j] = 0.5 * (min[j] + max[j]);
+  r2 = 0.0;
+  for (i = 1; i <= model->numvertices; i++) {
+    float d2 = 0.0;
+    for (j = 0; j < 3; j++) {
+      float d = model->vertexData[i * stride + j] - model->lodCenter[j];
+      d2 += d * d;
+    }
+    if (d2 > r2)
+      r2 = d2;
+  }
+  model->lodRadius = sqrt(r2);
+
+  printf("glmMakeLODs(): %u triangles", basetris);
+  for (l = 0; l < model->numlods; l++)
+    printf(", %u (error %g)", lodcount[l], model->lodError[l]);
+  printf("\n");
+
+  free(groups);
+  free(tgroup);
+  free(tris);
+  free(start);
+  free(adj);
+  free(locked);
+  free(used);
+  free(remap);
+  free(quadrics);
+}
+
+
+/* Binary model cache.  A cache holds everything glmDrawVBO() needs after
+ * glmBuildVBOData(): the vertex and index data exactly as uploaded, the
+ * groups' index ranges, the materials, and the clusters and levels of
+ * detail of glmMakeClusters() and glmMakeLODs(), if made.  All sections are 16-byte
+ * aligned so the vertex and index data can be used straight from the
+ * mapped file.  Numbers are in native byte order; a cache written on a
+ * different kind of machine fails validation and is rebuilt.
+ *
+ * The cache is stamped with the .obj file and its material library, as
+ * the materials are stored in it.  Texture maps aren't: only their names
+ * are cached and the images are read by glmLoadTextures() every time.
+ */
+#define GLM_CACHE_MAGIC   "GLMCACHE"
+#define GLM_CACHE_VERSION 7
+#define GLM_CACHE_ALIGN(x) (((x) + 15) & ~(size_t)15)
+
+typedef struct {
+  char     magic[8];
+  uint     version;
+  uint     byteorder;			/* 0x01020304 */
+  uint64_t objsize;			/* validation of the .obj file */
+  int64_t  objmtime;
+  uint64_t objhash;
+  uint64_t mtlsize;			/* validation of the material library */
+  int64_t  mtlmtime;
+  uint64_t mtlhash;
+  uint     mtllib;			/* offset into the strings, or ~0 */
+  uint     numvertices, numnormals, numtexcoords, numtriangles;
+  uint     vertexSize, posOffset, normOffset, texOffset;
+  uint     numindices, numgroups, nummaterials, numclusters;
+  float    position[3], scale;
+  uint     numlods;
+  float    lodError[GLM_MAX_LODS], lodCenter[3], lodRadius;
+  uint64_t vertexData, indexData, groups, materials, clusters, strings;
+} GLMcacheHeader;
+
+typedef struct {
+  uint numtriangles, material;
+  uint minIndex, maxIndex, indexDataOffset;
+  uint lodTriangles[GLM_MAX_LODS], lodDataOffset[GLM_MAX_LODS];
+  uint name;				/* offset into the strings */
+} GLMcacheGroup;
+
+typedef struct {
+  float diffuse[4], ambient[4], specular[4], emmissive[4];
+  float shininess;
+  uint  name, map_kd;			/* offsets into the strings, or ~0 */
+} GLMcacheMaterial;
+
+typedef struct {
+  float center[3], radius;
+  float axis[3], coneCos, coneSin;
+  uint  material, firstIndex, numIndices;
+} GLMcacheCluster;
+
+/* _glmCacheName: name of the cache file for a model file.  The return
+ * value should be free'd.
+ */
+static char*
+_glmCacheName(const char* filename)
+{
+  char* name = (char*)malloc(strlen(filename) + 6);
+  strcpy(name, filename);
+  strcat(name, ".glmc");
+  return name;
+}
+
+/* _glmFileStamp: get the size, mtime and a hash of a file.  Hashing all
+ * of a multi-GB file would cost about as much as parsing it, so only 16
+ * evenly spaced 64KB blocks are hashed (FNV-1a), which together with
+ * size and mtime catches edited and replaced files in practice.
+ * Returns FALSE if the file can't be read.
+ */
+static boolean
+_glmFileStamp(const char* filename, uint64_t* size, int64_t* mtime,
+              uint64_t* hash)
+{
+  const size_t block = 64 * 1024;
+  char* data;
+  size_t len, i, j;
+  boolean mapped;
+  uint64_t h = 14695981039346656037ULL;
+  struct stat st;
+
+  if (stat(filename, &st) != 0)
+    return FALSE;
+  data = _glmMapFile(filename, &len, &mapped);
+  if (!data)
+    return FALSE;
+
+  for (i = 0; i < 16; i++) {
+    size_t start = len > block ? (len - block) / 15 * i : 0;
+    size_t end = start + block < len ? start + block : len;
+    for (j = start; j < end; j++) {
+      h ^= (unsigned char)data[j];
+      h *= 1099511628211ULL;
+    }
+    if (len <= block)
+      break;
+  }
+  _glmUnmapFile(data, len, mapped);
+
+  *size = len;
+  *mtime = (int64_t)st.st_mtime;
+  *hash = h;
+  return TRUE;
+}
+
+/* glmWriteCache: Writes the binary cache of a model next to its .obj
+ * file (as <file>.glmc).  Calls glmBuildVBOData() if needed.  Failing to
+ * write the cache is not an error, the model just won't load faster
+ * next time.
+ *
+ * model - initialized GLMmodel structure, after glmReIndex()
+ */
+void
+glmWriteCache(GLMmodel* model)
+{
+  GLMcacheHeader hdr;
+  GLMcacheGroup* groups;
+  GLMcacheMaterial* materials;
+  GLMcacheCluster* clusters;
+  GLMgroup* group;
+  char* strings;
+  size_t stringsize, pos, vertexbytes, indexbytes;
+  char* name;
+  char* tmpname;
+  FILE* file;
+  uint i;
+  static const char zeros[16];
+
+  glmBuildVBOData(model);
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, GLM_CACHE_MAGIC, 8);
+  hdr.version = GLM_CACHE_VERSION;
+  hdr.byteorder = 0x01020304;
+  if (!_glmFileStamp(model->pathname, &hdr.objsize, &hdr.objmtime,
+                     &hdr.objhash))
+    return;
+  if (model->mtllibname) {
+    char* mtlpath = _glmMTLPath(model->pathname, model->mtllibname);
+    boolean ok = _glmFileStamp(mtlpath, &hdr.mtlsize, &hdr.mtlmtime,
+                               &hdr.mtlhash);
+    free(mtlpath);
+    if (!ok)
+      return;
+  }
+
+  hdr.numvertices  = model->numvertices;
+  hdr.numnormals   = model->numnormals;
+  hdr.numtexcoords = model->numtexcoords;
+  hdr.numtriangles = model->numtriangles;
+  hdr.vertexSize   = model->vertexSize;
+  hdr.posOffset    = model->posOffset;
+  hdr.normOffset   = model->normOffset;
+  hdr.texOffset    = model->texOffset;
+  hdr.numindices   = model->numindices;
+  hdr.numgroups    = model->numgroups;
+  hdr.nummaterials = model->nummaterials;
+  hdr.numclusters  = model->numclusters;
+  hdr.scale        = model->scale;
+  memcpy(hdr.position, model->position, sizeof(hdr.position));
+  hdr.numlods      = model->numlods;
+  hdr.lodRadius    = model->lodRadius;
+  memcpy(hdr.lodError, model->lodError, sizeof(hdr.lodError));
+  memcpy(hdr.lodCenter, model->lodCenter, sizeof(hdr.lodCenter));
+
+  /* gather the strings */
+  stringsize = 0;
+  if (model->mtllibname)
+    stringsize += strlen(model->mtllibname) + 1;
+  for (group = model->groups; group; group = group->next)
+    stringsize += strlen(group->name) + 1;
+  for (i = 0; i < model->nummaterials; i++) {
+    if (model->materials[i].name)
+      stringsize += strlen(model->materials[i].name) + 1;
+    if (model->materials[i].map_kd)
+      stringsize += strlen(model->materials[i].map_kd) + 1;
+  }
+  strings = (char*)malloc(stringsize + 1);
+  stringsize = 0;
+
+  hdr.mtllib = ~0u;
+  if (model->mtllibname) {
+    hdr.mtllib = stringsize;
+    strcpy(strings + stringsize, model->mtllibname);
+    stringsize += strlen(model->mtllibname) + 1;
+  }
+
+  groups = (GLMcacheGroup*)calloc(model->numgroups + 1,
+                                  sizeof(GLMcacheGroup));
+  for (group = model->groups, i = 0; group; group = group->next, i++) {
+    groups[i].numtriangles    = group->numtriangles;
+    groups[i].material        = group->material;
+    groups[i].minIndex        = group->minIndex;
+    groups[i].maxIndex        = group->maxIndex;
+    groups[i].indexDataOffset = group->indexDataOffset;
+    memcpy(groups[i].lodTriangles, group->lodTriangles,
+           sizeof(group->lodTriangles));
+    memcpy(groups[i].lodDataOffset, group->lodDataOffset,
+           sizeof(group->lodDataOffset));
+    groups[i].name           = stringsize;
+    strcpy(strings + stringsize, group->name);
+    stringsize += strlen(group->name) + 1;
+  }
+
+  materials = (GLMcacheMaterial*)calloc(model->nummaterials + 1,
+                                        sizeof(GLMcacheMaterial));
+  for (i = 0; i < model->nummaterials; i++) {
+    GLMmaterial* mat = &model->materials[i];
+
+    memcpy(materials[i].diffuse, mat->diffuse, sizeof(mat->diffuse));
+    memcpy(materials[i].ambient, mat->ambient, sizeof(mat->ambient));
+    memcpy(materials[i].specular, mat->specular, sizeof(mat->specular));
+    memcpy(materials[i].emmissive, mat->emmissive, sizeof(mat->emmissive));
+    materials[i].shininess = mat->shininess;
+    materials[i].name = materials[i].map_kd = ~0u;
+    if (mat->name) {
+      materials[i].name = stringsize;
+      strcpy(strings + stringsize, mat->name);
+      stringsize += strlen(mat->name) + 1;
+    }
+    if (mat->map_kd) {
+      materials[i].map_kd = stringsize;
+      strcpy(strings + stringsize, mat->map_kd);
+      stringsize += strlen(mat->map_kd) + 1;
+    }
+  }
+
+  clusters = (GLMcacheCluster*)calloc(model->numclusters + 1,
+                                      sizeof(GLMcacheCluster));
+  for (i = 0; i < model->numclusters; i++) {
+    const GLMcluster* cluster = &model->clusters[i];
+
+    memcpy(clusters[i].center, cluster->center, sizeof(cluster->center));
+    memcpy(clusters[i].axis, cluster->axis, sizeof(cluster->axis));
+    clusters[i].radius     = cluster->radius;
+    clusters[i].coneCos    = cluster->coneCos;
+    clusters[i].coneSin    = cluster->coneSin;
+    clusters[i].material   = cluster->material;
+    clusters[i].firstIndex = cluster->firstIndex;
+    clusters[i].numIndices = cluster->numIndices;
+  }
+
+  /* lay out the sections */
+  vertexbytes = (size_t)(model->numvertices + 1) * model->vertexSize *
+                sizeof(float);
+  indexbytes = (size_t)model->numindices * sizeof(uint);
+  pos = GLM_CACHE_ALIGN(sizeof(hdr));
+  hdr.vertexData = pos;
+  pos = GLM_CACHE_ALIGN(pos + vertexbytes);
+  hdr.indexData = pos;
+  pos = GLM_CACHE_ALIGN(pos + indexbytes);
+  hdr.groups = pos;
+  pos = GLM_CACHE_ALIGN(pos + model->numgroups * sizeof(GLMcacheGroup));
+  hdr.materials = pos;
+  pos = GLM_CACHE_ALIGN(pos + model->nummaterials * sizeof(GLMcacheMaterial));
+  hdr.clusters = pos;
+  pos = GLM_CACHE_ALIGN(pos + model->numclusters * sizeof(GLMcacheCluster));
+  hdr.strings = pos;
+
+  /* write to a temporary file and rename it, so a concurrent or
+     interrupted write never leaves a bad cache behind */
+  name = _glmCacheName(model->pathname);
+  tmpname = (char*)malloc(strlen(name) + 5);
+  strcpy(tmpname, name);
+  strcat(tmpname, ".tmp");
+
+  file = fopen(tmpname, "wb");
+  if (file) {
+    boolean ok;
+
+#define GLM_CACHE_PAD() \
+    fwrite(zeros, 1, GLM_CACHE_ALIGN(ftell(file)) - ftell(file), file)
+
+    fwrite(&hdr, sizeof(hdr), 1, file);
+    GLM_CACHE_PAD();
+    fwrite(model->vertexData, 1, vertexbytes, file);
+    GLM_CACHE_PAD();
+    fwrite(model->indexData, 1, indexbytes, file);
+    GLM_CACHE_PAD();
+    fwrite(groups, sizeof(GLMcacheGroup), model->numgroups, file);
+    GLM_CACHE_PAD();
+    fwrite(materials, sizeof(GLMcacheMaterial), model->nummaterials, file);
+    GLM_CACHE_PAD();
+    fwrite(clusters, sizeof(GLMcacheCluster), model->numclusters, file);
+    GLM_CACHE_PAD();
+    fwrite(strings, 1, stringsize, file);
+
+#undef GLM_CACHE_PAD
+
+    ok = !ferror(file);
+    if (fclose(file) != 0)
+      ok = FALSE;
+    if (!ok || rename(tmpname, name) != 0) {
+      fprintf(stderr, "glmWriteCache(): can't write \"%s\".\n", name);
+      remove(tmpname);
+    }
+  }
+
+  free(tmpname);
+  free(name);
+  free(groups);
+  free(materials);
+  free(clusters);
+  free(strings);
+}
+
+/* glmReadCache: Loads a model from the binary cache of a .obj file, if
+ * there is one and it's up to date.  The vertex and index data are used
+ * in place from the mapped cache file, so the returned model has no
+ * vertices/triangles arrays and is only good for glmMakeVBOs(),
+ * glmDrawVBO(), glmLoadTextures() and the material functions.  Returns
+ * NULL if there's no valid cache.
+ *
+ * filename - name of the .obj file (not of the cache)
+ */
+GLMmodel*
+glmReadCache(char* filename)
+{
+  GLMcacheHeader hdr;
+  const GLMcacheGroup* groups;
+  const GLMcacheMaterial* materials;
+  const GLMcacheCluster* clusters;
+  const char* strings;
+  GLMmodel* model;
+  GLMgroup** tail;
+  char* name;
+  char* data;
+  size_t size, stringsize;
+  boolean mapped;
+  uint64_t objsize, objhash, mtlsize, mtlhash;
+  int64_t objmtime, mtlmtime;
+  uint i;
+
+  if (!_glmFileStamp(filename, &objsize, &objmtime, &objhash))
+    return NULL;
+
+  name = _glmCacheName(filename);
+  data = _glmMapFile(name, &size, &mapped);
+  free(name);
+  if (!data)
+    return NULL;
+
+  /* validate */
+  if (size < sizeof(hdr))
+    goto invalid;
+  memcpy(&hdr, data, sizeof(hdr));
+  if (memcmp(hdr.magic, GLM_CACHE_MAGIC, 8) != 0 ||
+      hdr.version != GLM_CACHE_VERSION ||
+      hdr.byteorder != 0x01020304 ||
+      hdr.objsize != objsize ||
+      hdr.objmtime != objmtime ||
+      hdr.objhash != objhash)
+    goto invalid;
+  if (hdr.vertexData + (uint64_t)(hdr.numvertices + 1) * hdr.vertexSize *
+      sizeof(float) > hdr.indexData ||
+      hdr.indexData + (uint64_t)hdr.numindices * sizeof(uint) > hdr.groups ||
+      hdr.groups + (uint64_t)hdr.numgroups * sizeof(GLMcacheGroup) >
+      hdr.materials ||
+      hdr.materials + (uint64_t)hdr.nummaterials * sizeof(GLMcacheMaterial) >
+      hdr.clusters ||
+      hdr.clusters + (uint64_t)hdr.numclusters * sizeof(GLMcacheCluster) >
+      hdr.strings ||
+      hdr.strings > size ||
+      (hdr.vertexData | hdr.indexData | hdr.groups | hdr.materials |
+       hdr.clusters) & 15)
+    goto invalid;
+
+  groups = (const GLMcacheGroup*)(data + hdr.groups);
+  materials = (const GLMcacheMaterial*)(data + hdr.materials);
+  clusters = (const GLMcacheCluster*)(data + hdr.clusters);
+  strings = data + hdr.strings;
+  stringsize = size - hdr.strings;
+
+  /* make sure all the names are terminated within the file */
+  if (stringsize == 0 || strings[stringsize - 1] != '\0')
+    goto invalid;
+
+  /* the materials are only current if the library hasn't changed */
+  if (hdr.mtllib != ~0u) {
+    char* mtlpath;
+    boolean ok;
+
+    if (hdr.mtllib >= stringsize)
+      goto invalid;
+    mtlpath = _glmMTLPath(filename, strings + hdr.mtllib);
+    ok = _glmFileStamp(mtlpath, &mtlsize, &mtlmtime, &mtlhash);
+    free(mtlpath);
+    if (!ok ||
+        hdr.mtlsize != mtlsize ||
+        hdr.mtlmtime != mtlmtime ||
+        hdr.mtlhash != mtlhash)
+      goto invalid;
+  }
+
+  if (hdr.numlods > GLM_MAX_LODS)
+    goto invalid;
+  for (i = 0; i < hdr.numgroups; i++) {
+    uint l;
+
+    if (groups[i].name >= stringsize ||
+        groups[i].material >= hdr.nummaterials ||
+        groups[i].indexDataOffset + (uint64_t)groups[i].numtriangles * 3 *
+        sizeof(uint) > (uint64_t)hdr.numindices * sizeof(uint))
+      goto invalid;
+    for (l = 0; l < hdr.numlods; l++) {
+      if (groups[i].lodDataOffset[l] + (uint64_t)groups[i].lodTriangles[l] *
+          3 * sizeof(uint) > (uint64_t)hdr.numindices * sizeof(uint))
+        goto invalid;
+    }
+  }
+  for (i = 0; i < hdr.nummaterials; i++) {
+    if ((materials[i].name != ~0u && materials[i].name >= stringsize) ||
+        (materials[i].map_kd != ~0u && materials[i].map_kd >= stringsize))
+      goto invalid;
+  }
+  for (i = 0; i < hdr.numclusters; i++) {
+    if (clusters[i].material >= hdr.nummaterials ||
+        (uint64_t)clusters[i].firstIndex + clusters[i].numIndices >
+        hdr.numindices)
+      goto invalid;
+  }
+
+  /* build the model */
+  model = (GLMmodel*)calloc(1, sizeof(GLMmodel));
+  model->pathname     = stralloc(filename);
+  if (hdr.mtllib != ~0u)
+    model->mtllibname = stralloc(strings + hdr.mtllib);
+  model->numvertices  = hdr.numvertices;
+  model->numnormals   = hdr.numnormals;
+  model->numtexcoords = hdr.numtexcoords;
+  model->numtriangles = hdr.numtriangles;
+  model->vertexSize   = hdr.vertexSize;
+  model->posOffset    = hdr.posOffset;
+  model->normOffset   = hdr.normOffset;
+  model->texOffset    = hdr.texOffset;
+  model->numindices   = hdr.numindices;
+  model->scale        = hdr.scale;
+  memcpy(model->position, hdr.position, sizeof(hdr.position));
+  model->numlods      = hdr.numlods;
+  model->lodRadius    = hdr.lodRadius;
+  model->lodPixels    = 1.0;
+  memcpy(model->lodError, hdr.lodError, sizeof(hdr.lodError));
+  memcpy(model->lodCenter, hdr.lodCenter, sizeof(hdr.lodCenter));
+  model->vertexData   = (float*)(data + hdr.vertexData);
+  model->indexData    = (uint*)(data + hdr.indexData);
+  model->cacheData    = data;
+  model->cacheSize    = size;
+  model->cacheMapped  = mapped;
+
+  /* groups, in their original order */
+  tail = &model->groups;
+  for (i = 0; i < hdr.numgroups; i++) {
+    GLMgroup* group = (GLMgroup*)calloc(1, sizeof(GLMgroup));
+    group->name           = stralloc(strings + groups[i].name);
+    group->numtriangles   = groups[i].numtriangles;
+    group->material       = groups[i].material;
+    group->minIndex       = groups[i].minIndex;
+    group->maxIndex       = groups[i].maxIndex;
+    group->indexDataOffset = groups[i].indexDataOffset;
+    group->indexVboOffset  = groups[i].indexDataOffset;
+    memcpy(group->lodTriangles, groups[i].lodTriangles,
+           sizeof(group->lodTriangles));
+    memcpy(group->lodDataOffset, groups[i].lodDataOffset,
+           sizeof(group->lodDataOffset));
+    memcpy(group->lodVboOffset, groups[i].lodDataOffset,
+           sizeof(group->lodVboOffset));
+    *tail = group;
+    tail = &group->next;
+  }
+  model->numgroups = hdr.numgroups;
+
+  model->materials = (GLMmaterial*)calloc(hdr.nummaterials + 1,
+                                          sizeof(GLMmaterial));
+  for (i = 0; i < hdr.nummaterials; i++) {
+    GLMmaterial* mat = &model->materials[i];
+
+    memcpy(mat->diffuse, materials[i].diffuse, sizeof(mat->diffuse));
+    memcpy(mat->ambient, materials[i].ambient, sizeof(mat->ambient));
+    memcpy(mat->specular, materials[i].specular, sizeof(mat->specular));
+    memcpy(mat->emmissive, materials[i].emmissive, sizeof(mat->emmissive));
+    mat->shininess = materials[i].shininess;
+    if (materials[i].name != ~0u)
+      mat->name = stralloc(strings + materials[i].name);
+    if (materials[i].map_kd != ~0u)
+      mat->map_kd = stralloc(strings + materials[i].map_kd);
+  }
+  model->nummaterials = hdr.nummaterials;
+
+  model->clusters = (GLMcluster*)calloc(hdr.numclusters + 1,
+                                        sizeof(GLMcluster));
+  for (i = 0; i < hdr.numclusters; i++) {
+    GLMcluster* cluster = &model->clusters[i];
+
+    memcpy(cluster->center, clusters[i].center, sizeof(cluster->center));
+    memcpy(cluster->axis, clusters[i].axis, sizeof(cluster->axis));
+    cluster->radius     = clusters[i].radius;
+    cluster->coneCos    = clusters[i].coneCos;
+    cluster->coneSin    = clusters[i].coneSin;
+    cluster->material   = clusters[i].material;
+    cluster->firstIndex = clusters[i].firstIndex;
+    cluster->numIndices = clusters[i].numIndices;
+  }
+  model->numclusters = hdr.numclusters;
+
+  return model;
+
+invalid:
+  _glmUnmapFile(data, size, mapped);
+  return NULL;
+}
+
+
 void
 glmPrint(const GLMmodel *model)
 {
@@ -26,6 +26,16 @@ typedef unsigned int uint;
 #define GLM_COLOR    (1 << 3)		/* render with colors */
 #define GLM_MATERIAL (1 << 4)		/* render with materials */
 
+/* compact VBO layouts, for glmMakeVBOsCompact() */
+#define GLM_VBO_INDEX16  (1 << 0)	/* 16-bit indexes where they fit */
+#define GLM_VBO_NORMAL10 (1 << 1)	/* normals as INT_2_10_10_10_REV */
+#define GLM_VBO_TEXHALF  (1 << 2)	/* half float texcoords */
+#define GLM_VBO_POS16    (1 << 3)	/* 16-bit positions, scaled back */
+#define GLM_VBO_COMPACT  (GLM_VBO_INDEX16 | GLM_VBO_NORMAL10 | \
+                          GLM_VBO_TEXHALF | GLM_VBO_POS16)
+
+#define GLM_MAX_LODS 4			/* simplified levels, see glmMakeLODs() */
+
 
 /* structs */
 
@@ -64,10 +74,44 @@ typedef struct _GLMgroup {
   uint            material;           /* index to material for group */
   uint *          triIndexes;
   uint            minIndex, maxIndex;
+  uint            indexDataOffset;      /* offset into indexData, in bytes */
   uint            indexVboOffset;       /* offset into index VBO for elements */
+  uint            indexType;            /* GL type of the elements */
+  int             baseVertex;           /* added to the elements */
+  uint            lodTriangles[GLM_MAX_LODS];   /* of each simplified level */
+  uint            lodDataOffset[GLM_MAX_LODS];  /* into indexData, in bytes */
+  uint            lodVboOffset[GLM_MAX_LODS];   /* into the index VBO */
   struct _GLMgroup* next;		/* pointer to next group in model */
 } GLMgroup;
 
+/* GLMbatch: Structure that defines one multi-draw of the index ranges
+ * of a material, for glmDrawVBOBatched().
+ */
+typedef struct {
+  uint  material;			/* index to material */
+  uint  indexType;			/* GL type of the elements */
+  uint  numranges;
+  int*  counts;				/* elements of each range */
+  const void** offsets;			/* offset of each range in the VBO */
+  int*  baseVertex;			/* NULL if all 0 */
+} GLMbatch;
+
+/* GLMcluster: Structure that defines a cluster of nearby triangles of
+ * a group, for culling.  The triangles of a cluster are contiguous in
+ * the index data.
+ */
+typedef struct {
+  float center[3], radius;		/* bounding sphere */
+  float axis[3];			/* normal cone, all facet normals */
+  float coneCos, coneSin;		/* within it; coneCos <= 0 if none */
+  uint  material;			/* index to material */
+  uint  firstIndex;			/* first element in indexData */
+  uint  numIndices;
+  uint  indexVboOffset;			/* set by glmMakeVBOs() */
+  uint  indexType;
+  int   baseVertex;
+} GLMcluster;
+
 /* GLMmodel: Structure that defines a model.
  */
 typedef struct {
@@ -104,6 +148,33 @@ typedef struct {
   uint posOffset;   /* offset of position within vertex, in bytes */
   uint normOffset;   /* offset of normal within vertex, in bytes */
   uint texOffset;   /* offset of texcoord within vertex, in bytes */
+
+  uint vboStride;      /* bytes per vertex in the VBO */
+  uint vboPosOffset, vboNormOffset, vboTexOffset;  /* in bytes */
+  uint posType, normType, texType;  /* GL types of the VBO attributes */
+  float posScale[3], posBias[3];    /* positions = VBO value * scale + bias */
+
+  float* vertexData;  /* interleaved vertex data for the VBO */
+  uint*  indexData;   /* index data for the index VBO */
+  uint   numindices;
+
+  uint      numbatches;  /* draws of glmDrawVBOBatched() */
+  GLMbatch* batches;
+
+  uint        numclusters;  /* in index data order, see glmMakeClusters() */
+  GLMcluster* clusters;
+  GLMbatch    visible;      /* draws of glmDrawVBOCulled(), per frame */
+
+  uint  numlods;                  /* simplified levels, see glmMakeLODs() */
+  float lodError[GLM_MAX_LODS];   /* their largest vertex distance, in
+                                     model units, see glmMakeLODs() */
+  float lodCenter[3], lodRadius;  /* bounding sphere for choosing a level */
+  float lodPixels;                /* allowed error on screen, in pixels */
+  uint  lod;                      /* level drawn last, 0 = full detail */
+
+  void*  cacheData;   /* binary cache the above point into, if any */
+  unsigned long cacheSize;
+  int    cacheMapped;
 } GLMmodel;
 
 
@@ -211,6 +282,16 @@ glmDelete(GLMmodel* model);
 GLMmodel* 
 glmReadOBJ(char* filename);
 
+/* glmReadOBJThreads: Like glmReadOBJ(), but splits the file at line
+ * boundaries and parses the pieces in parallel.  The result is the same
+ * for any number of threads.
+ *
+ * filename   - name of the file containing the Wavefront .OBJ format data.
+ * numthreads - number of threads, 0 = one per CPU (for large files)
+ */
+GLMmodel* 
+glmReadOBJThreads(char* filename, uint numthreads);
+
 /* glmWriteOBJ: Writes a model description in Wavefront .OBJ format to
  * a file.
  *
@@ -268,12 +349,110 @@ glmWeld(GLMmodel* model, float epsilon);
 void
 glmReIndex(GLMmodel *model);
 
+/* glmOptimize: Reorders the index data of a model for the vertex
+ * cache, optionally also for less overdraw, and renumbers the vertices
+ * in the order they are used.  Doesn't change what is drawn.  Call it
+ * after glmReIndex() and before glmBuildVBOData().
+ *
+ * model    - initialized GLMmodel structure
+ * overdraw - also reorder to reduce overdraw
+ */
+void
+glmOptimize(GLMmodel* model, int overdraw);
+
+void
+glmBuildVBOData(GLMmodel *model);
+
+/* glmMakeClusters: Splits each group into clusters of up to
+ * maxtriangles nearby triangles, reordering the group's indexes so
+ * each cluster is contiguous, and computes the bounding sphere and
+ * normal cone of each cluster for glmDrawVBOCulled().  Call it after
+ * glmBuildVBOData() and before glmWriteCache()/glmMakeVBOs().
+ *
+ * model        - initialized GLMmodel structure
+ * maxtriangles - most triangles in a cluster (e.g. 128)
+ */
+void
+glmMakeClusters(GLMmodel* model, uint maxtriangles);
+
+/* glmMakeLODs: Makes up to GLM_MAX_LODS simplified levels of detail
+ * of a model, each with about half the triangles of the one before,
+ * by collapsing edges in the order of least quadric error.  Vertices
+ * on group boundaries, open borders and attribute (UV or normal) seams
+ * are kept, so the levels only index the model's vertex data.  The
+ * draw functions pick the coarsest level whose error is at most
+ * model->lodPixels on screen.  Call it after glmBuildVBOData() and
+ * before glmWriteCache()/glmMakeVBOs().
+ *
+ * model   - initialized GLMmodel structure
+ * numlods - number of levels wanted
+ */
+void
+glmMakeLODs(GLMmodel* model, uint numlods);
+
 void
 glmMakeVBOs(GLMmodel *model);
 
+/* glmMakeVBOsCompact: Like glmMakeVBOs(), but stores the data in less
+ * space where the GL supports it.  Positions quantized to 16 bits are
+ * accurate to 1/65534 of the model's size on each axis.
+ *
+ * model - initialized GLMmodel structure
+ * flags - a bitwise OR of
+ *         GLM_VBO_INDEX16  - 16-bit indexes for groups whose range fits
+ *         GLM_VBO_NORMAL10 - normals packed in 32 bits
+ *         GLM_VBO_TEXHALF  - half float texcoords
+ *         GLM_VBO_POS16    - 16-bit positions
+ *         GLM_VBO_COMPACT  - all of the above
+ */
+void
+glmMakeVBOsCompact(GLMmodel *model, uint flags);
+
+/* glmWriteCache: Writes the vertex/index data, groups, materials and
+ * clusters of a model to a binary cache next to its .obj file (<file>.glmc).
+ *
+ * model - initialized GLMmodel structure, after glmReIndex()
+ */
+void
+glmWriteCache(GLMmodel* model);
+
+/* glmReadCache: Loads a model from the binary cache of a .obj file if
+ * the cache is up to date (same size, mtime and hash of the .obj file and
+ * its material library), else returns NULL.  The vertex/index data are
+ * used in place from the mapped cache, so the model can only be drawn
+ * with glmMakeVBOs()/glmDrawVBO().
+ *
+ * filename - name of the .obj file
+ */
+GLMmodel*
+glmReadCache(char* filename);
+
 void
 glmDrawVBO(GLMmodel *model);
 
+/* glmDrawVBOBatched: Like glmDrawVBO(), but draws all the groups of a
+ * material at once, with one multi-draw per material (and index type)
+ * instead of one draw per group.
+ *
+ * model - initialized GLMmodel structure, after glmMakeVBOs()
+ */
+void
+glmDrawVBOBatched(GLMmodel *model);
+
+/* glmDrawVBOCulled: Only draws the clusters that are in the view
+ * frustum of the current modelview and projection matrices, and, if
+ * back faces are culled, that have some triangle facing the eye.
+ * Assumes a perspective projection.  Returns the number of triangles
+ * drawn.
+ *
+ * model   - initialized GLMmodel structure, after glmMakeClusters() and
+ *           glmMakeVBOs()
+ * batched - draw the visible clusters of a material with one multi-draw
+ *           like glmDrawVBOBatched(), else one draw per cluster
+ */
+uint
+glmDrawVBOCulled(GLMmodel *model, int batched);
+
 void
 glmPrint(const GLMmodel *model);
 
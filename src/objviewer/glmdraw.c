@@ -3,6 +3,7 @@
 #define GL_GLEXT_PROTOTYPES
 
 #include <assert.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,6 +16,9 @@
 /* defines */
 #define T(x) model->triangles[(x)]
 
+/* vertex attribute of the normals in glmDrawVBO() */
+#define GLM_NORMAL_ATTRIB 2
+
 
 /* glmDraw: Renders the model to the current OpenGL context using the
  * mode specified.
@@ -154,90 +158,433 @@ glmDraw(GLMmodel* model, GLuint mode)
 void
 glmMakeVBOs(GLMmodel *model)
 {
-   uint bytes, vertexFloats, i;
-   float *buffer;
-   GLMgroup* group;
-   unsigned totalIndexes;
-   GLubyte *ibuffer, *ib;
+   glmMakeVBOsCompact(model, 0);
+}
+
+
+/* _glmFloatToHalf: convert a float to a half float, rounding to
+ * nearest.
+ */
+static GLushort
+_glmFloatToHalf(float f)
+{
+   union { float f; GLuint u; } v;
+   GLuint sign, exp, mant, h;
+
+   v.f = f;
+   sign = (v.u >> 16) & 0x8000;
+   exp = (v.u >> 23) & 0xff;
+   mant = v.u & 0x7fffff;
+
+   if (exp == 0xff)                     /* inf or nan */
+      return sign | 0x7c00 | (mant ? 0x200 : 0);
+   if (exp < 103)                       /* below half of the smallest denorm */
+      return sign;
+   if (exp < 113) {                     /* denorm */
+      GLuint shift = 126 - exp;
+      mant |= 0x800000;
+      return sign | ((mant + (1 << (shift - 1))) >> shift);
+   }
+
+   h = ((((exp - 112) << 23) | mant) + 0x1000) >> 13;
+   if (h >= 0x7c00)                     /* overflow */
+      h = 0x7c00;
+   return sign | h;
+}
+
+
+/* _glmQuantize: round f * max to the nearest integer in [-max, max].
+ */
+static int
+_glmQuantize(float f, float max)
+{
+   float c = f * max;
+
+   c = c > max ? max : (c < -max ? -max : c);
+   return (int) (c < 0.0f ? c - 0.5f : c + 0.5f);
+}
+
+
+static int
+_glmGroupOffsetCompare(const void *a, const void *b)
+{
+   const GLMgroup *ga = *(const GLMgroup **) a;
+   const GLMgroup *gb = *(const GLMgroup **) b;
+
+   return ga->indexDataOffset < gb->indexDataOffset ? -1 :
+      (ga->indexDataOffset > gb->indexDataOffset);
+}
+
+
+/* _glmGroupsInDataOrder: the groups of a model in the order of their
+ * indexes in indexData, which is by material.  The return value
+ * should be free'd.
+ */
+static GLMgroup **
+_glmGroupsInDataOrder(GLMmodel *model)
+{
+   GLMgroup **groups, *group;
+   uint n = 0;
+
+   groups = (GLMgroup **) malloc(sizeof(GLMgroup *) * (model->numgroups + 1));
+   for (group = model->groups; group; group = group->next)
+      groups[n++] = group;
+   assert(n == model->numgroups);
+   qsort(groups, n, sizeof(GLMgroup *), _glmGroupOffsetCompare);
+   return groups;
+}
+
+
+/* _glmMakeBatches: make the multi-draws of glmDrawVBOBatched(), one per
+ * material and index type, merging the index ranges of groups that
+ * follow each other in the index VBO.
+ *
+ * groups - the groups, in index VBO order
+ */
+static void
+_glmMakeBatches(GLMmodel *model, GLMgroup **groups)
+{
+   GLMbatch *batch = NULL;
+   uint g, b, draws = 0, ranges = 0;
+
+   for (b = 0; b < model->numbatches; b++) {
+      free(model->batches[b].counts);
+      free((void *) model->batches[b].offsets);
+      free(model->batches[b].baseVertex);
+   }
+   free(model->batches);
+   model->batches = (GLMbatch *) calloc(model->numgroups + 1,
+                                        sizeof(GLMbatch));
+   model->numbatches = 0;
+
+   for (g = 0; g < model->numgroups; g++) {
+      GLMgroup *group = groups[g];
+      const uint size = group->indexType == GL_UNSIGNED_INT ? 4 : 2;
+      uint r;
+
+      if (group->numtriangles == 0)
+         continue;
+      draws++;
+
+      if (!batch || batch->material != group->material ||
+          batch->indexType != group->indexType) {
+         batch = &model->batches[model->numbatches++];
+         batch->material = group->material;
+         batch->indexType = group->indexType;
+      }
+
+      /* extend the last range if this one follows it directly */
+      r = batch->numranges;
+      if (r > 0 &&
+          (size_t) batch->offsets[r - 1] + batch->counts[r - 1] * size ==
+          group->indexVboOffset &&
+          (batch->baseVertex ? batch->baseVertex[r - 1] : 0) ==
+          group->baseVertex) {
+         batch->counts[r - 1] += 3 * group->numtriangles;
+         continue;
+      }
+
+      /* grow the arrays at powers of two */
+      if ((r & (r - 1)) == 0) {
+         const uint cap = r ? 2 * r : 1;
+         batch->counts = (int *) realloc(batch->counts, cap * sizeof(int));
+         batch->offsets = (const void **)
+            realloc((void *) batch->offsets, cap * sizeof(void *));
+         if (batch->baseVertex)
+            batch->baseVertex = (int *) realloc(batch->baseVertex,
+                                                cap * sizeof(int));
+      }
+      if (group->baseVertex && !batch->baseVertex) {
+         const uint cap = r ? 2 * r : 1;
+         batch->baseVertex = (int *) calloc(cap, sizeof(int));
+      }
+      batch->counts[r] = 3 * group->numtriangles;
+      batch->offsets[r] = (const void *) (GLintptr) group->indexVboOffset;
+      if (batch->baseVertex)
+         batch->baseVertex[r] = group->baseVertex;
+      batch->numranges++;
+      ranges++;
+   }
+
+   printf("glmMakeVBOs(): %u draws, batched: %u multi-draws of %u ranges\n",
+          draws, model->numbatches, ranges);
+}
+
+
+/* _glmPlaceClusters: find where the clusters' indexes went in the
+ * index VBO, and make room for the draws of glmDrawVBOCulled().
+ *
+ * groups - the groups, in index VBO order
+ */
+static void
+_glmPlaceClusters(GLMmodel *model, GLMgroup **groups)
+{
+   GLMbatch *visible = &model->visible;
+   uint c, g = 0;
+
+   for (c = 0; c < model->numclusters; c++) {
+      GLMcluster *cluster = &model->clusters[c];
+      const uint offset = cluster->firstIndex * sizeof(GLuint);
+      GLMgroup *group;
+
+      /* both are in index data order */
+      while (groups[g]->indexDataOffset +
+             3 * groups[g]->numtriangles * sizeof(GLuint) <= offset)
+         g++;
+      group = groups[g];
+      assert(g < model->numgroups && group->indexDataOffset <= offset);
+
+      cluster->indexType = group->indexType;
+      cluster->baseVertex = group->baseVertex;
+      cluster->indexVboOffset = group->indexVboOffset +
+         (offset - group->indexDataOffset) / sizeof(GLuint) *
+         (group->indexType == GL_UNSIGNED_INT ? 4 : 2);
+   }
+
+   free(visible->counts);
+   free((void *) visible->offsets);
+   free(visible->baseVertex);
+   visible->counts = (int *) malloc((model->numclusters + 1) * sizeof(int));
+   visible->offsets = (const void **)
+      malloc((model->numclusters + 1) * sizeof(void *));
+   visible->baseVertex = (int *) malloc((model->numclusters + 1) *
+                                        sizeof(int));
+   visible->numranges = 0;
+}
+
+
+/* _glmCopyIndexes: copy n of a group's indexes from indexData to an
+ * index buffer, in the group's index type.
+ *
+ * offset - offset of the indexes in indexData, in bytes
+ */
+static void
+_glmCopyIndexes(const GLMmodel *model, const GLMgroup *group, GLubyte *dst,
+                uint offset, uint n)
+{
+   const GLuint *src = model->indexData + offset / sizeof(GLuint);
+   uint i;
+
+   if (group->indexType == GL_UNSIGNED_SHORT) {
+      GLushort *dst16 = (GLushort *) dst;
+      for (i = 0; i < n; i++)
+         dst16[i] = (GLushort) (src[i] - group->baseVertex);
+   }
+   else {
+      memcpy(dst, src, n * sizeof(GLuint));
+   }
+}
+
+
+/* glmMakeVBOsCompact: upload the vertex and index data made by
+ * glmBuildVBOData(), converted to the layout asked for where the GL
+ * supports it.  Without any flags the data is uploaded as it is.
+ */
+void
+glmMakeVBOsCompact(GLMmodel *model, uint flags)
+{
+   const GLboolean normal10 = (flags & GLM_VBO_NORMAL10) &&
+      (GLEW_VERSION_3_3 || GLEW_ARB_vertex_type_2_10_10_10_rev);
+   const GLboolean texHalf = (flags & GLM_VBO_TEXHALF) &&
+      (GLEW_VERSION_3_0 || GLEW_ARB_half_float_vertex);
+   const GLboolean pos16 = (flags & GLM_VBO_POS16) != 0;
+   const GLboolean baseVertex =
+      GLEW_VERSION_3_2 || GLEW_ARB_draw_elements_base_vertex;
+   const uint floatStride = model->vertexSize * sizeof(float);
+   const uint numverts = model->numvertices + 1;
+   GLubyte *vbuf = NULL, *ibuf = NULL;
+   const void *vdata, *idata;
+   GLsizeiptr vbytes, ibytes;
+   GLMgroup *group, **groups;
+   uint i, c, g, l;
+
+   glmBuildVBOData(model);
+   vdata = model->vertexData;
+   idata = model->indexData;
 
    /*
-    * Vertex data
+    * Vertex layout
     */
-   vertexFloats = 3;
-   model->posOffset = 0;
-
+   model->posType = pos16 ? GL_SHORT : GL_FLOAT;
+   model->vboPosOffset = 0;
+   model->vboStride = pos16 ? 4 * sizeof(GLshort) : 3 * sizeof(GLfloat);
+   model->normType = GL_FLOAT;
    if (model->numnormals > 0) {
-      assert(model->numnormals == model->numvertices);
-      model->normOffset = vertexFloats * sizeof(GLfloat);
-      vertexFloats += 3;
-   }      
-
+      model->vboNormOffset = model->vboStride;
+      if (flags & GLM_VBO_NORMAL10) {
+         /* fall back to signed bytes without 2_10_10_10 support */
+         model->normType = normal10 ? GL_INT_2_10_10_10_REV : GL_BYTE;
+         model->vboStride += 4;
+      }
+      else {
+         model->vboStride += 3 * sizeof(GLfloat);
+      }
+   }
+   model->texType = texHalf ? GL_HALF_FLOAT : GL_FLOAT;
    if (model->numtexcoords > 0) {
-      assert(model->numtexcoords == model->numvertices);
-      model->texOffset = vertexFloats * sizeof(GLfloat);
-      vertexFloats += 2;
-   }
-
-   model->vertexSize = vertexFloats;
-
-   bytes = (model->numvertices + 1) * vertexFloats * sizeof(float);
-
-   buffer = (float *) malloc(bytes);
-   for (i = 0; i < model->numvertices; i++) {
-      /* copy vertex pos */
-      uint j = 0;
-      buffer[i * vertexFloats + j++] = model->vertices[i * 3 + 0];
-      buffer[i * vertexFloats + j++] = model->vertices[i * 3 + 1];
-      buffer[i * vertexFloats + j++] = model->vertices[i * 3 + 2];
-      if (model->numnormals > 0) {
-         buffer[i * vertexFloats + j++] = model->normals[i * 3 + 0];
-         buffer[i * vertexFloats + j++] = model->normals[i * 3 + 1];
-         buffer[i * vertexFloats + j++] = model->normals[i * 3 + 2];
+      model->vboTexOffset = model->vboStride;
+      model->vboStride += texHalf ? 2 * sizeof(GLushort) : 2 * sizeof(GLfloat);
+   }
+
+   for (c = 0; c < 3; c++) {
+      model->posScale[c] = 1.0;
+      model->posBias[c] = 0.0;
+   }
+
+   vbytes = (GLsizeiptr) numverts * model->vboStride;
+
+   if (pos16 && numverts > 1) {
+      float lo[3], hi[3], extent;
+
+      /* bounds of the positions, for quantizing */
+      for (c = 0; c < 3; c++)
+         lo[c] = hi[c] = model->vertexData[model->vertexSize + c];
+      for (i = 2; i < numverts; i++) {
+         const float *v = model->vertexData + i * model->vertexSize;
+         for (c = 0; c < 3; c++) {
+            if (v[c] < lo[c]) lo[c] = v[c];
+            if (v[c] > hi[c]) hi[c] = v[c];
+         }
       }
-      if (model->numtexcoords > 0) {
-         buffer[i * vertexFloats + j++] = model->texcoords[i * 2 + 0];
-         buffer[i * vertexFloats + j++] = model->texcoords[i * 2 + 1];
+      /* the same scale on all axes, so it doesn't change the
+         direction of the normals */
+      extent = 0.0f;
+      for (c = 0; c < 3; c++) {
+         model->posBias[c] = 0.5f * (lo[c] + hi[c]);
+         if (hi[c] - lo[c] > extent)
+            extent = hi[c] - lo[c];
+      }
+      if (extent > 0.0f) {
+         for (c = 0; c < 3; c++)
+            model->posScale[c] = 0.5f * extent / 32767.0f;
       }
    }
 
-   glGenBuffersARB(1, &model->vbo);
-   glBindBufferARB(GL_ARRAY_BUFFER_ARB, model->vbo);
-   glBufferDataARB(GL_ARRAY_BUFFER_ARB, bytes, buffer, GL_STATIC_DRAW_ARB);
-   glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+   if (model->vboStride != floatStride || pos16) {
+
+      vbuf = (GLubyte *) calloc(1, vbytes);
+      for (i = 1; i < numverts; i++) {
+         const float *src = model->vertexData + i * model->vertexSize;
+         GLubyte *dst = vbuf + i * model->vboStride;
+
+         if (pos16) {
+            GLshort *p = (GLshort *) dst;
+            for (c = 0; c < 3; c++)
+               p[c] = _glmQuantize((src[c] - model->posBias[c]) /
+                                   (model->posScale[c] * 32767.0f), 32767.0f);
+         }
+         else {
+            memcpy(dst, src, 3 * sizeof(float));
+         }
+
+         if (model->numnormals > 0) {
+            const float *n = src + model->normOffset / sizeof(float);
+            if (model->normType == GL_INT_2_10_10_10_REV) {
+               GLuint *p = (GLuint *) (dst + model->vboNormOffset);
+               *p = ((_glmQuantize(n[0], 511.0f) & 0x3ff) |
+                     (_glmQuantize(n[1], 511.0f) & 0x3ff) << 10 |
+                     (_glmQuantize(n[2], 511.0f) & 0x3ff) << 20);
+            }
+            else if (model->normType == GL_BYTE) {
+               GLbyte *p = (GLbyte *) (dst + model->vboNormOffset);
+               for (c = 0; c < 3; c++)
+                  p[c] = _glmQuantize(n[c], 127.0f);
+            }
+            else {
+               memcpy(dst + model->vboNormOffset, n, 3 * sizeof(float));
+            }
+         }
 
-   free(buffer);
+         if (model->numtexcoords > 0) {
+            const float *t = src + model->texOffset / sizeof(float);
+            if (texHalf) {
+               GLushort *h = (GLushort *) (dst + model->vboTexOffset);
+               h[0] = _glmFloatToHalf(t[0]);
+               h[1] = _glmFloatToHalf(t[1]);
+            }
+            else {
+               memcpy(dst + model->vboTexOffset, t, 2 * sizeof(float));
+            }
+         }
+      }
+      vdata = vbuf;
+   }
 
    /*
-    * Index data
+    * Index layout: 16-bit indexes for groups whose range fits, relative
+    * to the group's first vertex if base vertex drawing is supported.
+    * Each group starts at a multiple of its index size.
     */
-   totalIndexes = 0;
-   for (group = model->groups; group; group = group->next) {
-      if (group->numtriangles > 0) {
-         totalIndexes += 3 * group->numtriangles;
+   groups = _glmGroupsInDataOrder(model);
+   ibytes = 0;
+   for (g = 0; g < model->numgroups; g++) {
+      group = groups[g];
+      group->indexType = GL_UNSIGNED_INT;
+      group->baseVertex = 0;
+      if ((flags & GLM_VBO_INDEX16) && group->numtriangles > 0) {
+         if (group->maxIndex <= 0xffff) {
+            group->indexType = GL_UNSIGNED_SHORT;
+         }
+         else if (baseVertex && group->maxIndex - group->minIndex <= 0xffff) {
+            group->indexType = GL_UNSIGNED_SHORT;
+            group->baseVertex = group->minIndex;
+         }
+      }
+      if (group->indexType == GL_UNSIGNED_INT)
+         ibytes = (ibytes + 3) & ~3;
+      group->indexVboOffset = ibytes;
+      ibytes += 3 * group->numtriangles *
+         (group->indexType == GL_UNSIGNED_INT ? 4 : 2);
+   }
+   /* then the levels of detail, in the same order as in indexData */
+   for (l = 0; l < model->numlods; l++) {
+      for (g = 0; g < model->numgroups; g++) {
+         group = groups[g];
+         if (group->indexType == GL_UNSIGNED_INT)
+            ibytes = (ibytes + 3) & ~3;
+         group->lodVboOffset[l] = ibytes;
+         ibytes += 3 * group->lodTriangles[l] *
+            (group->indexType == GL_UNSIGNED_INT ? 4 : 2);
       }
    }
 
-   glGenBuffersARB(1, &model->index_vbo);
-   glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, model->index_vbo);
-   glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, totalIndexes * sizeof(GLuint),
-                   NULL, GL_STATIC_DRAW_ARB);
-   ibuffer = (GLubyte *) glMapBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB,
-                                        GL_WRITE_ONLY);
-   ib = ibuffer;
-
-   for (group = model->groups; group; group = group->next) {
-      if (group->numtriangles > 0) {
-         int bytes = 3 * group->numtriangles * sizeof(uint);
-         memcpy(ib, group->triIndexes, bytes);
-         totalIndexes += 3 * group->numtriangles;
-         group->indexVboOffset = ib - ibuffer;
-         ib += bytes;
+   if (ibytes != (GLsizeiptr) (model->numindices * sizeof(GLuint))) {
+      ibuf = (GLubyte *) malloc(ibytes + 1);
+      for (group = model->groups; group; group = group->next) {
+         _glmCopyIndexes(model, group, ibuf + group->indexVboOffset,
+                         group->indexDataOffset, 3 * group->numtriangles);
+         for (l = 0; l < model->numlods; l++)
+            _glmCopyIndexes(model, group, ibuf + group->lodVboOffset[l],
+                            group->lodDataOffset[l],
+                            3 * group->lodTriangles[l]);
       }
+      idata = ibuf;
+   }
+
+   _glmMakeBatches(model, groups);
+   _glmPlaceClusters(model, groups);
+   free(groups);
+
+   if (flags) {
+      printf("glmMakeVBOsCompact(): %u -> %u bytes/vertex, "
+             "%u -> %u index bytes\n",
+             floatStride, model->vboStride,
+             (uint) (model->numindices * sizeof(GLuint)), (uint) ibytes);
    }
 
-   glUnmapBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB);
+   glGenBuffersARB(1, &model->vbo);
+   glBindBufferARB(GL_ARRAY_BUFFER_ARB, model->vbo);
+   glBufferDataARB(GL_ARRAY_BUFFER_ARB, vbytes, vdata, GL_STATIC_DRAW_ARB);
+   glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
 
+   glGenBuffersARB(1, &model->index_vbo);
+   glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, model->index_vbo);
+   glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, ibytes, idata,
+                   GL_STATIC_DRAW_ARB);
    glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+
+   free(vbuf);
+   free(ibuf);
 }
 
 
@@ -286,29 +633,33 @@ glmLoadTextures(GLMmodel *model)
 }
 
 
-void
-glmDrawVBO(GLMmodel *model)
+/* _glmBeginDrawVBO: set up the vertex arrays and transformation for
+ * drawing from the VBOs.
+ */
+static void
+_glmBeginDrawVBO(GLMmodel *model)
 {
-   GLMgroup* group;
-   uint prevMaterial = ~0;
-
    assert(model->vbo);
 
    glBindBufferARB(GL_ARRAY_BUFFER_ARB, model->vbo);
 
-   glVertexPointer(3, GL_FLOAT, model->vertexSize * sizeof(float),
-                   (const void *) (size_t) model->posOffset);
+   glVertexPointer(3, model->posType, model->vboStride,
+                   (const void *) (size_t) model->vboPosOffset);
    glEnableClientState(GL_VERTEX_ARRAY);
 
    if (model->numnormals > 0) {
-      glNormalPointer(GL_FLOAT, model->vertexSize * sizeof(float),
-                      (const void *) (size_t) model->normOffset);
-      glEnableClientState(GL_NORMAL_ARRAY);
+      /* a generic attribute, since packed normals can't be given to
+         glNormalPointer() everywhere */
+      glVertexAttribPointer(GLM_NORMAL_ATTRIB,
+                            model->normType == GL_INT_2_10_10_10_REV ? 4 : 3,
+                            model->normType, GL_TRUE, model->vboStride,
+                            (const void *) (size_t) model->vboNormOffset);
+      glEnableVertexAttribArray(GLM_NORMAL_ATTRIB);
    }
 
    if (model->numtexcoords > 0) {
-      glTexCoordPointer(2, GL_FLOAT, model->vertexSize * sizeof(float),
-                        (const void *) (size_t) model->texOffset);
+      glTexCoordPointer(2, model->texType, model->vboStride,
+                        (const void *) (size_t) model->vboTexOffset);
       glEnableClientState(GL_TEXTURE_COORD_ARRAY);
    }
 
@@ -317,33 +668,386 @@ glmDrawVBO(GLMmodel *model)
    glPushMatrix();
    glTranslatef(model->position[0], model->position[1], model->position[2]);
    glScalef(model->scale, model->scale, model->scale);
+   /* undo the quantization of the positions */
+   glTranslatef(model->posBias[0], model->posBias[1], model->posBias[2]);
+   glScalef(model->posScale[0], model->posScale[1], model->posScale[2]);
+}
+
+
+static void
+_glmEndDrawVBO(void)
+{
+   glPopMatrix();
+
+   glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+   glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+   glDisableClientState(GL_VERTEX_ARRAY);
+   glDisableVertexAttribArray(GLM_NORMAL_ATTRIB);
+   glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+}
+
+
+/* _glmSelectLOD: the coarsest level of detail of a model whose error
+ * is at most model->lodPixels on screen at the nearest point of the
+ * model, with the current matrices and viewport.  0 is full detail.
+ */
+static uint
+_glmSelectLOD(const GLMmodel *model)
+{
+   GLfloat mv[16], proj[16], p[3], c[3], scale, dist, pixels;
+   GLint viewport[4];
+   uint i, l;
+
+   if (model->numlods == 0 || model->lodPixels < 0.0)
+      return 0;
+
+   glGetFloatv(GL_MODELVIEW_MATRIX, mv);
+   glGetFloatv(GL_PROJECTION_MATRIX, proj);
+   glGetIntegerv(GL_VIEWPORT, viewport);
+
+   /* the bounding sphere in eye space */
+   for (i = 0; i < 3; i++)
+      p[i] = model->position[i] + model->scale * model->lodCenter[i];
+   for (i = 0; i < 3; i++)
+      c[i] = mv[i] * p[0] + mv[4 + i] * p[1] + mv[8 + i] * p[2] + mv[12 + i];
+   scale = model->scale * sqrt(mv[0] * mv[0] + mv[1] * mv[1] + mv[2] * mv[2]);
+
+   /* pixels per eye space unit at the nearest point */
+   pixels = 0.5 * proj[5] * viewport[3];
+   if (proj[15] == 0.0) {
+      dist = -c[2] - model->lodRadius * scale;
+      if (dist <= 0.0)
+         return 0;
+      pixels /= dist;
+   }
+
+   for (l = model->numlods; l > 0; l--) {
+      if (model->lodError[l - 1] * scale * pixels <= model->lodPixels)
+         return l;
+   }
+   return 0;
+}
+
+
+/* _glmDrawGroups: draw the groups one by one, at a level of detail.
+ */
+static uint
+_glmDrawGroups(GLMmodel *model, uint lod)
+{
+   GLMgroup* group;
+   uint prevMaterial = ~0;
+   uint drawn = 0;
 
    for (group = model->groups; group; group = group->next) {
-      if (group->numtriangles > 0) {
+      const uint numtriangles =
+         lod ? group->lodTriangles[lod - 1] : group->numtriangles;
+      const GLintptr offset =
+         lod ? group->lodVboOffset[lod - 1] : group->indexVboOffset;
+
+      if (numtriangles > 0) {
 
          if (group->material != prevMaterial) {
             glmShaderMaterial(&model->materials[group->material]);
             prevMaterial = group->material;
          }
 
-         glDrawRangeElements(GL_TRIANGLES,
-                             group->minIndex, group->maxIndex,
-                             3 * group->numtriangles,
-                             GL_UNSIGNED_INT,
-                             (void *) (GLintptr) group->indexVboOffset);
+         if (group->baseVertex)
+            glDrawRangeElementsBaseVertex(GL_TRIANGLES,
+                                          group->minIndex - group->baseVertex,
+                                          group->maxIndex - group->baseVertex,
+                                          3 * numtriangles,
+                                          group->indexType,
+                                          (void *) offset,
+                                          group->baseVertex);
+         else
+            glDrawRangeElements(GL_TRIANGLES,
+                                group->minIndex, group->maxIndex,
+                                3 * numtriangles,
+                                group->indexType,
+                                (void *) offset);
+         drawn += numtriangles;
       }
    }
+   return drawn;
+}
 
-   glPopMatrix();
 
-   glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
-   glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
-   glDisableClientState(GL_VERTEX_ARRAY);
-   glDisableClientState(GL_NORMAL_ARRAY);
-   glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+void
+glmDrawVBO(GLMmodel *model)
+{
+   model->lod = _glmSelectLOD(model);
+
+   _glmBeginDrawVBO(model);
+   _glmDrawGroups(model, model->lod);
+   _glmEndDrawVBO();
 }
 
 
+void
+glmDrawVBOBatched(GLMmodel *model)
+{
+   uint prevMaterial = ~0;
+   uint b, r;
+
+   /* the levels of detail are drawn by group */
+   model->lod = _glmSelectLOD(model);
+   if (model->lod > 0) {
+      _glmBeginDrawVBO(model);
+      _glmDrawGroups(model, model->lod);
+      _glmEndDrawVBO();
+      return;
+   }
+
+   _glmBeginDrawVBO(model);
+
+   for (b = 0; b < model->numbatches; b++) {
+      const GLMbatch *batch = &model->batches[b];
+
+      if (batch->material != prevMaterial) {
+         glmShaderMaterial(&model->materials[batch->material]);
+         prevMaterial = batch->material;
+      }
+
+      if (batch->baseVertex) {
+         glMultiDrawElementsBaseVertex(GL_TRIANGLES, batch->counts,
+                                       batch->indexType, batch->offsets,
+                                       batch->numranges, batch->baseVertex);
+      }
+      else if (GLEW_VERSION_1_4) {
+         glMultiDrawElements(GL_TRIANGLES, batch->counts, batch->indexType,
+                             batch->offsets, batch->numranges);
+      }
+      else {
+         for (r = 0; r < batch->numranges; r++)
+            glDrawElements(GL_TRIANGLES, batch->counts[r], batch->indexType,
+                           batch->offsets[r]);
+      }
+   }
+
+   _glmEndDrawVBO();
+}
+
+
+
+/* _glmFlushVisible: draw the ranges gathered in model->visible.
+ */
+static void
+_glmFlushVisible(GLMmodel *model)
+{
+   GLMbatch *visible = &model->visible;
+   uint r;
+
+   if (visible->numranges == 0)
+      return;
+
+   if (visible->numranges == 1) {
+      if (visible->baseVertex[0])
+         glDrawElementsBaseVertex(GL_TRIANGLES, visible->counts[0],
+                                  visible->indexType, visible->offsets[0],
+                                  visible->baseVertex[0]);
+      else
+         glDrawElements(GL_TRIANGLES, visible->counts[0], visible->indexType,
+                        visible->offsets[0]);
+   }
+   else if (GLEW_VERSION_3_2 || GLEW_ARB_draw_elements_base_vertex) {
+      glMultiDrawElementsBaseVertex(GL_TRIANGLES, visible->counts,
+                                    visible->indexType, visible->offsets,
+                                    visible->numranges, visible->baseVertex);
+   }
+   else if (GLEW_VERSION_1_4) {
+      /* no base vertex is needed without the extension */
+      glMultiDrawElements(GL_TRIANGLES, visible->counts, visible->indexType,
+                          visible->offsets, visible->numranges);
+   }
+   else {
+      for (r = 0; r < visible->numranges; r++)
+         glDrawElements(GL_TRIANGLES, visible->counts[r], visible->indexType,
+                        visible->offsets[r]);
+   }
+   visible->numranges = 0;
+}
+
+
+/* _glmInvertAffine: invert a 4x4 column-major matrix whose last row is
+ * 0 0 0 1.  Returns GL_FALSE if it's singular.
+ */
+static GLboolean
+_glmInvertAffine(const GLfloat m[16], GLfloat inv[16])
+{
+   GLfloat det;
+   uint i;
+
+   inv[0] = m[5] * m[10] - m[6] * m[9];
+   inv[1] = m[2] * m[9] - m[1] * m[10];
+   inv[2] = m[1] * m[6] - m[2] * m[5];
+   inv[4] = m[6] * m[8] - m[4] * m[10];
+   inv[5] = m[0] * m[10] - m[2] * m[8];
+   inv[6] = m[2] * m[4] - m[0] * m[6];
+   inv[8] = m[4] * m[9] - m[5] * m[8];
+   inv[9] = m[1] * m[8] - m[0] * m[9];
+   inv[10] = m[0] * m[5] - m[1] * m[4];
+
+   det = m[0] * inv[0] + m[4] * inv[1] + m[8] * inv[2];
+   if (det == 0.0)
+      return GL_FALSE;
+   for (i = 0; i < 11; i++)
+      inv[i] /= det;
+
+   inv[12] = -(inv[0] * m[12] + inv[4] * m[13] + inv[8] * m[14]);
+   inv[13] = -(inv[1] * m[12] + inv[5] * m[13] + inv[9] * m[14]);
+   inv[14] = -(inv[2] * m[12] + inv[6] * m[13] + inv[10] * m[14]);
+   inv[3] = inv[7] = inv[11] = 0.0;
+   inv[15] = 1.0;
+   return GL_TRUE;
+}
+
+
+uint
+glmDrawVBOCulled(GLMmodel *model, int batched)
+{
+   GLMbatch *visible = &model->visible;
+   GLfloat mv[16], proj[16], inv[16], clip[16], planes[6][4], eye[3];
+   GLboolean cone;
+   GLfloat coneSign = 1.0;
+   uint prevMaterial = ~0;
+   uint drawn = 0;
+   uint c, i, j;
+
+   /* a coarser level of detail is only used far away, where most of
+      the model is on screen anyway */
+   model->lod = _glmSelectLOD(model);
+   if (model->lod > 0) {
+      _glmBeginDrawVBO(model);
+      drawn = _glmDrawGroups(model, model->lod);
+      _glmEndDrawVBO();
+      return drawn;
+   }
+
+   /* the clusters are in the space of the model's vertices */
+   glPushMatrix();
+   glTranslatef(model->position[0], model->position[1], model->position[2]);
+   glScalef(model->scale, model->scale, model->scale);
+   glGetFloatv(GL_MODELVIEW_MATRIX, mv);
+   glPopMatrix();
+   glGetFloatv(GL_PROJECTION_MATRIX, proj);
+
+   /* frustum planes from the rows of proj * mv, inside where >= 0 */
+   for (i = 0; i < 4; i++) {
+      for (j = 0; j < 4; j++) {
+         clip[i * 4 + j] = proj[j] * mv[i * 4 + 0] +
+                           proj[4 + j] * mv[i * 4 + 1] +
+                           proj[8 + j] * mv[i * 4 + 2] +
+                           proj[12 + j] * mv[i * 4 + 3];
+      }
+   }
+   for (i = 0; i < 6; i++) {
+      const GLfloat sign = (i & 1) ? -1.0 : 1.0;
+      GLfloat len;
+
+      for (j = 0; j < 4; j++)
+         planes[i][j] = clip[j * 4 + 3] + sign * clip[j * 4 + i / 2];
+      len = sqrt(planes[i][0] * planes[i][0] + planes[i][1] * planes[i][1] +
+                 planes[i][2] * planes[i][2]);
+      if (len > 0.0) {
+         for (j = 0; j < 4; j++)
+            planes[i][j] /= len;
+      }
+   }
+
+   /* back facing clusters can be skipped if back faces are culled */
+   cone = glIsEnabled(GL_CULL_FACE) && _glmInvertAffine(mv, inv);
+   if (cone) {
+      GLint mode, front;
+
+      glGetIntegerv(GL_CULL_FACE_MODE, &mode);
+      glGetIntegerv(GL_FRONT_FACE, &front);
+      if (mode == GL_FRONT_AND_BACK)
+         cone = GL_FALSE;
+      if ((mode == GL_FRONT) != (front == GL_CW))
+         coneSign = -1.0;
+      /* the winding flips in a mirroring transform */
+      if (inv[0] * (inv[5] * inv[10] - inv[6] * inv[9]) -
+          inv[4] * (inv[1] * inv[10] - inv[2] * inv[9]) +
+          inv[8] * (inv[1] * inv[6] - inv[2] * inv[5]) < 0.0)
+         coneSign = -coneSign;
+      eye[0] = inv[12];
+      eye[1] = inv[13];
+      eye[2] = inv[14];
+   }
+
+   _glmBeginDrawVBO(model);
+
+   visible->numranges = 0;
+   for (c = 0; c < model->numclusters; c++) {
+      const GLMcluster *cluster = &model->clusters[c];
+      const uint size = cluster->indexType == GL_UNSIGNED_INT ? 4 : 2;
+      GLboolean inside = GL_TRUE;
+      uint r;
+
+      for (i = 0; i < 6 && inside; i++) {
+         if (planes[i][0] * cluster->center[0] +
+             planes[i][1] * cluster->center[1] +
+             planes[i][2] * cluster->center[2] + planes[i][3] <
+             -cluster->radius)
+            inside = GL_FALSE;
+      }
+      if (!inside)
+         continue;
+
+      /* all the triangles face away if the eye sees every point of
+         the sphere at more than 90 degrees to every normal of the cone */
+      if (cone && cluster->coneCos > 0.0) {
+         GLfloat d[3], len, cosa, sina;
+
+         for (i = 0; i < 3; i++)
+            d[i] = cluster->center[i] - eye[i];
+         len = sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+         if (len > cluster->radius) {
+            cosa = coneSign * (d[0] * cluster->axis[0] +
+                               d[1] * cluster->axis[1] +
+                               d[2] * cluster->axis[2]) / len;
+            sina = fabs(cosa) < 1.0 ? sqrt(1.0 - cosa * cosa) : 0.0;
+            if (cosa * cluster->coneCos - sina * cluster->coneSin >=
+                cluster->radius / len)
+               continue;
+         }
+      }
+
+      if (cluster->material != prevMaterial ||
+          cluster->indexType != visible->indexType) {
+         _glmFlushVisible(model);
+         if (cluster->material != prevMaterial) {
+            glmShaderMaterial(&model->materials[cluster->material]);
+            prevMaterial = cluster->material;
+         }
+         visible->indexType = cluster->indexType;
+      }
+
+      /* merge with the last range if they're next to each other */
+      r = visible->numranges;
+      if (batched && r > 0 && visible->baseVertex[r - 1] == cluster->baseVertex &&
+          (size_t) visible->offsets[r - 1] + visible->counts[r - 1] * size ==
+          cluster->indexVboOffset) {
+         visible->counts[r - 1] += cluster->numIndices;
+      }
+      else {
+         visible->counts[r] = cluster->numIndices;
+         visible->offsets[r] = (const void *) (GLintptr) cluster->indexVboOffset;
+         visible->baseVertex[r] = cluster->baseVertex;
+         visible->numranges++;
+      }
+      drawn += cluster->numIndices / 3;
+
+      if (!batched)
+         _glmFlushVisible(model);
+   }
+   _glmFlushVisible(model);
+
+   _glmEndDrawVBO();
+
+   return drawn;
+}
+
 
 /* glmList: Generates and returns a display list for the model using
  * the mode specified.
@@ -375,10 +1079,11 @@ glmList(GLMmodel* model, GLuint mode)
 
 
 static const char *VertexShader =
+   "attribute vec3 vertNormal; \n"
    "varying vec3 normal; \n"
    "void main() { \n"
    "   gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex; \n"
-   "   normal = gl_NormalMatrix * gl_Normal; \n"
+   "   normal = gl_NormalMatrix * vertNormal; \n"
    "   gl_TexCoord[0] = gl_MultiTexCoord0; \n"
    "} \n";
 
@@ -441,6 +1146,10 @@ glmShaderMaterial(GLMmaterial *mat)
       mat->prog = LinkShaders(vs, fs);
       assert(mat->prog);
 
+      /* the normals come from a generic attribute, see glmDrawVBO() */
+      glBindAttribLocation(mat->prog, GLM_NORMAL_ATTRIB, "vertNormal");
+      glLinkProgram(mat->prog);
+
       glUseProgram(mat->prog);
 
       mat->uAmbient = glGetUniformLocation(mat->prog, "ambient");
@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <assert.h>
 #include <stdarg.h>
+#include <string.h>
 #include <GL/glew.h>
 #include "glut_wrap.h"
 #include "glm.h"
@@ -28,6 +29,11 @@ static GLuint SkyboxTex;
 static GLboolean Skybox = GL_TRUE;
 static GLboolean Cull = GL_TRUE;
 static GLboolean WireFrame = GL_FALSE;
+static GLboolean Compact = GL_FALSE;	/* compact VBO layout */
+static GLboolean Batched = GL_TRUE;	/* multi-draw per material */
+static GLboolean Culled = GL_TRUE;	/* draw only visible clusters */
+static GLboolean LOD = GL_TRUE;		/* simplified models far away */
+static uint DrawnTriangles;
 static GLenum FrontFace = GL_CCW;
 static GLfloat Yrot = 0.0;
 static GLint WinWidth = 1024, WinHeight = 768;
@@ -142,19 +148,32 @@ init_model(void)
 {
    float objScale;
 
-   /* read in the model */
-   Model = glmReadOBJ(Model_file);
-   objScale = glmUnitize(Model);
-   glmFacetNormals(Model);
-   if (Model->numnormals == 0) {
-      GLfloat smoothing_angle = 90.0;
-      printf("Generating normals.\n");
-      glmVertexNormals(Model, smoothing_angle);
+   /* use the binary cache of the model if it's up to date */
+   Model = glmReadCache(Model_file);
+   if (!Model) {
+      /* read in the model */
+      Model = glmReadOBJ(Model_file);
+      objScale = glmUnitize(Model);
+      glmFacetNormals(Model);
+      if (Model->numnormals == 0) {
+         GLfloat smoothing_angle = 90.0;
+         printf("Generating normals.\n");
+         glmVertexNormals(Model, smoothing_angle);
+      }
+
+      glmReIndex(Model);
+      glmOptimize(Model, 1);
+      glmBuildVBOData(Model);
+      glmMakeClusters(Model, 128);
+      glmMakeLODs(Model, GLM_MAX_LODS);
+      glmWriteCache(Model);
    }
 
    glmLoadTextures(Model);
-   glmReIndex(Model);
-   glmMakeVBOs(Model);
+   if (Compact)
+      glmMakeVBOsCompact(Model, GLM_VBO_COMPACT);
+   else
+      glmMakeVBOs(Model);
    if (0)
       glmPrint(Model);
 }
@@ -212,6 +231,18 @@ Idle(void)
 }
 
 
+static void
+DrawModel(void)
+{
+   if (Culled)
+      DrawnTriangles += glmDrawVBOCulled(Model, Batched);
+   else if (Batched)
+      glmDrawVBOBatched(Model);
+   else
+      glmDrawVBO(Model);
+}
+
+
 static void
 display(void)
 {
@@ -242,8 +273,9 @@ display(void)
       else
          glDisable(GL_CULL_FACE);
 
+      DrawnTriangles = 0;
       if (NumInstances == 1) {
-         glmDrawVBO(Model);
+         DrawModel();
       }
       else {
          /* draw > 1 instance */
@@ -253,7 +285,7 @@ display(void)
             glPushMatrix();
             glRotatef(r, 0, 1, 0);
             glTranslatef(1.4, 0.0, 0.0);
-            glmDrawVBO(Model);
+            DrawModel();
             glPopMatrix();
          }
       }
@@ -279,6 +311,11 @@ display(void)
            Model->numgroups);
       text(5, glutGet(GLUT_WINDOW_HEIGHT) - (5+20*7), 20, "%d materials", 
            Model->nummaterials);
+      if (Culled)
+         text(5, glutGet(GLUT_WINDOW_HEIGHT) - (5+20*8), 20,
+              "%u triangles drawn", DrawnTriangles);
+      text(5, glutGet(GLUT_WINDOW_HEIGHT) - (5+20*9), 20, "LOD %u of %u",
+           Model->lod, Model->numlods);
    }
 
    glutSwapBuffers();
@@ -301,6 +338,10 @@ keyboard(unsigned char key, int x, int y)
       printf("d/D          -  Decrease/Incrase number of models\n");
       printf("w            -  Toggle wireframe/filled\n");
       printf("c            -  Toggle culling\n");
+      printf("b            -  Toggle per-material batched drawing (of the\n"
+             "                whole model or of the visible clusters)\n");
+      printf("v            -  Toggle culling of invisible clusters\n");
+      printf("l            -  Toggle level of detail\n");
       printf("n            -  Toggle facet/smooth normal\n");
       printf("r            -  Reverse polygon winding\n");
       printf("p            -  Toggle performance indicator\n");
@@ -332,6 +373,19 @@ keyboard(unsigned char key, int x, int y)
    case 'w':
       WireFrame = !WireFrame;
       break;
+   case 'b':
+      Batched = !Batched;
+      printf("Batched drawing: %d\n", Batched);
+      break;
+   case 'l':
+      LOD = !LOD;
+      Model->lodPixels = LOD ? 1.0 : -1.0;
+      printf("Level of detail: %d\n", LOD);
+      break;
+   case 'v':
+      Culled = !Culled;
+      printf("Cluster culling: %d\n", Culled);
+      break;
    case 'c':
       Cull = !Cull;
       printf("Polygon culling: %d\n", Cull);
@@ -466,14 +520,19 @@ DoFeatureChecks(void)
 int
 main(int argc, char** argv)
 {
+   int i;
+
    glutInitWindowSize(WinWidth, WinHeight);
    glutInit(&argc, argv);
 
-   if (argc > 1) {
-      Model_file = argv[1];
+   for (i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "-compact") == 0)
+         Compact = GL_TRUE;
+      else
+         Model_file = argv[i];
    }
    if (!Model_file) {
-      fprintf(stderr, "usage: objview file.obj\n");
+      fprintf(stderr, "usage: objview [-compact] file.obj\n");
       fprintf(stderr, "(using default bunny.obj)\n");
       Model_file = "bunny.obj";
    }
@@ -499,6 +558,9 @@ main(int argc, char** argv)
    glutAddMenuEntry("[D] More models", 'D');
    glutAddMenuEntry("[w] Toggle wireframe/filled", 'w');
    glutAddMenuEntry("[c] Toggle culling on/off", 'c');
+   glutAddMenuEntry("[b] Toggle batched drawing", 'b');
+   glutAddMenuEntry("[v] Toggle cluster culling", 'v');
+   glutAddMenuEntry("[l] Toggle level of detail", 'l');
    glutAddMenuEntry("[r] Reverse polygon winding", 'r');
    glutAddMenuEntry("[z] Scale model smaller", 'z');
    glutAddMenuEntry("[Z] Scale model larger", 'Z');
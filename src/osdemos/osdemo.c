@@ -14,6 +14,23 @@
  * ASCII PPM output added by Brian Paul.
  *
  * Usage: osdemo [filename]
+ *
+ * Batch mode renders many views of the scene, each into its own file,
+ * with one OSMesa context per thread:
+ *
+ *    osdemo -batch jobfile [-threads n] [-writers n] [width height]
+ *
+ * Each line of the job file is "filename [xrot [yrot]]", the rotations
+ * in degrees; "-" reads the jobs from stdin.  Writer threads encode and
+ * write the images while the render threads go on with the next jobs.
+ *
+ * Tiled mode renders images too big for one OSMesa buffer, like posters,
+ * in tiles, streaming them to the file a row of tiles at a time:
+ *
+ *    osdemo -tiled [-tile n] [-threads n] filename width height
+ *
+ * The file name extension selects run length encoded Targa (.tga),
+ * binary PPM (.ppm) or QOI (.qoi) output.
  */
 
 
@@ -21,6 +38,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/time.h>
+#include <unistd.h>
+#ifdef PTHREADS
+#include <pthread.h>
+#endif
 #include "GL/osmesa.h"
 #include "gl_wrap.h"
 
@@ -31,6 +54,66 @@ static int Width = 400;
 static int Height = 400;
 
 
+/** A batch mode job: one view of the scene, rendered into one file */
+struct job
+{
+   char filename[256];
+   GLfloat xrot, yrot;
+};
+
+static struct job *Jobs;
+static int NumJobs;
+static int NextJob;  /**< next job to hand out */
+#ifdef PTHREADS
+static pthread_mutex_t JobMutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/**
+ * A color buffer on its way from a render thread to the image writers.
+ * The frames form a fixed pool, which also bounds the write queue.
+ */
+struct frame
+{
+   GLubyte *pixels;
+   const struct job *job;   /**< the job rendered into pixels */
+};
+
+static struct frame *Frames;
+static int NumFrames;
+static struct frame **FreeFrames;   /**< stack of frames free to render to */
+static int NumFreeFrames;
+static struct frame **WriteQueue;   /**< ring of frames waiting for a writer */
+static int NumWriters;
+static long ImagesWritten;
+#ifdef PTHREADS
+static int QueueHead, QueueCount;
+static GLboolean RenderingDone;
+static pthread_mutex_t FrameMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t FrameFree = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t FrameReady = PTHREAD_COND_INITIALIZER;
+#endif
+
+/**
+ * Tiled mode renders the image in TileSize squares and writes it out a
+ * strip, a row of tiles, at a time.  The tiles of the next strip render
+ * into the other strip buffer while one is written.
+ */
+#define NUM_STRIPS 2
+
+static int TileSize = 256;
+static int TilesX, NumStrips;
+static GLubyte *Strips[NUM_STRIPS];   /**< RGBA, bottom-up rows */
+#ifdef PTHREADS
+static int NextTile;                  /**< next tile to hand out */
+static int StripTiles[NUM_STRIPS];    /**< tiles done in each strip buffer */
+static int StripsWritten;
+static int TileWorkers;               /**< tile threads still running */
+static pthread_mutex_t TileMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t StripReady = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t StripFree = PTHREAD_COND_INITIALIZER;
+#endif
+
+
 static void
 Sphere(float radius, int slices, int stacks)
 {
@@ -93,8 +176,12 @@ Torus(float innerRadius, float outerRadius, int sides, int rings)
 }
 
 
+/**
+ * Render the scene.  window is the left, right, bottom and top of the
+ * part of the view to render, as for glOrtho, or NULL for all of it.
+ */
 static void
-render_image(void)
+render_image(GLfloat xrot, GLfloat yrot, const GLdouble *window)
 {
    GLfloat light_ambient[] = { 0.0, 0.0, 0.0, 1.0 };
    GLfloat light_diffuse[] = { 1.0, 1.0, 1.0, 1.0 };
@@ -116,13 +203,17 @@ render_image(void)
 
    glMatrixMode(GL_PROJECTION);
    glLoadIdentity();
-   glOrtho(-2.5, 2.5, -2.5, 2.5, -10.0, 10.0);
+   if (window)
+      glOrtho(window[0], window[1], window[2], window[3], -10.0, 10.0);
+   else
+      glOrtho(-2.5, 2.5, -2.5, 2.5, -10.0, 10.0);
    glMatrixMode(GL_MODELVIEW);
 
    glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
 
    glPushMatrix();
-   glRotatef(20.0, 1.0, 0.0, 0.0);
+   glRotatef(xrot, 1.0, 0.0, 0.0);
+   glRotatef(yrot, 0.0, 1.0, 0.0);
 
    glPushMatrix();
    glTranslatef(-0.75, 0.5, 0.0); 
@@ -153,97 +244,1021 @@ render_image(void)
 }
 
 
+/** Output file formats, chosen by the file name extension */
+enum image_format
+{
+   IMAGE_TGA,   /**< run length encoded Targa */
+   IMAGE_PPM,   /**< binary PPM */
+   IMAGE_QOI    /**< "Quite OK Image" lossless format */
+};
+
+
+/**
+ * An image being encoded a row at a time, top to bottom, so that big
+ * images can be streamed to the file in pieces.
+ */
+struct image_encoder
+{
+   enum image_format format;
+   int width, height;
+   /* QOI state carried from row to row */
+   GLubyte index[64][3];
+   GLubyte prev[3];
+   int run;
+};
+
+
+/** Growable buffer an image is encoded into before being written out */
+struct encode_buffer
+{
+   GLubyte *data;
+   size_t size;
+};
+
+
+static enum image_format
+image_format(const char *filename)
+{
+   const char *ext = strrchr(filename, '.');
+
+   if (ext) {
+      if (strcasecmp(ext, ".tga") == 0)
+         return IMAGE_TGA;
+      if (strcasecmp(ext, ".ppm") == 0)
+         return IMAGE_PPM;
+      if (strcasecmp(ext, ".qoi") == 0)
+         return IMAGE_QOI;
+   }
 #ifdef SAVE_TARGA
+   return IMAGE_TGA;
+#else
+   return IMAGE_PPM;
+#endif
+}
 
-static void
-write_targa(const char *filename, const GLubyte *buffer, int width, int height)
-{
-   FILE *f = fopen( filename, "w" );
-   if (f) {
-      int i, x, y;
-      const GLubyte *ptr = buffer;
-      printf ("osdemo, writing tga file \n");
-      fputc (0x00, f);	/* ID Length, 0 => No ID	*/
-      fputc (0x00, f);	/* Color Map Type, 0 => No color map included	*/
-      fputc (0x02, f);	/* Image Type, 2 => Uncompressed, True-color Image */
-      fputc (0x00, f);	/* Next five bytes are about the color map entries */
-      fputc (0x00, f);	/* 2 bytes Index, 2 bytes length, 1 byte size */
-      fputc (0x00, f);
-      fputc (0x00, f);
-      fputc (0x00, f);
-      fputc (0x00, f);	/* X-origin of Image	*/
-      fputc (0x00, f);
-      fputc (0x00, f);	/* Y-origin of Image	*/
-      fputc (0x00, f);
-      fputc (Width & 0xff, f);      /* Image Width	*/
-      fputc ((Width>>8) & 0xff, f);
-      fputc (Height & 0xff, f);     /* Image Height	*/
-      fputc ((Height>>8) & 0xff, f);
-      fputc (0x18, f);		/* Pixel Depth, 0x18 => 24 Bits	*/
-      fputc (0x20, f);		/* Image Descriptor	*/
-      fclose(f);
-      f = fopen( filename, "ab" );  /* reopen in binary append mode */
-      for (y=height-1; y>=0; y--) {
-         for (x=0; x<width; x++) {
-            i = (y*width + x) * 4;
-            fputc(ptr[i+2], f); /* write blue */
-            fputc(ptr[i+1], f); /* write green */
-            fputc(ptr[i], f);   /* write red */
+
+/** Upper bound of the size of the file header or end */
+#define MAX_HEADER_SIZE 64
+
+/** Upper bound of the encoded size of one row */
+static size_t
+max_row_size(enum image_format format, int width)
+{
+   switch (format) {
+   case IMAGE_TGA:
+      /* one packet header per 128 pixels, at worst */
+      return (size_t) width * 3 + (width + 127) / 128;
+   case IMAGE_PPM:
+      return (size_t) width * 3;
+   case IMAGE_QOI:
+   default:
+      return (size_t) width * 4;
+   }
+}
+
+
+/** Grow the encode buffer to hold the header, end and numRows rows */
+static GLboolean
+reserve_rows(struct encode_buffer *enc, enum image_format format,
+             int width, int numRows)
+{
+   const size_t size = 2 * MAX_HEADER_SIZE +
+      (size_t) numRows * max_row_size(format, width);
+
+   if (enc->size < size) {
+      free(enc->data);
+      enc->data = malloc(size);
+      enc->size = enc->data ? size : 0;
+   }
+   return enc->data != NULL;
+}
+
+
+/** Start encoding a width x height image, returns the header size */
+static size_t
+begin_image(struct image_encoder *e, enum image_format format,
+            int width, int height, GLubyte *out)
+{
+   e->format = format;
+   e->width = width;
+   e->height = height;
+
+   switch (format) {
+   case IMAGE_TGA:
+      {
+         static const GLubyte header[12] = {
+            0x00,   /* ID Length, 0 => No ID */
+            0x00,   /* Color Map Type, 0 => No color map included */
+            0x0a,   /* Image Type, 10 => Run length encoded True-color */
+            0x00, 0x00, 0x00, 0x00, 0x00,   /* color map entries */
+            0x00, 0x00,   /* X-origin of Image */
+            0x00, 0x00    /* Y-origin of Image */
+         };
+         memcpy(out, header, sizeof(header));
+         out[12] = width & 0xff;          /* Image Width */
+         out[13] = (width >> 8) & 0xff;
+         out[14] = height & 0xff;         /* Image Height */
+         out[15] = (height >> 8) & 0xff;
+         out[16] = 0x18;                  /* Pixel Depth, 0x18 => 24 Bits */
+         out[17] = 0x20;                  /* Image Descriptor, top-left */
+         return 18;
+      }
+   case IMAGE_PPM:
+      return sprintf((char *) out,
+                     "P6\n# ppm-file created by osdemo.c\n%i %i\n255\n",
+                     width, height);
+   case IMAGE_QOI:
+   default:
+      memset(e->index, 0, sizeof(e->index));
+      memset(e->prev, 0, sizeof(e->prev));
+      e->run = 0;
+      memcpy(out, "qoif", 4);
+      out[4] = (width >> 24) & 0xff;
+      out[5] = (width >> 16) & 0xff;
+      out[6] = (width >> 8) & 0xff;
+      out[7] = width & 0xff;
+      out[8] = (height >> 24) & 0xff;
+      out[9] = (height >> 16) & 0xff;
+      out[10] = (height >> 8) & 0xff;
+      out[11] = height & 0xff;
+      out[12] = 3;   /* channels */
+      out[13] = 0;   /* sRGB with linear alpha */
+      return 14;
+   }
+}
+
+
+#define SAME_RGB(a, b) ((a)[0] == (b)[0] && (a)[1] == (b)[1] && (a)[2] == (b)[2])
+
+/**
+ * Encode a row of RGBA pixels as run length encoded 24-bit Targa.
+ * Packets don't cross rows.
+ */
+static size_t
+encode_targa_row(const GLubyte *row, int width, GLubyte *out)
+{
+   GLubyte *p = out;
+   int x;
+
+   for (x = 0; x < width; ) {
+      const GLubyte *src = row + x * 4;
+      int n = 1, i;
+
+      while (x + n < width && n < 128 && SAME_RGB(src + n * 4, src))
+         n++;
+
+      if (n > 1) {
+         /* run length packet */
+         *p++ = 0x80 | (n - 1);
+         *p++ = src[2];   /* blue */
+         *p++ = src[1];   /* green */
+         *p++ = src[0];   /* red */
+      }
+      else {
+         /* raw packet, up to where the next run starts */
+         while (x + n < width && n < 128 &&
+                !(x + n + 1 < width &&
+                  SAME_RGB(src + n * 4, src + (n + 1) * 4)))
+            n++;
+         *p++ = n - 1;
+         for (i = 0; i < n; i++) {
+            *p++ = src[i * 4 + 2];
+            *p++ = src[i * 4 + 1];
+            *p++ = src[i * 4];
          }
       }
+      x += n;
    }
+
+   return p - out;
 }
 
-#else
 
-static void
-write_ppm(const char *filename, const GLubyte *buffer, int width, int height)
-{
-   const int binary = 0;
-   FILE *f = fopen( filename, "w" );
-   if (f) {
-      int i, x, y;
-      const GLubyte *ptr = buffer;
-      if (binary) {
-         fprintf(f,"P6\n");
-         fprintf(f,"# ppm-file created by osdemo.c\n");
-         fprintf(f,"%i %i\n", width,height);
-         fprintf(f,"255\n");
-         fclose(f);
-         f = fopen( filename, "ab" );  /* reopen in binary append mode */
-         for (y=height-1; y>=0; y--) {
-            for (x=0; x<width; x++) {
-               i = (y*width + x) * 4;
-               fputc(ptr[i], f);   /* write red */
-               fputc(ptr[i+1], f); /* write green */
-               fputc(ptr[i+2], f); /* write blue */
-            }
+static size_t
+encode_ppm_row(const GLubyte *row, int width, GLubyte *out)
+{
+   GLubyte *p = out;
+   int x;
+
+   for (x = 0; x < width; x++) {
+      *p++ = row[0];
+      *p++ = row[1];
+      *p++ = row[2];
+      row += 4;
+   }
+
+   return p - out;
+}
+
+
+/**
+ * Encode a row of RGBA pixels as 3 channel QOI, see
+ * https://qoiformat.org/qoi-specification.pdf
+ * Alpha is dropped, the same as in the other formats.
+ */
+static size_t
+encode_qoi_row(struct image_encoder *e, const GLubyte *src, GLubyte *out)
+{
+   GLubyte *p = out;
+   int x;
+
+   for (x = 0; x < e->width; x++, src += 4) {
+      int hash, dr, dg, db;
+
+      if (SAME_RGB(src, e->prev)) {
+         if (++e->run == 62) {
+            *p++ = 0xc0 | (e->run - 1);   /* QOI_OP_RUN */
+            e->run = 0;
          }
+         continue;
+      }
+      if (e->run > 0) {
+         *p++ = 0xc0 | (e->run - 1);
+         e->run = 0;
+      }
+
+      /* the alpha of every pixel is 255 */
+      hash = (src[0] * 3 + src[1] * 5 + src[2] * 7 + 255 * 11) % 64;
+      if (SAME_RGB(e->index[hash], src)) {
+         *p++ = hash;   /* QOI_OP_INDEX */
       }
       else {
-         /*ASCII*/
-         int counter = 0;
-         fprintf(f,"P3\n");
-         fprintf(f,"# ascii ppm file created by osdemo.c\n");
-         fprintf(f,"%i %i\n", width, height);
-         fprintf(f,"255\n");
-         for (y=height-1; y>=0; y--) {
-            for (x=0; x<width; x++) {
-               i = (y*width + x) * 4;
-               fprintf(f, " %3d %3d %3d", ptr[i], ptr[i+1], ptr[i+2]);
-               counter++;
-               if (counter % 5 == 0)
-                  fprintf(f, "\n");
-            }
+         e->index[hash][0] = src[0];
+         e->index[hash][1] = src[1];
+         e->index[hash][2] = src[2];
+
+         dr = (signed char) (src[0] - e->prev[0]);
+         dg = (signed char) (src[1] - e->prev[1]);
+         db = (signed char) (src[2] - e->prev[2]);
+
+         if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 &&
+             db >= -2 && db <= 1) {
+            /* QOI_OP_DIFF */
+            *p++ = 0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2);
+         }
+         else if (dg >= -32 && dg <= 31 &&
+                  dr - dg >= -8 && dr - dg <= 7 &&
+                  db - dg >= -8 && db - dg <= 7) {
+            /* QOI_OP_LUMA */
+            *p++ = 0x80 | (dg + 32);
+            *p++ = (dr - dg + 8) << 4 | (db - dg + 8);
+         }
+         else {
+            /* QOI_OP_RGB */
+            *p++ = 0xfe;
+            *p++ = src[0];
+            *p++ = src[1];
+            *p++ = src[2];
          }
       }
+
+      e->prev[0] = src[0];
+      e->prev[1] = src[1];
+      e->prev[2] = src[2];
+   }
+
+   return p - out;
+}
+
+
+/** Encode the next row of the image, returns the encoded size */
+static size_t
+encode_row(struct image_encoder *e, const GLubyte *row, GLubyte *out)
+{
+   switch (e->format) {
+   case IMAGE_TGA:
+      return encode_targa_row(row, e->width, out);
+   case IMAGE_PPM:
+      return encode_ppm_row(row, e->width, out);
+   case IMAGE_QOI:
+   default:
+      return encode_qoi_row(e, row, out);
+   }
+}
+
+
+/** Finish encoding the image, returns the size of the file's end */
+static size_t
+end_image(struct image_encoder *e, GLubyte *out)
+{
+   size_t size = 0;
+
+   if (e->format == IMAGE_QOI) {
+      if (e->run > 0)
+         out[size++] = 0xc0 | (e->run - 1);
+      /* end marker */
+      memset(out + size, 0, 7);
+      out[size + 7] = 1;
+      size += 8;
+   }
+   return size;
+}
+
+
+/**
+ * Encode the bottom-up RGBA rows of a GL color buffer from first down
+ * to first - numRows + 1, returns the encoded size.
+ */
+static size_t
+encode_rows(struct image_encoder *e, const GLubyte *buffer, int first,
+            int numRows, GLubyte *out)
+{
+   GLubyte *p = out;
+   int y;
+
+   for (y = first; y > first - numRows; y--)
+      p += encode_row(e, buffer + (size_t) y * e->width * 4, p);
+   return p - out;
+}
+
+
+/** Write size bytes to the file, complaining if that fails */
+static GLboolean
+write_bytes(FILE *f, const char *filename, const GLubyte *data, size_t size)
+{
+   if (fwrite(data, 1, size, f) != size) {
+      fprintf(stderr, "osdemo: error writing %s\n", filename);
+      return GL_FALSE;
+   }
+   return GL_TRUE;
+}
+
+
+/**
+ * Encode the RGBA image in memory and write it to the file with a single
+ * fwrite.  The encode buffer is grown as needed and may be reused for
+ * the next image.
+ */
+static GLboolean
+write_image(const char *filename, const GLubyte *buffer, int width, int height,
+            struct encode_buffer *enc)
+{
+   struct image_encoder e;
+   const enum image_format format = image_format(filename);
+   GLboolean ok;
+   size_t size;
+   FILE *f;
+
+   if (!reserve_rows(enc, format, width, height)) {
+      fprintf(stderr, "osdemo: out of memory encoding %s\n", filename);
+      return GL_FALSE;
+   }
+
+   size = begin_image(&e, format, width, height, enc->data);
+   size += encode_rows(&e, buffer, height - 1, height, enc->data + size);
+   size += end_image(&e, enc->data + size);
+
+   f = fopen(filename, "wb");
+   if (!f) {
+      fprintf(stderr, "osdemo: can't open %s\n", filename);
+      return GL_FALSE;
+   }
+   ok = write_bytes(f, filename, enc->data, size);
+   if (fclose(f) != 0 && ok) {
+      fprintf(stderr, "osdemo: error writing %s\n", filename);
+      ok = GL_FALSE;
+   }
+   return ok;
+}
+
+
+static OSMesaContext
+create_context(void)
+{
+   /* Create an RGBA-mode context */
+#if OSMESA_MAJOR_VERSION * 100 + OSMESA_MINOR_VERSION >= 305
+   /* specify Z, stencil, accum sizes */
+   return OSMesaCreateContextExt( OSMESA_RGBA, 16, 0, 0, NULL );
+#else
+   return OSMesaCreateContext( OSMESA_RGBA, NULL );
+#endif
+}
+
+
+static double
+get_time(void)
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+
+/**
+ * Read the batch jobs, one per line: "filename [xrot [yrot]]".
+ * Blank lines and lines starting with '#' are skipped.
+ */
+static int
+read_jobs(const char *filename)
+{
+   FILE *f = strcmp(filename, "-") == 0 ? stdin : fopen(filename, "r");
+   char line[1024];
+   int maxJobs = 0;
+
+   if (!f) {
+      fprintf(stderr, "osdemo: can't open job file %s\n", filename);
+      return 0;
+   }
+
+   while (fgets(line, sizeof(line), f)) {
+      struct job job;
+      int n;
+
+      job.xrot = 20.0;
+      job.yrot = 0.0;
+      n = sscanf(line, "%255s %f %f", job.filename, &job.xrot, &job.yrot);
+      if (n < 1 || job.filename[0] == '#')
+         continue;
+
+      if (NumJobs == maxJobs) {
+         maxJobs = maxJobs ? 2 * maxJobs : 64;
+         Jobs = realloc(Jobs, maxJobs * sizeof(struct job));
+      }
+      Jobs[NumJobs++] = job;
+   }
+
+   if (f != stdin)
       fclose(f);
+   return NumJobs;
+}
+
+
+/** Take the next job off the queue, or NULL if there are none left */
+static const struct job *
+next_job(void)
+{
+   const struct job *job = NULL;
+
+#ifdef PTHREADS
+   pthread_mutex_lock(&JobMutex);
+#endif
+   if (NextJob < NumJobs)
+      job = &Jobs[NextJob++];
+#ifdef PTHREADS
+   pthread_mutex_unlock(&JobMutex);
+#endif
+   return job;
+}
+
+
+/** Wait for a frame that isn't queued or being written */
+static struct frame *
+acquire_frame(void)
+{
+   struct frame *frame;
+
+#ifdef PTHREADS
+   pthread_mutex_lock(&FrameMutex);
+   while (NumFreeFrames == 0)
+      pthread_cond_wait(&FrameFree, &FrameMutex);
+#endif
+   frame = FreeFrames[--NumFreeFrames];
+#ifdef PTHREADS
+   pthread_mutex_unlock(&FrameMutex);
+#endif
+   return frame;
+}
+
+
+/** Return a frame to the pool, counting its image if it was written */
+static void
+release_frame(struct frame *frame, GLboolean written)
+{
+#ifdef PTHREADS
+   pthread_mutex_lock(&FrameMutex);
+#endif
+   FreeFrames[NumFreeFrames++] = frame;
+   if (written)
+      ImagesWritten++;
+#ifdef PTHREADS
+   pthread_cond_signal(&FrameFree);
+   pthread_mutex_unlock(&FrameMutex);
+#endif
+}
+
+
+/**
+ * Queue a rendered frame for the writer threads, or write it right away
+ * with the caller's encode buffer if there are none.
+ */
+static void
+submit_frame(struct frame *frame, struct encode_buffer *enc)
+{
+#ifdef PTHREADS
+   if (NumWriters > 0) {
+      pthread_mutex_lock(&FrameMutex);
+      /* can't overflow, the queue has room for every frame */
+      WriteQueue[(QueueHead + QueueCount) % NumFrames] = frame;
+      QueueCount++;
+      pthread_cond_signal(&FrameReady);
+      pthread_mutex_unlock(&FrameMutex);
+      return;
+   }
+#endif
+   release_frame(frame, write_image(frame->job->filename, frame->pixels,
+                                    Width, Height, enc));
+}
+
+
+#ifdef PTHREADS
+
+/**
+ * Writer thread: encode and write queued frames until the render
+ * threads are done and the queue is empty.
+ */
+static void *
+writer_thread(void *arg)
+{
+   struct encode_buffer enc = { NULL, 0 };
+
+   (void) arg;
+
+   for (;;) {
+      struct frame *frame;
+
+      pthread_mutex_lock(&FrameMutex);
+      while (QueueCount == 0 && !RenderingDone)
+         pthread_cond_wait(&FrameReady, &FrameMutex);
+      if (QueueCount == 0) {
+         pthread_mutex_unlock(&FrameMutex);
+         break;
+      }
+      frame = WriteQueue[QueueHead];
+      QueueHead = (QueueHead + 1) % NumFrames;
+      QueueCount--;
+      pthread_mutex_unlock(&FrameMutex);
+
+      release_frame(frame, write_image(frame->job->filename, frame->pixels,
+                                       Width, Height, &enc));
    }
+
+   free(enc.data);
+   return NULL;
 }
 
 #endif
 
 
+/**
+ * Batch worker: render jobs from the queue with its own context until
+ * there are none left.  Each job gets a free frame from the pool, so the
+ * next image renders while the writers still encode the previous one.
+ * Returns the number of images rendered, as a pointer-sized integer.
+ */
+static void *
+batch_worker(void *arg)
+{
+   struct encode_buffer enc = { NULL, 0 };
+   const struct job *job;
+   OSMesaContext ctx;
+   long count = 0;
+
+   (void) arg;
+
+#ifdef PTHREADS
+   /* don't count on context creation being thread safe */
+   pthread_mutex_lock(&JobMutex);
+#endif
+   ctx = create_context();
+#ifdef PTHREADS
+   pthread_mutex_unlock(&JobMutex);
+#endif
+   if (!ctx) {
+      printf("osdemo: batch worker setup failed!\n");
+      return (void *) count;
+   }
+
+   while ((job = next_job()) != NULL) {
+      struct frame *frame = acquire_frame();
+
+      if (!OSMesaMakeCurrent(ctx, frame->pixels, GL_UNSIGNED_BYTE,
+                             Width, Height)) {
+         printf("osdemo: OSMesaMakeCurrent failed!\n");
+         release_frame(frame, GL_FALSE);
+         break;
+      }
+      render_image(job->xrot, job->yrot, NULL);
+      frame->job = job;
+      submit_frame(frame, &enc);
+      count++;
+   }
+
+   OSMesaMakeCurrent(NULL, NULL, 0, 0, 0);
+   OSMesaDestroyContext(ctx);
+   free(enc.data);
+   return (void *) count;
+}
+
+
+/**
+ * Allocate the frame pool: two color buffers per render thread, so each
+ * can render one while the other waits for or is in a writer.
+ */
+static GLboolean
+alloc_frames(int numFrames)
+{
+   int i;
+
+   NumFrames = numFrames;
+   Frames = calloc(numFrames, sizeof(struct frame));
+   FreeFrames = malloc(numFrames * sizeof(struct frame *));
+   WriteQueue = malloc(numFrames * sizeof(struct frame *));
+   if (!Frames || !FreeFrames || !WriteQueue)
+      return GL_FALSE;
+
+   for (i = 0; i < numFrames; i++) {
+      Frames[i].pixels = malloc(Width * Height * 4 * sizeof(GLubyte));
+      if (!Frames[i].pixels)
+         return GL_FALSE;
+      FreeFrames[NumFreeFrames++] = &Frames[i];
+   }
+   return GL_TRUE;
+}
+
+
+static void
+free_frames(void)
+{
+   int i;
+
+   if (Frames) {
+      for (i = 0; i < NumFrames; i++)
+         free(Frames[i].pixels);
+   }
+   free(Frames);
+   free(FreeFrames);
+   free(WriteQueue);
+}
+
+
+/**
+ * Render all the jobs of a job file with numThreads render threads
+ * (0 = one per CPU), each owning a context, and numWriters threads
+ * encoding and writing the images (-1 = one per two render threads,
+ * 0 = the render threads write their own images).
+ */
+static int
+run_batch(const char *jobfile, int numThreads, int numWriters)
+{
+   double t0, t1;
+   int i;
+
+   if (!read_jobs(jobfile)) {
+      fprintf(stderr, "osdemo: no jobs\n");
+      return 1;
+   }
+
+   if (numThreads <= 0) {
+      numThreads = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+      numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+   }
+   if (numThreads > NumJobs)
+      numThreads = NumJobs;
+   if (numThreads < 1)
+      numThreads = 1;
+#ifndef PTHREADS
+   numThreads = 1;
+   numWriters = 0;
+#endif
+   if (numWriters < 0)
+      numWriters = (numThreads + 1) / 2;
+
+   if (!alloc_frames(2 * numThreads)) {
+      fprintf(stderr, "osdemo: out of memory for %d image buffers\n",
+              2 * numThreads);
+      free_frames();
+      free(Jobs);
+      return 1;
+   }
+
+   t0 = get_time();
+
+#ifdef PTHREADS
+   {
+      pthread_t *threads = malloc(numThreads * sizeof(pthread_t));
+      pthread_t *writers = malloc(numWriters * sizeof(pthread_t));
+      int started = 0;
+
+      NumWriters = 0;
+      for (i = 0; i < numWriters; i++) {
+         if (pthread_create(&writers[NumWriters], NULL, writer_thread,
+                            NULL) == 0)
+            NumWriters++;
+      }
+
+      for (i = 0; i < numThreads; i++) {
+         if (pthread_create(&threads[started], NULL, batch_worker, NULL) == 0)
+            started++;
+      }
+      if (started == 0) {
+         batch_worker(NULL);
+      }
+      for (i = 0; i < started; i++) {
+         pthread_join(threads[i], NULL);
+      }
+      numThreads = started ? started : 1;
+
+      /* let the writers drain the queue and exit */
+      pthread_mutex_lock(&FrameMutex);
+      RenderingDone = GL_TRUE;
+      pthread_cond_broadcast(&FrameReady);
+      pthread_mutex_unlock(&FrameMutex);
+      for (i = 0; i < NumWriters; i++) {
+         pthread_join(writers[i], NULL);
+      }
+
+      free(threads);
+      free(writers);
+   }
+#else
+   (void) i;
+   batch_worker(NULL);
+#endif
+
+   t1 = get_time();
+
+   printf("osdemo: %ld of %d images (%dx%d) in %.2f s with %d render and "
+          "%d writer threads, %.1f images/s\n", ImagesWritten, NumJobs,
+          Width, Height, t1 - t0, numThreads, NumWriters,
+          ImagesWritten / (t1 - t0));
+
+   free_frames();
+   free(Jobs);
+   return ImagesWritten == NumJobs ? 0 : 1;
+}
+
+
+/** Image rows from the top that strip s of the tiled image covers */
+static int
+strip_height(int s)
+{
+   return Height - s * TileSize < TileSize ? Height - s * TileSize : TileSize;
+}
+
+
+/**
+ * Render tile t with the current context, whose color buffer is tile,
+ * TileSize x TileSize, and copy the part inside the image into its strip.
+ */
+static void
+render_tile(int t, const GLubyte *tile)
+{
+   const int s = t / TilesX;
+   const int x0 = (t % TilesX) * TileSize;
+   const int top = Height - s * TileSize;   /* GL y of the strip's top */
+   const int w = Width - x0 < TileSize ? Width - x0 : TileSize;
+   const int h = strip_height(s);
+   GLubyte *strip = Strips[s % NUM_STRIPS];
+   GLdouble window[4];
+   int y;
+
+   /* the part of the full view under the tile, whose top row is the
+    * strip's top row; edge tiles extend past the image
+    */
+   window[0] = -2.5 + 5.0 * x0 / Width;
+   window[1] = -2.5 + 5.0 * (x0 + TileSize) / Width;
+   window[2] = -2.5 + 5.0 * (top - TileSize) / Height;
+   window[3] = -2.5 + 5.0 * top / Height;
+   render_image(20.0, 0.0, window);
+
+   for (y = 0; y < h; y++) {
+      memcpy(strip + ((size_t) y * Width + x0) * 4,
+             tile + (size_t) (TileSize - h + y) * TileSize * 4, w * 4);
+   }
+}
+
+
+/** Create a context rendering into a new tile buffer and make it current */
+static OSMesaContext
+create_tile_context(GLubyte **tile)
+{
+   OSMesaContext ctx;
+
+#ifdef PTHREADS
+   pthread_mutex_lock(&JobMutex);
+#endif
+   ctx = create_context();
+#ifdef PTHREADS
+   pthread_mutex_unlock(&JobMutex);
+#endif
+   *tile = malloc(TileSize * TileSize * 4 * sizeof(GLubyte));
+   if (!ctx || !*tile ||
+       !OSMesaMakeCurrent(ctx, *tile, GL_UNSIGNED_BYTE, TileSize, TileSize)) {
+      printf("osdemo: tile context setup failed!\n");
+      if (ctx)
+         OSMesaDestroyContext(ctx);
+      free(*tile);
+      return NULL;
+   }
+   return ctx;
+}
+
+
+static void
+destroy_tile_context(OSMesaContext ctx, GLubyte *tile)
+{
+   OSMesaMakeCurrent(NULL, NULL, 0, 0, 0);
+   OSMesaDestroyContext(ctx);
+   free(tile);
+}
+
+
+#ifdef PTHREADS
+
+/**
+ * Tile worker: render tiles in order, top strip first, until there are
+ * none left.  A tile waits until its strip buffer has been written out.
+ */
+static void *
+tile_worker(void *arg)
+{
+   GLubyte *tile;
+   OSMesaContext ctx = create_tile_context(&tile);
+
+   (void) arg;
+
+   for (;;) {
+      int t, s;
+
+      pthread_mutex_lock(&TileMutex);
+      if (!ctx || NextTile == TilesX * NumStrips) {
+         TileWorkers--;
+         pthread_cond_broadcast(&StripReady);
+         pthread_mutex_unlock(&TileMutex);
+         break;
+      }
+      t = NextTile++;
+      s = t / TilesX;
+      while (s >= StripsWritten + NUM_STRIPS)
+         pthread_cond_wait(&StripFree, &TileMutex);
+      pthread_mutex_unlock(&TileMutex);
+
+      render_tile(t, tile);
+
+      pthread_mutex_lock(&TileMutex);
+      if (++StripTiles[s % NUM_STRIPS] == TilesX)
+         pthread_cond_broadcast(&StripReady);
+      pthread_mutex_unlock(&TileMutex);
+   }
+
+   if (ctx)
+      destroy_tile_context(ctx, tile);
+   return NULL;
+}
+
+#endif
+
+
+/**
+ * Render a Width x Height image in TileSize tiles with numThreads threads
+ * (0 = one per CPU) and stream it to the file a row of tiles at a time,
+ * so that memory use depends on the width and tile size only.  While a
+ * strip is being encoded and written the threads render the next one.
+ */
+static int
+run_tiled(const char *filename, int numThreads)
+{
+   const enum image_format format = image_format(filename);
+   struct image_encoder e;
+   struct encode_buffer enc = { NULL, 0 };
+   OSMesaContext ctx = NULL;
+   GLubyte *tile = NULL;
+   GLboolean ok = GL_TRUE;
+   double t0, t1;
+   FILE *f;
+   int s, i;
+#ifdef PTHREADS
+   pthread_t *threads;
+#endif
+
+   TilesX = (Width + TileSize - 1) / TileSize;
+   NumStrips = (Height + TileSize - 1) / TileSize;
+
+   if (numThreads <= 0) {
+      numThreads = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+      numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+   }
+   if (numThreads > TilesX * NumStrips)
+      numThreads = TilesX * NumStrips;
+
+   for (i = 0; i < NUM_STRIPS; i++) {
+      Strips[i] = malloc((size_t) Width * TileSize * 4);
+      ok = ok && Strips[i];
+   }
+   if (!ok || !reserve_rows(&enc, format, Width, TileSize)) {
+      fprintf(stderr, "osdemo: out of memory for %d pixel wide strips\n",
+              Width);
+      ok = GL_FALSE;
+      goto cleanup;
+   }
+
+   f = fopen(filename, "wb");
+   if (!f) {
+      fprintf(stderr, "osdemo: can't open %s\n", filename);
+      ok = GL_FALSE;
+      goto cleanup;
+   }
+
+   t0 = get_time();
+
+   ok = write_bytes(f, filename, enc.data,
+                    begin_image(&e, format, Width, Height, enc.data));
+
+#ifdef PTHREADS
+   threads = malloc(numThreads * sizeof(pthread_t));
+   pthread_mutex_lock(&TileMutex);
+   for (i = 0; i < numThreads; i++) {
+      if (pthread_create(&threads[TileWorkers], NULL, tile_worker, NULL) == 0)
+         TileWorkers++;
+   }
+   numThreads = TileWorkers;
+   pthread_mutex_unlock(&TileMutex);
+#else
+   numThreads = 0;
+#endif
+
+   if (numThreads == 0) {
+      /* render the tiles here */
+      ctx = create_tile_context(&tile);
+      if (!ctx)
+         ok = GL_FALSE;
+   }
+
+   for (s = 0; s < NumStrips && (numThreads || ctx); s++) {
+      const int slot = s % NUM_STRIPS;
+
+      if (ctx) {
+         int t;
+         for (t = s * TilesX; t < (s + 1) * TilesX; t++)
+            render_tile(t, tile);
+      }
+#ifdef PTHREADS
+      else {
+         GLboolean done;
+
+         pthread_mutex_lock(&TileMutex);
+         while (StripTiles[slot] < TilesX && TileWorkers > 0)
+            pthread_cond_wait(&StripReady, &TileMutex);
+         done = StripTiles[slot] == TilesX;
+         pthread_mutex_unlock(&TileMutex);
+         if (!done) {
+            /* all the workers failed */
+            ok = GL_FALSE;
+            break;
+         }
+      }
+#endif
+
+      if (ok) {
+         const int h = strip_height(s);
+         ok = write_bytes(f, filename, enc.data,
+                          encode_rows(&e, Strips[slot], h - 1, h, enc.data));
+      }
+
+#ifdef PTHREADS
+      pthread_mutex_lock(&TileMutex);
+      StripTiles[slot] = 0;
+      StripsWritten++;
+      pthread_cond_broadcast(&StripFree);
+      pthread_mutex_unlock(&TileMutex);
+#endif
+   }
+
+#ifdef PTHREADS
+   for (i = 0; i < numThreads; i++) {
+      pthread_join(threads[i], NULL);
+   }
+   free(threads);
+#endif
+
+   if (ctx)
+      destroy_tile_context(ctx, tile);
+
+   if (ok)
+      ok = write_bytes(f, filename, enc.data, end_image(&e, enc.data));
+   if (fclose(f) != 0 && ok) {
+      fprintf(stderr, "osdemo: error writing %s\n", filename);
+      ok = GL_FALSE;
+   }
+
+   t1 = get_time();
+
+   if (ok) {
+      printf("osdemo: %dx%d image in %d %dx%d tiles with %d threads, "
+             "%.2f s\n", Width, Height, TilesX * NumStrips, TileSize,
+             TileSize, numThreads ? numThreads : 1, t1 - t0);
+   }
+
+cleanup:
+   for (i = 0; i < NUM_STRIPS; i++)
+      free(Strips[i]);
+   free(enc.data);
+   return ok ? 0 : 1;
+}
 
 int
 main(int argc, char *argv[])
@@ -255,22 +1270,65 @@ main(int argc, char *argv[])
    if (argc < 2) {
       fprintf(stderr, "Usage:\n");
       fprintf(stderr, "  osdemo filename [width height]\n");
+      fprintf(stderr, "  osdemo -batch jobfile [-threads n] [-writers n] "
+              "[width height]\n");
+      fprintf(stderr, "  osdemo -tiled [-tile n] [-threads n] filename "
+              "width height\n");
+      fprintf(stderr, "The file name extension picks the format: "
+              ".tga, .ppm or .qoi\n");
       return 0;
    }
 
+   if (strcmp(argv[1], "-batch") == 0 && argc >= 3) {
+      int numThreads = 0, numWriters = -1;
+      int i = 3;
+
+      while (i + 1 < argc && argv[i][0] == '-') {
+         if (strcmp(argv[i], "-threads") == 0)
+            numThreads = atoi(argv[i + 1]);
+         else if (strcmp(argv[i], "-writers") == 0)
+            numWriters = atoi(argv[i + 1]);
+         else
+            break;
+         i += 2;
+      }
+      if (argc == i + 2) {
+         Width = atoi(argv[i]);
+         Height = atoi(argv[i + 1]);
+      }
+      return run_batch(argv[2], numThreads, numWriters);
+   }
+
+   if (strcmp(argv[1], "-tiled") == 0) {
+      int numThreads = 0;
+      int i = 2;
+
+      while (i + 1 < argc && argv[i][0] == '-') {
+         if (strcmp(argv[i], "-tile") == 0)
+            TileSize = atoi(argv[i + 1]);
+         else if (strcmp(argv[i], "-threads") == 0)
+            numThreads = atoi(argv[i + 1]);
+         else
+            break;
+         i += 2;
+      }
+      if (argc != i + 3 || TileSize < 1) {
+         fprintf(stderr, "osdemo: -tiled needs a filename, width and "
+                 "height\n");
+         return 1;
+      }
+      Width = atoi(argv[i + 1]);
+      Height = atoi(argv[i + 2]);
+      return run_tiled(argv[i], numThreads);
+   }
+
    filename = argv[1];
    if (argc == 4) {
       Width = atoi(argv[2]);
       Height = atoi(argv[3]);
    }
 
-   /* Create an RGBA-mode context */
-#if OSMESA_MAJOR_VERSION * 100 + OSMESA_MINOR_VERSION >= 305
-   /* specify Z, stencil, accum sizes */
-   ctx = OSMesaCreateContextExt( OSMESA_RGBA, 16, 0, 0, NULL );
-#else
-   ctx = OSMesaCreateContext( OSMESA_RGBA, NULL );
-#endif
+   ctx = create_context();
    if (!ctx) {
       printf("OSMesaCreateContext failed!\n");
       return 0;
@@ -298,14 +1356,13 @@ main(int argc, char *argv[])
       printf("Depth=%d Stencil=%d Accum=%d\n", z, s, a);
    }
 
-   render_image();
+   render_image(20.0, 0.0, NULL);
 
    if (filename != NULL) {
-#ifdef SAVE_TARGA
-      write_targa(filename, buffer, Width, Height);
-#else
-      write_ppm(filename, buffer, Width, Height);
-#endif
+      struct encode_buffer enc = { NULL, 0 };
+      printf("osdemo, writing image file\n");
+      write_image(filename, buffer, Width, Height, &enc);
+      free(enc.data);
    }
    else {
       printf("Specify a filename if you want to make an image file\n");
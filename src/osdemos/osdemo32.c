@@ -5,11 +5,21 @@
  * Compile with something like this:
  *
  * gcc osdemo32.c -I../../include -L../../lib -lglut -lGLU -lOSMesa32 -lm -o osdemo32
+ *
+ * Usage: osdemo32 [-sequence frames [-histogram]] [filename]
+ *
+ * With -sequence the camera orbits the scene over the given number of
+ * frames and the render, glFinish and float readback times of each frame
+ * are recorded, to profile long runs instead of a single cold frame.
+ * -histogram also prints a histogram of the frame times.  The filename
+ * gets the last frame.
  */
 
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
 #include "GL/osmesa.h"
 #include "glut_wrap.h"
 
@@ -20,9 +30,15 @@
 #define WIDTH 400
 #define HEIGHT 400
 
+#define HISTOGRAM_BINS 20
 
 
-static void render_image( void )
+
+/**
+ * Draw the scene, rotated by yrot degrees about the vertical axis.
+ * Doesn't wait for the rendering to finish.
+ */
+static void draw_scene( GLfloat yrot )
 {
    GLfloat light_ambient[] = { 0.0, 0.0, 0.0, 1.0 };
    GLfloat light_diffuse[] = { 1.0, 1.0, 1.0, 1.0 };
@@ -53,6 +69,7 @@ static void render_image( void )
 
    glPushMatrix();
    glRotatef(20.0, 1.0, 0.0, 0.0);
+   glRotatef(yrot, 0.0, 1.0, 0.0);
 
    /* red square */
    glPushMatrix();
@@ -118,13 +135,19 @@ static void render_image( void )
 
    glPopMatrix();
 
+   gluDeleteQuadric(qobj);
+}
+
+
+static void render_image( void )
+{
+   draw_scene(0.0);
+
    /* This is very important!!!
     * Make sure buffered commands are finished!!!
     */
    glFinish();
 
-   gluDeleteQuadric(qobj);
-
    {
       GLint r, g, b, a, d;
       glGetIntegerv(GL_RED_BITS, &r);
@@ -247,9 +270,155 @@ write_ppm(const char *filename, const GLfloat *buffer, int width, int height)
 
 
 
+static double
+current_time_ms(void)
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+
+static int
+compare_double(const void *a, const void *b)
+{
+   const double x = *(const double *) a, y = *(const double *) b;
+   return x < y ? -1 : x > y;
+}
+
+
+/** Print min/median/mean/p95/max of n times, sorted in place */
+static void
+print_times(const char *name, double *times, int n)
+{
+   double sum = 0.0;
+   int i;
+
+   qsort(times, n, sizeof(double), compare_double);
+   for (i = 0; i < n; i++)
+      sum += times[i];
+
+   printf("  %-9s min %8.3f  median %8.3f  mean %8.3f  p95 %8.3f"
+          "  max %8.3f ms\n", name, times[0], times[n / 2], sum / n,
+          times[(n * 95) / 100], times[n - 1]);
+}
+
+
+/** Print a histogram of n sorted times */
+static void
+print_histogram(const double *times, int n)
+{
+   const double lo = times[0], hi = times[n - 1];
+   const double width = (hi - lo) / HISTOGRAM_BINS;
+   int counts[HISTOGRAM_BINS];
+   int i, maxCount = 0;
+
+   memset(counts, 0, sizeof(counts));
+   for (i = 0; i < n; i++) {
+      int bin = width > 0.0 ? (int) ((times[i] - lo) / width) : 0;
+      if (bin >= HISTOGRAM_BINS)
+         bin = HISTOGRAM_BINS - 1;
+      counts[bin]++;
+   }
+   for (i = 0; i < HISTOGRAM_BINS; i++) {
+      if (counts[i] > maxCount)
+         maxCount = counts[i];
+   }
+
+   printf("frame time histogram:\n");
+   for (i = 0; i < HISTOGRAM_BINS; i++) {
+      int bar = (counts[i] * 50 + maxCount - 1) / maxCount;
+      printf("  %8.3f - %8.3f ms %6d |", lo + i * width, lo + (i + 1) * width,
+             counts[i]);
+      while (bar-- > 0)
+         putchar('#');
+      putchar('\n');
+      if (width <= 0.0)
+         break;
+   }
+}
+
+
+/**
+ * Render numFrames frames of a camera orbit around the scene, timing
+ * issuing the commands, glFinish and reading the float color buffer back
+ * for each frame.  The first, cold frame is reported on its own.
+ */
+static int
+render_sequence(int numFrames, GLboolean histogram)
+{
+   GLfloat *readback = (GLfloat *) malloc(WIDTH * HEIGHT * 4 * sizeof(GLfloat));
+   double *times = (double *) malloc(4 * numFrames * sizeof(double));
+   double *render = times, *finish = times + numFrames;
+   double *read = times + 2 * numFrames, *total = times + 3 * numFrames;
+   double start, elapsed;
+   int i;
+
+   if (!readback || !times) {
+      printf("Alloc sequence buffers failed!\n");
+      free(readback);
+      free(times);
+      return 0;
+   }
+
+   start = current_time_ms();
+   for (i = 0; i < numFrames; i++) {
+      double t0, t1, t2, t3;
+
+      t0 = current_time_ms();
+      draw_scene(360.0 * i / numFrames);
+      t1 = current_time_ms();
+      glFinish();
+      t2 = current_time_ms();
+      glReadPixels(0, 0, WIDTH, HEIGHT, GL_RGBA, GL_FLOAT, readback);
+      t3 = current_time_ms();
+
+      render[i] = t1 - t0;
+      finish[i] = t2 - t1;
+      read[i] = t3 - t2;
+      total[i] = t3 - t0;
+   }
+
+   elapsed = current_time_ms() - start;
+
+   printf("%d frames (%dx%d float RGBA) in %.1f ms, %.1f frames/s\n",
+          numFrames, WIDTH, HEIGHT, elapsed, numFrames * 1000.0 / elapsed);
+   printf("first frame: render %.3f  finish %.3f  readback %.3f"
+          "  total %.3f ms\n", render[0], finish[0], read[0], total[0]);
+
+   if (numFrames > 1) {
+      printf("frames 2-%d:\n", numFrames);
+      print_times("render", render + 1, numFrames - 1);
+      print_times("finish", finish + 1, numFrames - 1);
+      print_times("readback", read + 1, numFrames - 1);
+      print_times("total", total + 1, numFrames - 1);
+      if (histogram)
+         print_histogram(total + 1, numFrames - 1);
+   }
+
+   free(readback);
+   free(times);
+   return 1;
+}
+
+
+
 int main( int argc, char *argv[] )
 {
    GLfloat *buffer;
+   const char *filename = NULL;
+   int numFrames = 0;
+   GLboolean histogram = GL_FALSE;
+   int i;
+
+   for (i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "-sequence") == 0 && i + 1 < argc)
+         numFrames = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-histogram") == 0)
+         histogram = GL_TRUE;
+      else
+         filename = argv[i];
+   }
 
    /* Create an RGBA-mode context */
 #if OSMESA_MAJOR_VERSION * 100 + OSMESA_MINOR_VERSION >= 305
@@ -276,13 +445,19 @@ int main( int argc, char *argv[] )
       return 0;
    }
      
-   render_image();
+   if (numFrames > 0) {
+      if (!render_sequence(numFrames, histogram))
+         return 0;
+   }
+   else {
+      render_image();
+   }
 
-   if (argc>1) {
+   if (filename) {
 #ifdef SAVE_TARGA
-      write_targa(argv[1], buffer, WIDTH, HEIGHT);
+      write_targa(filename, buffer, WIDTH, HEIGHT);
 #else
-      write_ppm(argv[1], buffer, WIDTH, HEIGHT);
+      write_ppm(filename, buffer, WIDTH, HEIGHT);
 #endif
    }
    else {
@@ -0,0 +1,317 @@
+/*
+ * Copyright (C) 2009  VMware, Inc.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * VMWARE BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+ * AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Compare perf results against a baseline results file (as written with
+ * -json or -csv) and report regressions.
+ */
+
+#include "common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/** Allowed drop in percent before a result counts as a regression */
+double PerfRegressionThreshold = 5.0;
+
+
+struct baseline_entry
+{
+   char *test, *mode, *params;
+   double value, ci_low, ci_high;
+};
+
+static struct baseline_entry *Baseline = NULL;
+static unsigned NumBaseline = 0, MaxBaseline = 0;
+static unsigned NumCompared = 0, NumRegressions = 0;
+static int BaselineLoaded = 0;
+
+
+static char *
+CopyString(const char *s, size_t len)
+{
+   char *str = malloc(len + 1);
+   memcpy(str, s, len);
+   str[len] = 0;
+   return str;
+}
+
+
+/**
+ * Parse a quoted JSON or CSV string starting at 's' (at the opening
+ * quote).  Return a malloc'd copy and set *end past the closing quote.
+ */
+static char *
+ParseString(const char *s, int csv, const char **end)
+{
+   char *str = malloc(strlen(s) + 1);
+   char *d = str;
+
+   s++;
+   while (*s) {
+      if (*s == '"') {
+         if (csv && s[1] == '"') {
+            *d++ = '"';
+            s += 2;
+            continue;
+         }
+         s++;
+         break;
+      }
+      if (!csv && *s == '\\' && s[1]) {
+         s++;
+         if (*s == 'u') {
+            *d++ = (char) strtol(s + 1, NULL, 16);
+            s += strlen(s) >= 5 ? 5 : strlen(s);
+            continue;
+         }
+      }
+      *d++ = *s++;
+   }
+   *d = 0;
+   *end = s;
+   return str;
+}
+
+
+/** Find "key": in a JSON line and return a pointer to its value */
+static const char *
+FindJSONKey(const char *line, const char *key)
+{
+   char pattern[40];
+   const char *p;
+
+   snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+   p = strstr(line, pattern);
+   if (!p)
+      return NULL;
+   p += strlen(pattern);
+   while (*p == ' ')
+      p++;
+   return p;
+}
+
+
+static char *
+JSONString(const char *line, const char *key)
+{
+   const char *p = FindJSONKey(line, key), *end;
+   if (!p || *p != '"')
+      return CopyString("", 0);
+   return ParseString(p, 0, &end);
+}
+
+
+static double
+JSONNumber(const char *line, const char *key)
+{
+   const char *p = FindJSONKey(line, key);
+   return p ? atof(p) : 0.0;
+}
+
+
+static struct baseline_entry *
+NewEntry(void)
+{
+   if (NumBaseline == MaxBaseline) {
+      MaxBaseline = MaxBaseline ? MaxBaseline * 2 : 64;
+      Baseline = realloc(Baseline, MaxBaseline * sizeof(*Baseline));
+   }
+   return &Baseline[NumBaseline++];
+}
+
+
+/**
+ * Split a CSV line into at most 'max' fields.  Quoted fields are
+ * unquoted, all fields are malloc'd.  Return the number of fields.
+ */
+static unsigned
+SplitCSV(const char *line, char **fields, unsigned max)
+{
+   unsigned n = 0;
+   const char *p = line;
+
+   while (n < max && *p && *p != '\n' && *p != '\r') {
+      if (*p == '"') {
+         fields[n++] = ParseString(p, 1, &p);
+      }
+      else {
+         size_t len = strcspn(p, ",\r\n");
+         fields[n++] = CopyString(p, len);
+         p += len;
+      }
+      if (*p == ',')
+         p++;
+   }
+   return n;
+}
+
+
+#define MAX_CSV_FIELDS 32
+
+static int
+FieldIndex(char **header, unsigned n, const char *name)
+{
+   unsigned i;
+   for (i = 0; i < n; i++) {
+      if (strcmp(header[i], name) == 0)
+         return i;
+   }
+   return -1;
+}
+
+
+/**
+ * Load a baseline from a results file.  Lines starting with '{' are
+ * read as JSON records, anything else as CSV with a header line.
+ */
+void
+PerfLoadBaseline(const char *filename)
+{
+   char line[4096];
+   char *header[MAX_CSV_FIELDS];
+   unsigned numHeader = 0, i;
+   FILE *f = fopen(filename, "r");
+
+   if (!f) {
+      fprintf(stderr, "Error: couldn't open baseline %s\n", filename);
+      exit(1);
+   }
+
+   while (fgets(line, sizeof(line), f)) {
+      if (line[0] == '{') {
+         struct baseline_entry *e = NewEntry();
+         e->test = JSONString(line, "test");
+         e->mode = JSONString(line, "mode");
+         e->params = JSONString(line, "params");
+         e->value = JSONNumber(line, "value");
+         e->ci_low = JSONNumber(line, "ci_low");
+         e->ci_high = JSONNumber(line, "ci_high");
+      }
+      else if (numHeader == 0) {
+         numHeader = SplitCSV(line, header, MAX_CSV_FIELDS);
+      }
+      else if (strncmp(line, "test,", 5) != 0) {
+         char *fields[MAX_CSV_FIELDS];
+         const unsigned n = SplitCSV(line, fields, MAX_CSV_FIELDS);
+         const int test = FieldIndex(header, numHeader, "test");
+         const int mode = FieldIndex(header, numHeader, "mode");
+         const int params = FieldIndex(header, numHeader, "params");
+         const int value = FieldIndex(header, numHeader, "value");
+         const int low = FieldIndex(header, numHeader, "ci_low");
+         const int high = FieldIndex(header, numHeader, "ci_high");
+
+         if (test >= 0 && mode >= 0 && params >= 0 && value >= 0 &&
+             (unsigned) test < n && (unsigned) mode < n &&
+             (unsigned) params < n && (unsigned) value < n) {
+            struct baseline_entry *e = NewEntry();
+            e->test = CopyString(fields[test], strlen(fields[test]));
+            e->mode = CopyString(fields[mode], strlen(fields[mode]));
+            e->params = CopyString(fields[params], strlen(fields[params]));
+            e->value = atof(fields[value]);
+            e->ci_low = (low >= 0 && (unsigned) low < n) ?
+               atof(fields[low]) : 0.0;
+            e->ci_high = (high >= 0 && (unsigned) high < n) ?
+               atof(fields[high]) : 0.0;
+         }
+         for (i = 0; i < n; i++)
+            free(fields[i]);
+      }
+   }
+   fclose(f);
+
+   for (i = 0; i < numHeader; i++)
+      free(header[i]);
+
+   BaselineLoaded = 1;
+}
+
+
+/**
+ * Print the baseline comparison summary.  Return the number of
+ * regressions, 0 if no baseline was loaded.
+ */
+unsigned
+PerfReportBaseline(void)
+{
+   if (!BaselineLoaded)
+      return 0;
+
+   perf_printf("perf: %u results compared against baseline, "
+               "%u regressions (threshold %.1f%%)\n",
+               NumCompared, NumRegressions, PerfRegressionThreshold);
+   return NumRegressions;
+}
+
+
+/**
+ * Compare one result with the baseline.  A result regressed if it
+ * dropped by more than PerfRegressionThreshold percent and, when both
+ * runs have confidence intervals, the intervals don't overlap, so noisy
+ * results aren't flagged.  If the baseline has several records for the
+ * same test the most recent one is used.  For costs ('lower_is_better')
+ * a rise counts as a drop.
+ */
+void
+PerfCompareBaseline(const char *test, const char *mode, const char *params,
+                    double value, double ci_low, double ci_high,
+                    int lower_is_better)
+{
+   const struct baseline_entry *base = NULL;
+   double change;
+   unsigned i;
+
+   for (i = NumBaseline; i-- > 0; ) {
+      const struct baseline_entry *e = &Baseline[i];
+      if (strcmp(e->test, test) == 0 && strcmp(e->mode, mode) == 0 &&
+          strcmp(e->params, params) == 0) {
+         base = e;
+         break;
+      }
+   }
+
+   if (!base || base->value <= 0.0)
+      return;
+
+   NumCompared++;
+   change = 100.0 * (value - base->value) / base->value;
+
+   if (lower_is_better) {
+      if (change > PerfRegressionThreshold &&
+          (base->ci_high <= 0.0 || ci_low <= 0.0 || ci_low > base->ci_high)) {
+         perf_printf("    REGRESSION %s %s%s%s: %.4g -> %.4g (+%.1f%%)\n",
+                     test, mode, params[0] ? " " : "", params,
+                     base->value, value, change);
+         NumRegressions++;
+      }
+      return;
+   }
+
+   if (change < -PerfRegressionThreshold &&
+       (base->ci_low <= 0.0 || ci_high <= 0.0 || ci_high < base->ci_low)) {
+      perf_printf("    REGRESSION %s %s%s%s: %.4g -> %.4g (%.1f%%)\n",
+                  test, mode, params[0] ? " " : "", params,
+                  base->value, value, change);
+      NumRegressions++;
+   }
+}
@@ -29,9 +29,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
+#include <math.h>
 
 #if defined(_MSC_VER)
 #define snprintf _snprintf
+#define vsnprintf _vsnprintf
 #endif
 
 
@@ -53,67 +56,683 @@ perf_printf(const char *format, ...)
 
 
 
+struct perf_sample_policy PerfSamplePolicy = {
+   2,      /* warmup */
+   9,      /* samples */
+   0.2,    /* sample_time */
+   3.0,    /* outlier_k */
+   0.95,   /* confidence */
+   0,      /* gpu_timing */
+   0       /* verbose */
+};
+
+static struct perf_stats LastStats;
+
+/** Statistics of the submission rates, see PerfFinish() */
+static struct perf_stats SubmitStats;
+
+/** Time of the last PerfFinish() call, 0 if none in this sample */
+static double SubmitEnd = 0.0;
+
+const char *PerfTestFilter = NULL;
+
+int PerfSweep = 0;
+
+/** Structured results sink, see PerfRecordResult() */
+static FILE *ResultsFile = NULL;
+static int ResultsCSV = 0;
+static char TestName[100] = "perf";
+
+
+/** Statistics of the most recent PerfMeasureRate() call */
+const struct perf_stats *
+PerfLastStats(void)
+{
+   return &LastStats;
+}
+
+
+static void
+CloseResults(void)
+{
+   if (ResultsFile) {
+      fclose(ResultsFile);
+      ResultsFile = NULL;
+   }
+}
+
+
+/**
+ * Normal end of a test: close the results and compare them against the
+ * -baseline, then exit with 'status', or 2 if a result regressed.
+ */
+void
+PerfExit(int status)
+{
+   CloseResults();
+   if (PerfReportBaseline() && status == 0)
+      status = 2;
+   exit(status);
+}
+
+
+/**
+ * Open the results file in append mode so several runs can share it.
+ * A CSV header is written when the file is empty.
+ */
+static void
+OpenResults(const char *filename, int csv)
+{
+   CloseResults();
+
+   ResultsFile = fopen(filename, "a");
+   if (!ResultsFile) {
+      fprintf(stderr, "Error: couldn't open %s for writing\n", filename);
+      exit(1);
+   }
+   ResultsCSV = csv;
+
+   fseek(ResultsFile, 0, SEEK_END);
+   if (csv && ftell(ResultsFile) == 0)
+      fprintf(ResultsFile,
+              "test,mode,params,value,units,renderer,median,p5,p95,"
+              "stddev,ci_low,ci_high,samples,outliers,iters,gpu_median,"
+              "submit_median\n");
+
+   atexit(CloseResults);
+}
+
+
+/**
+ * Parse the count argument of option 'opt', exiting with a usage error
+ * if it isn't an integer of at least 'min'.
+ */
+static unsigned
+ParseCount(const char *opt, const char *arg, long min)
+{
+   char *end;
+   long val = strtol(arg, &end, 10);
+
+   if (end == arg || *end != '\0' || val < min || val > 1000000000L) {
+      fprintf(stderr, "Error: %s expects an integer >= %ld, got '%s'\n",
+              opt, min, arg);
+      exit(1);
+   }
+   return (unsigned) val;
+}
+
+
+/**
+ * Parse the numeric argument of option 'opt', exiting with a usage error
+ * if it isn't a finite number of at least 'min'.
+ */
+static double
+ParseValue(const char *opt, const char *arg, double min)
+{
+   char *end;
+   double val = strtod(arg, &end);
+
+   if (end == arg || *end != '\0' || !(val >= min) || val > 1e9) {
+      fprintf(stderr, "Error: %s expects a number >= %g, got '%s'\n",
+              opt, min, arg);
+      exit(1);
+   }
+   return val;
+}
+
+
+/**
+ * Handle a sample policy or results option at argv[0].
+ * Return the number of arguments consumed, 0 if not ours.
+ */
+int
+PerfParseOption(int argc, char *argv[])
+{
+   if (strcmp(argv[0], "-stats") == 0) {
+      PerfSamplePolicy.verbose = 1;
+      return 1;
+   }
+
+   if (strcmp(argv[0], "-gputime") == 0) {
+      PerfSamplePolicy.gpu_timing = 1;
+      return 1;
+   }
+
+   if (strcmp(argv[0], "-sweep") == 0) {
+      PerfSweep = 1;
+      return 1;
+   }
+
+   if (argc < 2)
+      return 0;
+
+   if (strcmp(argv[0], "-filter") == 0 || strcmp(argv[0], "--filter") == 0) {
+      PerfTestFilter = argv[1];
+      return 2;
+   }
+
+   if (strcmp(argv[0], "-json") == 0 || strcmp(argv[0], "-csv") == 0) {
+      OpenResults(argv[1], argv[0][1] == 'c');
+      return 2;
+   }
+
+   if (strcmp(argv[0], "-baseline") == 0) {
+      PerfLoadBaseline(argv[1]);
+      return 2;
+   }
+
+   if (strcmp(argv[0], "-threshold") == 0) {
+      PerfRegressionThreshold = ParseValue(argv[0], argv[1], 0.0);
+      return 2;
+   }
+
+   if (strcmp(argv[0], "-warmup") == 0)
+      PerfSamplePolicy.warmup = ParseCount(argv[0], argv[1], 0);
+   else if (strcmp(argv[0], "-samples") == 0)
+      PerfSamplePolicy.samples = ParseCount(argv[0], argv[1], 1);
+   else if (strcmp(argv[0], "-sampletime") == 0)
+      PerfSamplePolicy.sample_time = ParseValue(argv[0], argv[1], 0.0);
+   else if (strcmp(argv[0], "-outlier") == 0)
+      PerfSamplePolicy.outlier_k = ParseValue(argv[0], argv[1], 0.0);
+   else if (strcmp(argv[0], "-confidence") == 0)
+      PerfSamplePolicy.confidence = ParseValue(argv[0], argv[1], 0.0);
+   else
+      return 0;
+
+   if (PerfSamplePolicy.sample_time <= 0.0)
+      PerfSamplePolicy.sample_time = 0.2;
+   if (PerfSamplePolicy.confidence <= 0.0 ||
+       PerfSamplePolicy.confidence >= 1.0)
+      PerfSamplePolicy.confidence = 0.95;
+
+   return 2;
+}
+
+
+static int
+CompareDouble(const void *a, const void *b)
+{
+   const double x = *(const double *) a, y = *(const double *) b;
+   return (x > y) - (x < y);
+}
+
+
+/** Linear-interpolated percentile (0..1) of a sorted array */
+static double
+Percentile(const double *sorted, unsigned n, double p)
+{
+   double pos = p * (n - 1);
+   unsigned i = (unsigned) pos;
+
+   if (i + 1 >= n)
+      return sorted[n - 1];
+   return sorted[i] + (pos - i) * (sorted[i + 1] - sorted[i]);
+}
+
+
+/** Small LCG so the bootstrap doesn't disturb the tests' use of rand() */
+static unsigned
+NextRandom(unsigned *seed)
+{
+   *seed = *seed * 1103515245u + 12345u;
+   return *seed >> 8;
+}
+
+
+/**
+ * Percentile bootstrap confidence interval of the median of 'x'.
+ */
+static void
+BootstrapMedian(const double *x, unsigned n, double confidence,
+                double *low, double *high)
+{
+   const unsigned rounds = 1000;
+   double *medians = malloc(rounds * sizeof(double));
+   double *resample = malloc(n * sizeof(double));
+   unsigned seed = 1, r, i;
+
+   for (r = 0; r < rounds; r++) {
+      for (i = 0; i < n; i++)
+         resample[i] = x[NextRandom(&seed) % n];
+      qsort(resample, n, sizeof(double), CompareDouble);
+      medians[r] = Percentile(resample, n, 0.5);
+   }
+   qsort(medians, rounds, sizeof(double), CompareDouble);
+
+   *low = Percentile(medians, rounds, 0.5 * (1.0 - confidence));
+   *high = Percentile(medians, rounds, 0.5 * (1.0 + confidence));
+
+   free(resample);
+   free(medians);
+}
+
+
+/**
+ * Compute 'st' from the per-sample rates, dropping samples further
+ * than outlier_k median absolute deviations from the median.
+ */
+static void
+ComputeStats(struct perf_stats *st, double *rates, unsigned n,
+             unsigned iters)
+{
+   double *dev = malloc(n * sizeof(double));
+   double median, mad, sum, sumsq;
+   unsigned i, kept;
+
+   qsort(rates, n, sizeof(double), CompareDouble);
+   median = Percentile(rates, n, 0.5);
+
+   for (i = 0; i < n; i++)
+      dev[i] = fabs(rates[i] - median);
+   qsort(dev, n, sizeof(double), CompareDouble);
+   /* scale MAD to be a consistent estimator of the std deviation */
+   mad = 1.4826 * Percentile(dev, n, 0.5);
+   free(dev);
+
+   kept = 0;
+   for (i = 0; i < n; i++) {
+      if (PerfSamplePolicy.outlier_k > 0.0 && mad > 0.0 &&
+          fabs(rates[i] - median) > PerfSamplePolicy.outlier_k * mad)
+         continue;
+      rates[kept++] = rates[i];
+   }
+
+   sum = sumsq = 0.0;
+   for (i = 0; i < kept; i++) {
+      sum += rates[i];
+      sumsq += rates[i] * rates[i];
+   }
+
+   st->samples = kept;
+   st->outliers = n - kept;
+   st->iters = iters;
+   st->mean = sum / kept;
+   st->stddev = 0.0;
+   if (kept > 1) {
+      const double var = (sumsq - sum * st->mean) / (kept - 1);
+      if (var > 0.0)
+         st->stddev = sqrt(var);
+   }
+   st->min = rates[0];
+   st->max = rates[kept - 1];
+   st->median = Percentile(rates, kept, 0.5);
+   st->p5 = Percentile(rates, kept, 0.05);
+   st->p95 = Percentile(rates, kept, 0.95);
+   BootstrapMedian(rates, kept, PerfSamplePolicy.confidence,
+                   &st->ci_low, &st->ci_high);
+}
+
+
 /**
- * Run function 'f' for enough iterations to reach a steady state.
- * Return the rate (iterations/second).
+ * Scale 'iters' so that 'elapsed' becomes 'target'.  The step is limited
+ * since some test functions do count-1 iterations and take almost no
+ * time for small counts.
+ */
+static unsigned
+ScaleIters(unsigned iters, double elapsed, double target)
+{
+   const double maxIters = 1u << 30, maxStep = 16.0;
+   double est;
+
+   if (elapsed <= 0.0)
+      est = iters * maxStep;
+   else
+      est = floor(iters * target / elapsed + 0.5);
+
+   if (est > iters * maxStep)
+      est = iters * maxStep;
+   if (est > maxIters)
+      est = maxIters;
+   if (est < 1.0)
+      est = 1.0;
+   return (unsigned) est;
+}
+
+
+/**
+ * Find an iteration count for which one call of 'f' takes about
+ * sample_time seconds.  The doubling search gives a first estimate
+ * which is then checked, since one-off costs (shader compiles, buffer
+ * allocations) can make a short early call look slow.
+ */
+static unsigned
+CalibrateIters(PerfRateFunc f)
+{
+   const double target = PerfSamplePolicy.sample_time;
+   unsigned iters = 1, tries;
+   double t0, t1;
+
+   /* keep one-time setup costs of the first call out of the estimate */
+   f(1);
+
+   while (1) {
+      t0 = PerfGetTime();
+      f(iters);
+      t1 = PerfGetTime();
+
+      if (t1 - t0 >= 0.1 * target || iters >= (1u << 30))
+         break;
+      iters *= 2;
+   }
+
+   for (tries = 0; tries < 4; tries++) {
+      iters = ScaleIters(iters, t1 - t0, target);
+
+      t0 = PerfGetTime();
+      f(iters);
+      t1 = PerfGetTime();
+
+      if (t1 - t0 >= 0.5 * target && t1 - t0 <= 2.0 * target)
+         break;
+   }
+
+   return iters;
+}
+
+
+/**
+ * Run function 'f' for PerfSamplePolicy.warmup untimed and
+ * PerfSamplePolicy.samples timed samples of roughly equal duration.
+ * Return the median rate (iterations/second); the full statistics are
+ * available from PerfLastStats().
  */
 double
 PerfMeasureRate(PerfRateFunc f)
 {
-   const double minDuration = 1.0;
-   double rate = 0.0, prevRate = 0.0;
-   unsigned subiters;
+   const unsigned n = PerfSamplePolicy.samples;
+   const int gpu = PerfSamplePolicy.gpu_timing && PerfGpuTimerSupported();
+   double *rates = malloc(n * sizeof(double));
+   double *submitRates = malloc(n * sizeof(double));
+   unsigned iters, i, submitted = 0;
 
-   /* Compute initial number of iterations to try.
-    * If the test function is pretty slow this helps to avoid
-    * extraordarily long run times.
-    */
-   subiters = 2;
-   {
+   iters = CalibrateIters(f);
+
+   for (i = 0; i < PerfSamplePolicy.warmup; i++)
+      f(iters);
+
+   for (i = 0; i < n; i++) {
       const double t0 = PerfGetTime();
       double t1;
-      do {
-         f(subiters); /* call the rendering function */
-         t1 = PerfGetTime();
-         subiters *= 2;
-      } while (t1 - t0 < 0.1 * minDuration);
+
+      SubmitEnd = 0.0;
+      if (gpu)
+         PerfGpuTimerBegin(i);
+      f(iters);
+      if (gpu)
+         PerfGpuTimerEnd(i);
+      t1 = PerfGetTime();
+
+      /* guard against timer granularity on very short samples */
+      if (t1 - t0 < 1e-6)
+         t1 = t0 + 1e-6;
+      rates[i] = iters / (t1 - t0);
+
+      if (SubmitEnd >= t0) {
+         const double t = SubmitEnd - t0;
+         submitRates[submitted++] = iters / (t > 1e-6 ? t : 1e-6);
+      }
    }
-   /*perf_printf("initial subIters = %u\n", subiters);*/
 
-   while (1) {
-      const double t0 = PerfGetTime();
-      unsigned iters = 0;
-      double t1;
+   ComputeStats(&LastStats, rates, n, iters);
+
+   /* only when every sample went through PerfFinish() */
+   memset(&SubmitStats, 0, sizeof(SubmitStats));
+   if (submitted == n)
+      ComputeStats(&SubmitStats, submitRates, n, iters);
+   LastStats.submit_median = SubmitStats.median;
+   free(submitRates);
+
+   LastStats.gpu_median = LastStats.gpu_p5 = LastStats.gpu_p95 = 0.0;
+   if (gpu) {
+      const double *times = PerfGpuTimerResults(n);
+      for (i = 0; i < n; i++)
+         rates[i] = iters / (times[i] > 1e-9 ? times[i] : 1e-9);
+      qsort(rates, n, sizeof(double), CompareDouble);
+      LastStats.gpu_median = Percentile(rates, n, 0.5);
+      LastStats.gpu_p5 = Percentile(rates, n, 0.05);
+      LastStats.gpu_p95 = Percentile(rates, n, 0.95);
+   }
+   free(rates);
+
+   if (PerfSamplePolicy.verbose) {
+      const struct perf_stats *st = &LastStats;
+      perf_printf("    [median %.4g/s, p5 %.4g, p95 %.4g, stddev %.2f%%, "
+                  "%.0f%% CI [%.4g, %.4g], %u samples x %u iters, "
+                  "%u outliers]\n",
+                  st->median, st->p5, st->p95,
+                  st->median > 0.0 ? 100.0 * st->stddev / st->median : 0.0,
+                  100.0 * PerfSamplePolicy.confidence,
+                  st->ci_low, st->ci_high,
+                  st->samples, st->iters, st->outliers);
+   }
+
+   /* The CPU rate includes the test's glFinish, so it's bounded by both
+    * submission and execution.  The submit rate stops at PerfFinish()
+    * and the GPU rate is execution only, so together they show which
+    * side limits the test.
+    */
+   if (gpu || (PerfSamplePolicy.verbose && LastStats.submit_median > 0.0)) {
+      const struct perf_stats *st = &LastStats;
+      perf_printf("    [cpu %.4g/s", st->median);
+      if (st->submit_median > 0.0)
+         perf_printf(", submit %.4g/s", st->submit_median);
+      if (gpu)
+         perf_printf(", gpu %.4g/s (p5 %.4g, p95 %.4g), gpu busy %.0f%%",
+                     st->gpu_median, st->gpu_p5, st->gpu_p95,
+                     st->gpu_median > 0.0 ?
+                     100.0 * st->median / st->gpu_median : 0.0);
+      perf_printf("]\n");
+   }
+
+   return LastStats.median;
+}
+
+
+/**
+ * End of command submission in a PerfMeasureRate() test function: note
+ * the time, then wait for the GPU.  Test functions should call this
+ * instead of glFinish() so the submission rate can be reported.
+ */
+void
+PerfFinish(void)
+{
+   SubmitEnd = PerfGetTime();
+   glFinish();
+}
 
-      do {
-         f(subiters); /* call the rendering function */
-         t1 = PerfGetTime();
-         iters += subiters;
-      } while (t1 - t0 < minDuration);
-
-      rate = iters / (t1 - t0);
-
-      if (0)
-         perf_printf("prevRate %f  rate  %f  ratio %f  iters %u\n",
-                prevRate, rate, rate/prevRate, iters);
-
-      /* Try and speed the search up by skipping a few steps:
-       */
-      if (rate > prevRate * 1.6)
-         subiters *= 8;
-      else if (rate > prevRate * 1.2)
-         subiters *= 4;
-      else if (rate > prevRate * 1.05)
-         subiters *= 2;
+
+/**
+ * Statistics of the submission rates of the last PerfMeasureRate()
+ * call, with samples = 0 if the test function doesn't use PerfFinish().
+ */
+const struct perf_stats *
+PerfLastSubmitStats(void)
+{
+   return &SubmitStats;
+}
+
+
+/** Set the test name used in results, from the program path */
+void
+PerfSetTestName(const char *name)
+{
+   const char *base = strrchr(name, '/');
+   if (!base)
+      base = strrchr(name, '\\');
+   snprintf(TestName, sizeof(TestName), "%s", base ? base + 1 : name);
+}
+
+
+/** Write a string as a quoted JSON or CSV field */
+static void
+WriteString(const char *str)
+{
+   const char *c;
+
+   fputc('"', ResultsFile);
+   for (c = str; *c; c++) {
+      if (ResultsCSV) {
+         if (*c == '"')
+            fputc('"', ResultsFile);
+         fputc(*c, ResultsFile);
+      }
+      else if (*c == '"' || *c == '\\')
+         fprintf(ResultsFile, "\\%c", *c);
+      else if ((unsigned char) *c < 0x20)
+         fprintf(ResultsFile, "\\u%04x", *c);
       else
-         break;
+         fputc(*c, ResultsFile);
+   }
+   fputc('"', ResultsFile);
+}
 
-      prevRate = rate;
+
+/** Write one record with statistics 'st' scaled by 'scale' */
+static void
+WriteRecord(const char *mode, double value, const char *units,
+            const char *params, const struct perf_stats *st, double scale)
+{
+   if (ResultsCSV) {
+      WriteString(TestName);
+      fputc(',', ResultsFile);
+      WriteString(mode);
+      fputc(',', ResultsFile);
+      WriteString(params);
+      fprintf(ResultsFile, ",%.6g,", value);
+      WriteString(units);
+      fputc(',', ResultsFile);
+      WriteString(PerfRendererString());
+      fprintf(ResultsFile,
+              ",%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%u,%u,%u,%.6g,%.6g\n",
+              st->median * scale, st->p5 * scale, st->p95 * scale,
+              st->stddev * scale, st->ci_low * scale, st->ci_high * scale,
+              st->samples, st->outliers, st->iters,
+              st->gpu_median * scale, st->submit_median * scale);
    }
+   else {
+      fprintf(ResultsFile, "{\"test\": ");
+      WriteString(TestName);
+      fprintf(ResultsFile, ", \"mode\": ");
+      WriteString(mode);
+      fprintf(ResultsFile, ", \"params\": ");
+      WriteString(params);
+      fprintf(ResultsFile, ", \"value\": %.6g, \"units\": ", value);
+      WriteString(units);
+      fprintf(ResultsFile, ", \"renderer\": ");
+      WriteString(PerfRendererString());
+      fprintf(ResultsFile,
+              ", \"median\": %.6g, \"p5\": %.6g, \"p95\": %.6g"
+              ", \"stddev\": %.6g, \"ci_low\": %.6g, \"ci_high\": %.6g"
+              ", \"samples\": %u, \"outliers\": %u, \"iters\": %u"
+              ", \"gpu_median\": %.6g, \"submit_median\": %.6g}\n",
+              st->median * scale, st->p5 * scale, st->p95 * scale,
+              st->stddev * scale, st->ci_low * scale, st->ci_high * scale,
+              st->samples, st->outliers, st->iters,
+              st->gpu_median * scale, st->submit_median * scale);
+   }
+   fflush(ResultsFile);
+}
+
+
+/**
+ * Record one result in the file given with -json or -csv and compare
+ * it with the -baseline results, if any.
+ * 'value' must be the last PerfMeasureRate() result times a constant
+ * (e.g. bytes per iteration), so the sample statistics can be reported
+ * in the same units.  'params' is a printf format for free-form
+ * parameters such as "size=%d".
+ */
+void
+PerfRecordResult(const char *mode, double value, const char *units,
+                 const char *params, ...)
+{
+   const struct perf_stats *st = &LastStats;
+   const double scale = (value > 0.0 && st->median > 0.0) ?
+      value / st->median : 0.0;
+   char paramStr[256];
+   va_list ap;
+
+   va_start(ap, params);
+   vsnprintf(paramStr, sizeof(paramStr), params, ap);
+   va_end(ap);
+
+   PerfCompareBaseline(TestName, mode, paramStr, value,
+                       st->ci_low * scale, st->ci_high * scale, 0);
+
+   if (ResultsFile)
+      WriteRecord(mode, value, units, paramStr, st, scale);
+}
+
+
+/**
+ * Like PerfRecordResult() but for a cost such as a time per call, which
+ * regresses when it grows.  The value isn't derived from the sample
+ * rates, so the record has no sample statistics.
+ */
+void
+PerfRecordCost(const char *mode, double value, const char *units,
+               const char *params, ...)
+{
+   static const struct perf_stats none;
+   char paramStr[256];
+   va_list ap;
+
+   va_start(ap, params);
+   vsnprintf(paramStr, sizeof(paramStr), params, ap);
+   va_end(ap);
+
+   PerfCompareBaseline(TestName, mode, paramStr, value, 0.0, 0.0, 1);
+
+   if (ResultsFile)
+      WriteRecord(mode, value, units, paramStr, &none, 0.0);
+}
+
+
+/**
+ * Record the submission cost of the last PerfMeasureRate() call, from
+ * the per-sample rates up to PerfFinish().  'per_iter' converts seconds
+ * per iteration to 'units' (1e9 for ns per call).  The rate statistics
+ * are inverted, so the record has the median, percentiles and interval
+ * of the cost.  Returns the median cost, 0 if nothing was measured.
+ */
+double
+PerfRecordSubmitCost(const char *mode, double per_iter, const char *units,
+                     const char *params, ...)
+{
+   const struct perf_stats *rate = &SubmitStats;
+   struct perf_stats cost;
+   char paramStr[256];
+   va_list ap;
+
+   if (rate->samples == 0 || rate->median <= 0.0 || rate->min <= 0.0)
+      return 0.0;
+
+   va_start(ap, params);
+   vsnprintf(paramStr, sizeof(paramStr), params, ap);
+   va_end(ap);
+
+   memset(&cost, 0, sizeof(cost));
+   cost.samples = rate->samples;
+   cost.outliers = rate->outliers;
+   cost.iters = rate->iters;
+   cost.median = per_iter / rate->median;
+   cost.mean = per_iter / rate->mean;
+   /* first order estimate, d(k/x) = k/x^2 dx */
+   cost.stddev = cost.median * rate->stddev / rate->median;
+   cost.min = per_iter / rate->max;
+   cost.max = per_iter / rate->min;
+   cost.p5 = per_iter / rate->p95;
+   cost.p95 = per_iter / rate->p5;
+   cost.ci_low = per_iter / rate->ci_high;
+   cost.ci_high = per_iter / rate->ci_low;
+
+   PerfCompareBaseline(TestName, mode, paramStr, cost.median,
+                       cost.ci_low, cost.ci_high, 1);
+
+   if (ResultsFile)
+      WriteRecord(mode, cost.median, units, paramStr, &cost, 1.0);
 
-   if (0)
-      perf_printf("%s returning iters %u  rate %f\n", __FUNCTION__, subiters, rate);
-   return rate;
+   return cost.median;
 }
 
 
@@ -30,9 +30,89 @@
 typedef void (*PerfRateFunc)(unsigned count);
 
 
+/** How PerfMeasureRate() samples a test function */
+struct perf_sample_policy
+{
+   unsigned warmup;       /**< untimed samples run first */
+   unsigned samples;      /**< timed samples */
+   double sample_time;    /**< target duration of one sample, in seconds */
+   double outlier_k;      /**< reject samples beyond k * MAD, 0 = keep all */
+   double confidence;     /**< level of the bootstrap interval, e.g. 0.95 */
+   int gpu_timing;        /**< also time samples with GPU timestamps */
+   int verbose;           /**< print the stats of each measurement */
+};
+
+/** Statistics of the last PerfMeasureRate() call, rates in iters/second */
+struct perf_stats
+{
+   unsigned samples;      /**< samples kept after outlier rejection */
+   unsigned outliers;     /**< samples rejected */
+   unsigned iters;        /**< iterations per sample */
+   double median, mean, stddev;
+   double min, max;
+   double p5, p95;
+   double ci_low, ci_high;   /**< bootstrap confidence interval of median */
+   double gpu_median;     /**< median rate by GPU time, 0 if not measured */
+   double gpu_p5, gpu_p95;
+   double submit_median;  /**< median rate up to PerfFinish(), 0 if unused */
+};
+
+extern struct perf_sample_policy PerfSamplePolicy;
+
+/** Allowed drop in percent vs. the -baseline results */
+extern double PerfRegressionThreshold;
+
+/** fnmatch pattern of the tests perfsuite should run, NULL = all */
+extern const char *PerfTestFilter;
+
+/** Run the format/type sweep instead of the regular tests, see -sweep */
+extern int PerfSweep;
+
+
 extern double
 PerfMeasureRate(PerfRateFunc f);
 
+extern const struct perf_stats *
+PerfLastStats(void);
+
+extern void
+PerfFinish(void);
+
+extern const struct perf_stats *
+PerfLastSubmitStats(void);
+
+extern int
+PerfParseOption(int argc, char *argv[]);
+
+extern void
+PerfSetTestName(const char *name);
+
+extern void
+PerfRecordResult(const char *mode, double value, const char *units,
+                 const char *params, ...);
+
+extern void
+PerfRecordCost(const char *mode, double value, const char *units,
+               const char *params, ...);
+
+extern double
+PerfRecordSubmitCost(const char *mode, double per_iter, const char *units,
+                     const char *params, ...);
+
+extern void
+PerfLoadBaseline(const char *filename);
+
+extern void
+PerfCompareBaseline(const char *test, const char *mode, const char *params,
+                    double value, double ci_low, double ci_high,
+                    int lower_is_better);
+
+extern unsigned
+PerfReportBaseline(void);
+
+extern void
+PerfExit(int status);
+
 const char *
 PerfHumanFloat( double d );
 
@@ -123,7 +123,7 @@ CopyTexImage(unsigned count)
       glCopyTexImage2D(GL_TEXTURE_2D, 0,
                        GL_RGBA, 0, 0, TexSize, TexSize, 0);
    }
-   glFinish();
+   PerfFinish();
 }
 
 
@@ -159,7 +159,7 @@ CopyTexSubImage(unsigned count)
                              0, 0, 0, 0, TexSize, TexSize);
       }
    }
-   glFinish();
+   PerfFinish();
 }
 
 
@@ -207,8 +207,10 @@ PerfDraw(void)
 
          perf_printf("  glCopyTex%sImage(%d x %d): %.1f copies/sec, %.1f Mpixels/sec\n",
                      (sub ? "Sub" : ""), TexSize, TexSize, rate, mbPerSec);
+         PerfRecordResult(sub ? "CopyTexSubImage" : "CopyTexImage",
+                          rate, "copies/sec", "size=%dx%d", TexSize, TexSize);
       }
    }
 
-   exit(0);
+   PerfExit(0);
 }
@@ -28,6 +28,13 @@
  *
  * All the window-system stuff should be contained in glmain.c (or TBDmain.c).
  *
+ * After the simple cases, a matrix of state change categories (blend,
+ * depth, texture, program, uniform, VAO, vertex format) crossed with the
+ * draw entry points (DrawArrays, DrawElements and their instanced and
+ * multi-draw variants) is measured and reported as nanoseconds of CPU
+ * time per draw call.  Only the submission loop of each timed sample is
+ * counted for those, not the glFinish() after it.
+ *
  * Brian Paul
  * 15 Sep 2009
  */
@@ -38,7 +45,11 @@
 
 int WinWidth = 100, WinHeight = 100;
 
-static GLuint VBO;
+static GLuint VBO, EBO;
+static GLuint VAO[2];
+static GLuint Tex[2];
+static GLuint Prog[2];
+static GLint ColorUniform;
 
 struct vertex
 {
@@ -52,21 +63,101 @@ static const struct vertex vertices[4] = {
    { -1.0,  1.0 }
 };
 
+/** Same vertices as GLshorts, stored after the floats in the VBO */
+static const GLshort short_vertices[4][2] = {
+   { -1, -1 },
+   {  1, -1 },
+   {  1,  1 },
+   { -1,  1 }
+};
+
+static const GLushort indices[4] = { 0, 1, 2, 3 };
+
+static const GLint multi_first[4] = { 0, 1, 2, 3 };
+static const GLsizei multi_count[4] = { 1, 1, 1, 1 };
+/** Byte offsets of the indices in the EBO */
+static const GLvoid *multi_indices[4] = {
+   (GLvoid *) 0, (GLvoid *) 2, (GLvoid *) 4, (GLvoid *) 6
+};
+
+static const char *VertexShader =
+   "void main() \n"
+   "{ \n"
+   "   gl_Position = ftransform(); \n"
+   "} \n";
+
+static const char *FragmentShader =
+   "uniform vec4 Color; \n"
+   "void main() \n"
+   "{ \n"
+   "   gl_FragColor = Color; \n"
+   "} \n";
+
+
+/** GL features needed by some of the matrix cases */
+#define NEED_GLSL       0x1
+#define NEED_VAO        0x2
+#define NEED_INSTANCED  0x4
+#define NEED_MULTIDRAW  0x8
+
+static unsigned Features;
+
 
 /** Called from test harness/main */
 void
 PerfInit(void)
 {
+   int i;
+
    /* setup VBO w/ vertex data */
    glGenBuffersARB(1, &VBO);
    glBindBufferARB(GL_ARRAY_BUFFER_ARB, VBO);
    glBufferDataARB(GL_ARRAY_BUFFER_ARB,
-                   sizeof(vertices), vertices, GL_STATIC_DRAW_ARB);
+                   sizeof(vertices) + sizeof(short_vertices),
+                   NULL, GL_STATIC_DRAW_ARB);
+   glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, 0, sizeof(vertices), vertices);
+   glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, sizeof(vertices),
+                      sizeof(short_vertices), short_vertices);
    glVertexPointer(2, GL_FLOAT, sizeof(struct vertex), (void *) 0);
    glEnableClientState(GL_VERTEX_ARRAY);
 
+   glGenBuffersARB(1, &EBO);
+   glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, EBO);
+   glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB,
+                   sizeof(indices), indices, GL_STATIC_DRAW_ARB);
+
    /* misc GL state */
    glAlphaFunc(GL_ALWAYS, 0.0);
+   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+   Tex[0] = PerfCheckerTexture(64, 64);
+   Tex[1] = PerfCheckerTexture(64, 64);
+   glBindTexture(GL_TEXTURE_2D, 0);
+
+   Features = 0;
+   if (GLEW_VERSION_1_4)
+      Features |= NEED_MULTIDRAW;
+   if (GLEW_VERSION_2_0) {
+      Features |= NEED_GLSL;
+      for (i = 0; i < 2; i++)
+         Prog[i] = PerfShaderProgram(VertexShader, FragmentShader);
+      ColorUniform = glGetUniformLocation(Prog[0], "Color");
+   }
+   if (GLEW_VERSION_3_1)
+      Features |= NEED_INSTANCED;
+   if (GLEW_VERSION_3_0 ||
+       PerfExtensionSupported("GL_ARB_vertex_array_object")) {
+      Features |= NEED_VAO;
+      glGenVertexArrays(2, VAO);
+      for (i = 0; i < 2; i++) {
+         glBindVertexArray(VAO[i]);
+         glBindBufferARB(GL_ARRAY_BUFFER_ARB, VBO);
+         glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, EBO);
+         glVertexPointer(2, GL_FLOAT, sizeof(struct vertex), (void *) 0);
+         glEnableClientState(GL_VERTEX_ARRAY);
+      }
+      glBindVertexArray(0);
+   }
 }
 
 
@@ -77,7 +168,7 @@ DrawNoStateChange(unsigned count)
    for (i = 0; i < count; i++) {
       glDrawArrays(GL_POINTS, 0, 4);
    }
-   glFinish();
+   PerfFinish();
 }
 
 
@@ -89,7 +180,7 @@ DrawNopStateChange(unsigned count)
       glDisable(GL_ALPHA_TEST);
       glDrawArrays(GL_POINTS, 0, 4);
    }
-   glFinish();
+   PerfFinish();
 }
 
 
@@ -104,9 +195,279 @@ DrawStateChange(unsigned count)
          glDisable(GL_TEXTURE_GEN_S);
       glDrawArrays(GL_POINTS, 0, 4);
    }
-   glFinish();
+   PerfFinish();
+}
+
+
+/**
+ * State change categories for the overhead matrix.  change() is called
+ * before every draw with the draw number and should alternate between
+ * two settings so that the driver can't skip the change as redundant.
+ */
+struct state_change
+{
+   const char *name;
+   unsigned needs;
+   void (*begin)(void);
+   void (*change)(unsigned i);
+   void (*end)(void);
+};
+
+
+static void
+ChangeNone(unsigned i)
+{
+}
+
+static void
+ChangeBlend(unsigned i)
+{
+   if (i & 1)
+      glEnable(GL_BLEND);
+   else
+      glDisable(GL_BLEND);
+}
+
+static void
+EndBlend(void)
+{
+   glDisable(GL_BLEND);
+}
+
+static void
+BeginDepth(void)
+{
+   glEnable(GL_DEPTH_TEST);
+}
+
+static void
+ChangeDepth(unsigned i)
+{
+   glDepthFunc((i & 1) ? GL_LEQUAL : GL_ALWAYS);
+}
+
+static void
+EndDepth(void)
+{
+   glDepthFunc(GL_LESS);
+   glDisable(GL_DEPTH_TEST);
+}
+
+static void
+BeginTexture(void)
+{
+   glEnable(GL_TEXTURE_2D);
+}
+
+static void
+ChangeTexture(unsigned i)
+{
+   glBindTexture(GL_TEXTURE_2D, Tex[i & 1]);
+}
+
+static void
+EndTexture(void)
+{
+   glBindTexture(GL_TEXTURE_2D, 0);
+   glDisable(GL_TEXTURE_2D);
+}
+
+static void
+ChangeProgram(unsigned i)
+{
+   glUseProgram(Prog[i & 1]);
+}
+
+static void
+EndProgram(void)
+{
+   glUseProgram(0);
+}
+
+static void
+BeginUniform(void)
+{
+   glUseProgram(Prog[0]);
+}
+
+static void
+ChangeUniform(unsigned i)
+{
+   const GLfloat c = (i & 1) ? 1.0f : 0.5f;
+   glUniform4f(ColorUniform, c, c, c, 1.0f);
+}
+
+static void
+ChangeVAO(unsigned i)
+{
+   glBindVertexArray(VAO[i & 1]);
+}
+
+static void
+EndVAO(void)
+{
+   glBindVertexArray(0);
+}
+
+static void
+ChangeFormat(unsigned i)
+{
+   if (i & 1)
+      glVertexPointer(2, GL_SHORT, 0, (void *) sizeof(vertices));
+   else
+      glVertexPointer(2, GL_FLOAT, sizeof(struct vertex), (void *) 0);
+}
+
+static void
+EndFormat(void)
+{
+   glVertexPointer(2, GL_FLOAT, sizeof(struct vertex), (void *) 0);
+}
+
+
+static const struct state_change StateChanges[] = {
+   { "none", 0, NULL, ChangeNone, NULL },
+   { "blend", 0, NULL, ChangeBlend, EndBlend },
+   { "depth", 0, BeginDepth, ChangeDepth, EndDepth },
+   { "texture", 0, BeginTexture, ChangeTexture, EndTexture },
+   { "program", NEED_GLSL, NULL, ChangeProgram, EndProgram },
+   { "uniform", NEED_GLSL, BeginUniform, ChangeUniform, EndProgram },
+   { "vao", NEED_VAO, NULL, ChangeVAO, EndVAO },
+   { "format", 0, NULL, ChangeFormat, EndFormat }
+};
+
+#define NUM_STATE_CHANGES (sizeof(StateChanges) / sizeof(StateChanges[0]))
+
+
+/** Draw entry points for the overhead matrix */
+struct draw_call
+{
+   const char *name;
+   unsigned needs;
+   void (*draw)(void);
+};
+
+
+static void
+DrawArrays(void)
+{
+   glDrawArrays(GL_POINTS, 0, 4);
+}
+
+static void
+DrawElements(void)
+{
+   glDrawElements(GL_POINTS, 4, GL_UNSIGNED_SHORT, (void *) 0);
+}
+
+static void
+DrawArraysInstanced(void)
+{
+   glDrawArraysInstanced(GL_POINTS, 0, 4, 1);
+}
+
+static void
+DrawElementsInstanced(void)
+{
+   glDrawElementsInstanced(GL_POINTS, 4, GL_UNSIGNED_SHORT, (void *) 0, 1);
+}
+
+static void
+MultiDrawArrays(void)
+{
+   glMultiDrawArrays(GL_POINTS, multi_first, multi_count, 4);
+}
+
+static void
+MultiDrawElements(void)
+{
+   glMultiDrawElements(GL_POINTS, multi_count, GL_UNSIGNED_SHORT,
+                       multi_indices, 4);
+}
+
+
+static const struct draw_call DrawCalls[] = {
+   { "DrawArrays", 0, DrawArrays },
+   { "DrawElements", 0, DrawElements },
+   { "DrawArraysInstanced", NEED_INSTANCED, DrawArraysInstanced },
+   { "DrawElementsInstanced", NEED_INSTANCED, DrawElementsInstanced },
+   { "MultiDrawArrays", NEED_MULTIDRAW, MultiDrawArrays },
+   { "MultiDrawElements", NEED_MULTIDRAW, MultiDrawElements }
+};
+
+#define NUM_DRAW_CALLS (sizeof(DrawCalls) / sizeof(DrawCalls[0]))
+
+
+/** The matrix cell being measured */
+static const struct state_change *CurState;
+static const struct draw_call *CurDraw;
+
+
+
+static void
+DrawMatrixCell(unsigned count)
+{
+   void (*change)(unsigned) = CurState->change;
+   void (*draw)(void) = CurDraw->draw;
+   unsigned i;
+
+   for (i = 0; i < count; i++) {
+      change(i);
+      draw();
+   }
+   PerfFinish();
 }
 
+
+/**
+ * Measure all state change / draw call combinations and print a table
+ * of ns per draw call.  The "none" column is the bare cost of each draw
+ * entry point; the difference to it is the cost of the state change.
+ * The table shows the median submission time of the timed samples, so
+ * that draining the GPU doesn't inflate the cheap calls; the recorded
+ * draws/sec rates do include it.
+ */
+static void
+DrawOverheadMatrix(void)
+{
+   unsigned d, s;
+
+   perf_printf("   CPU overhead matrix, ns per draw call (submission only):\n");
+   perf_printf("   %-22s", "");
+   for (s = 0; s < NUM_STATE_CHANGES; s++)
+      perf_printf(" %8s", StateChanges[s].name);
+   perf_printf("\n");
+
+   for (d = 0; d < NUM_DRAW_CALLS; d++) {
+      CurDraw = &DrawCalls[d];
+      perf_printf("   %-22s", CurDraw->name);
+
+      for (s = 0; s < NUM_STATE_CHANGES; s++) {
+         double rate, ns;
+
+         CurState = &StateChanges[s];
+         if ((CurDraw->needs | CurState->needs) & ~Features) {
+            perf_printf(" %8s", "n/a");
+            continue;
+         }
+
+         if (CurState->begin)
+            CurState->begin();
+         rate = PerfMeasureRate(DrawMatrixCell);
+         if (CurState->end)
+            CurState->end();
+
+         PerfRecordResult(CurDraw->name, rate, "draws/sec",
+                          "state=%s", CurState->name);
+         ns = PerfRecordSubmitCost(CurDraw->name, 1.0e9, "ns/draw",
+                                   "state=%s timing=submit", CurState->name);
+         perf_printf(" %8.1f", ns);
+      }
+      perf_printf("\n");
+   }
+}
+
+
 void
 PerfNextRound(void)
 {
@@ -121,17 +482,22 @@ PerfDraw(void)
    rate0 = PerfMeasureRate(DrawNoStateChange);
    perf_printf("   Draw only: %s draws/second\n", 
                PerfHumanFloat(rate0));
+   PerfRecordResult("DrawOnly", rate0, "draws/sec", "");
    
    rate1 = PerfMeasureRate(DrawNopStateChange);
    overhead = 1000.0 * (1.0 / rate1 - 1.0 / rate0);
    perf_printf("   Draw w/ nop state change: %s draws/sec (overhead: %f ms/draw)\n",
                PerfHumanFloat(rate1), overhead);
+   PerfRecordResult("NopStateChange", rate1, "draws/sec", "");
 
    rate2 = PerfMeasureRate(DrawStateChange);
    overhead = 1000.0 * (1.0 / rate2 - 1.0 / rate0);
    perf_printf("   Draw w/ state change: %s draws/sec (overhead: %f ms/draw)\n",
                PerfHumanFloat(rate2), overhead);
+   PerfRecordResult("StateChange", rate2, "draws/sec", "");
+
+   DrawOverheadMatrix();
 
-   exit(0);
+   PerfExit(0);
 }
 
@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2009  VMware, Inc.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * VMWARE BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+ * AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Headless EGL backend for the perf programs.
+ *
+ * Creates a desktop GL context on an EGL pbuffer so the tests can run
+ * on machines without a window system (e.g. llvmpipe on a build host).
+ * The Mesa surfaceless platform is used when available.  If no pbuffer
+ * config exists, a surfaceless context rendering into an FBO is used
+ * instead; tests which rebind framebuffer 0 need the pbuffer path.
+ */
+
+
+#define EGL_EGLEXT_PROTOTYPES
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include "eglmain.h"
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+
+static EGLDisplay Dpy = EGL_NO_DISPLAY;
+static EGLConfig Config;
+static EGLContext Ctx = EGL_NO_CONTEXT;
+static EGLSurface Surf = EGL_NO_SURFACE;
+
+/* used when rendering surfaceless */
+static GLuint Fbo, ColorRb, DepthRb;
+
+
+static EGLDisplay
+GetDisplay(void)
+{
+   const char *exts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+   if (exts && strstr(exts, "EGL_MESA_platform_surfaceless")) {
+      PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+         (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+         eglGetProcAddress("eglGetPlatformDisplayEXT");
+      if (getPlatformDisplay)
+         return getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                   EGL_DEFAULT_DISPLAY, NULL);
+   }
+
+   return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+
+static GLboolean
+ChooseConfig(EGLint surfaceType)
+{
+   const EGLint attribs[] = {
+      EGL_SURFACE_TYPE, surfaceType,
+      EGL_RED_SIZE, 8,
+      EGL_GREEN_SIZE, 8,
+      EGL_BLUE_SIZE, 8,
+      EGL_DEPTH_SIZE, surfaceType ? 24 : 0,
+      EGL_STENCIL_SIZE, surfaceType ? 8 : 0,
+      EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+      EGL_NONE
+   };
+   EGLint num = 0;
+
+   return eglChooseConfig(Dpy, attribs, &Config, 1, &num) && num > 0;
+}
+
+
+static GLboolean
+CreatePbuffer(unsigned width, unsigned height)
+{
+   const EGLint attribs[] = {
+      EGL_WIDTH, (EGLint) width,
+      EGL_HEIGHT, (EGLint) height,
+      EGL_NONE
+   };
+
+   Surf = eglCreatePbufferSurface(Dpy, Config, attribs);
+   return Surf != EGL_NO_SURFACE;
+}
+
+
+/** (Re)allocate the FBO storage used in place of a default framebuffer */
+static void
+SetupFbo(unsigned width, unsigned height)
+{
+   if (!Fbo) {
+      glGenFramebuffers(1, &Fbo);
+      glGenRenderbuffers(1, &ColorRb);
+      glGenRenderbuffers(1, &DepthRb);
+   }
+
+   glBindRenderbuffer(GL_RENDERBUFFER, ColorRb);
+   glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+   glBindRenderbuffer(GL_RENDERBUFFER, DepthRb);
+   glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+   glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+   glBindFramebuffer(GL_FRAMEBUFFER, Fbo);
+   glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                             GL_RENDERBUFFER, ColorRb);
+   glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                             GL_RENDERBUFFER, DepthRb);
+}
+
+
+/**
+ * Create the context and make it current.
+ * Return GL_FALSE if no usable EGL implementation was found.
+ */
+GLboolean
+PerfEglInit(unsigned width, unsigned height)
+{
+   EGLint major, minor;
+
+   Dpy = GetDisplay();
+   if (Dpy == EGL_NO_DISPLAY || !eglInitialize(Dpy, &major, &minor)) {
+      fprintf(stderr, "Error: unable to initialize EGL display\n");
+      return GL_FALSE;
+   }
+
+   if (!eglBindAPI(EGL_OPENGL_API)) {
+      fprintf(stderr, "Error: EGL %d.%d lacks desktop GL support\n",
+              major, minor);
+      return GL_FALSE;
+   }
+
+   if (!ChooseConfig(EGL_PBUFFER_BIT)) {
+      const char *exts = eglQueryString(Dpy, EGL_EXTENSIONS);
+      if (!exts || !strstr(exts, "EGL_KHR_surfaceless_context") ||
+          !ChooseConfig(0)) {
+         fprintf(stderr, "Error: no pbuffer or surfaceless EGL config\n");
+         return GL_FALSE;
+      }
+   }
+   else if (!CreatePbuffer(width, height)) {
+      fprintf(stderr, "Error: unable to create %ux%u pbuffer\n",
+              width, height);
+      return GL_FALSE;
+   }
+
+   Ctx = eglCreateContext(Dpy, Config, EGL_NO_CONTEXT, NULL);
+   if (Ctx == EGL_NO_CONTEXT ||
+       !eglMakeCurrent(Dpy, Surf, Surf, Ctx)) {
+      fprintf(stderr, "Error: unable to create EGL context\n");
+      return GL_FALSE;
+   }
+
+   glewInit();
+
+   if (Surf == EGL_NO_SURFACE)
+      SetupFbo(width, height);
+
+   return GL_TRUE;
+}
+
+
+void
+PerfEglFini(void)
+{
+   if (Dpy == EGL_NO_DISPLAY)
+      return;
+
+   eglMakeCurrent(Dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+   if (Ctx != EGL_NO_CONTEXT)
+      eglDestroyContext(Dpy, Ctx);
+   if (Surf != EGL_NO_SURFACE)
+      eglDestroySurface(Dpy, Surf);
+   eglTerminate(Dpy);
+   Dpy = EGL_NO_DISPLAY;
+}
+
+
+/** Return time in seconds */
+double
+PerfEglGetTime(void)
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+/**
+ * Swapping a pbuffer is a no-op in most EGL implementations, so wait
+ * for rendering to complete instead, which is what a presented frame
+ * would cost.
+ */
+void
+PerfEglSwapBuffers(void)
+{
+   if (Surf != EGL_NO_SURFACE)
+      eglSwapBuffers(Dpy, Surf);
+   glFinish();
+}
+
+
+/** Resize the pbuffer (or FBO); the GL context is kept */
+GLboolean
+PerfEglResize(unsigned width, unsigned height)
+{
+   if (Surf == EGL_NO_SURFACE) {
+      SetupFbo(width, height);
+      return GL_TRUE;
+   }
+
+   eglMakeCurrent(Dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+   eglDestroySurface(Dpy, Surf);
+
+   if (!CreatePbuffer(width, height) ||
+       !eglMakeCurrent(Dpy, Surf, Surf, Ctx)) {
+      fprintf(stderr, "Error: unable to resize pbuffer to %ux%u\n",
+              width, height);
+      return GL_FALSE;
+   }
+
+   return GL_TRUE;
+}
+
+
+GLboolean
+PerfEglExtensionSupported(const char *ext)
+{
+   const char *exts = (const char *) glGetString(GL_EXTENSIONS);
+   const size_t len = strlen(ext);
+   const char *p = exts;
+
+   while (p && (p = strstr(p, ext)) != NULL) {
+      if ((p == exts || p[-1] == ' ') && (p[len] == ' ' || p[len] == 0))
+         return GL_TRUE;
+      p += len;
+   }
+
+   return GL_FALSE;
+}
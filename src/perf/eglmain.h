@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2009  VMware, Inc.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * VMWARE BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+ * AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef EGLMAIN_H
+#define EGLMAIN_H
+
+
+#include "glmain.h"
+
+
+/** Headless (EGL pbuffer / surfaceless) backend used by glmain.c */
+
+extern GLboolean
+PerfEglInit(unsigned width, unsigned height);
+
+extern void
+PerfEglFini(void);
+
+extern double
+PerfEglGetTime(void);
+
+extern void
+PerfEglSwapBuffers(void);
+
+extern GLboolean
+PerfEglResize(unsigned width, unsigned height);
+
+extern GLboolean
+PerfEglExtensionSupported(const char *ext);
+
+
+#endif /* EGLMAIN_H */
@@ -129,7 +129,7 @@ FBOBind(unsigned count)
       if (DrawPoint)
          glDrawArrays(GL_POINTS, 0, 1);
    }
-   glFinish();
+   PerfFinish();
 }
 
 
@@ -148,6 +148,7 @@ PerfDraw(void)
 
    rate = PerfMeasureRate(FBOBind);
    perf_printf("  FBO Binding: %1.f binds/sec\n", rate);
+   PerfRecordResult("FBOBind", rate, "binds/sec", "");
 
-   exit(0);
+   PerfExit(0);
 }
@@ -184,7 +184,7 @@ DrawQuad(unsigned count)
       }
    }
 
-   glFinish();
+   PerfFinish();
 
    if (1)
       PerfSwapBuffers();
@@ -208,6 +208,8 @@ PerfDraw(void)
    rate = PerfMeasureRate(DrawQuad) * pixelsPerDraw;
    perf_printf("   Simple fill: %s pixels/second\n", 
                PerfHumanFloat(rate));
+   PerfRecordResult("Simple", rate, "pixels/sec", "size=%dx%d",
+                    WinWidth, WinHeight);
 
    /* blended fill */
    glEnable(GL_BLEND);
@@ -215,6 +217,8 @@ PerfDraw(void)
    glDisable(GL_BLEND);
    perf_printf("   Blended fill: %s pixels/second\n", 
                PerfHumanFloat(rate));
+   PerfRecordResult("Blended", rate, "pixels/sec", "size=%dx%d",
+                    WinWidth, WinHeight);
 
    /* textured fill */
    glEnable(GL_TEXTURE_2D);
@@ -224,6 +228,8 @@ PerfDraw(void)
    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
    perf_printf("   Textured fill: %s pixels/second\n", 
                PerfHumanFloat(rate));
+   PerfRecordResult("Textured", rate, "pixels/sec", "size=%dx%d",
+                    WinWidth, WinHeight);
 
    /* shader1 fill */
    glUseProgram(ShaderProg1);
@@ -233,6 +239,8 @@ PerfDraw(void)
    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
    perf_printf("   Shader1 fill: %s pixels/second\n", 
                PerfHumanFloat(rate));
+   PerfRecordResult("Shader1", rate, "pixels/sec", "size=%dx%d",
+                    WinWidth, WinHeight);
 
    /* shader2 fill */
    glUseProgram(ShaderProg2);
@@ -242,7 +250,9 @@ PerfDraw(void)
    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
    perf_printf("   Shader2 fill: %s pixels/second\n", 
                PerfHumanFloat(rate));
+   PerfRecordResult("Shader2", rate, "pixels/sec", "size=%dx%d",
+                    WinWidth, WinHeight);
 
-   exit(0);
+   PerfExit(0);
 }
 
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2009  VMware, Inc.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * VMWARE BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+ * AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Table of internal format x client format/type combinations used by the
+ * -sweep mode of the teximage and readpixels tests.  For each internal
+ * format the natural client format/type comes first (what should hit a
+ * plain memcpy path), followed by ones that need conversion.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "glmain.h"
+
+
+const struct perf_format PerfFormats[] = {
+   { "RGBA8 RGBA/ubyte", GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4, 0, NULL },
+   { "RGBA8 RGBA/float", GL_RGBA8, GL_RGBA, GL_FLOAT, 16, 0, NULL },
+   { "BGRA8 BGRA/ubyte", GL_RGBA8, GL_BGRA, GL_UNSIGNED_BYTE, 4, 12, NULL },
+   { "BGRA8 BGRA/8888_rev", GL_RGBA8, GL_BGRA,
+     GL_UNSIGNED_INT_8_8_8_8_REV, 4, 12, NULL },
+   { "RGB565 RGB/565", GL_RGB565, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, 2,
+     41, "GL_ARB_ES2_compatibility" },
+   { "RGB565 RGB/ubyte", GL_RGB565, GL_RGB, GL_UNSIGNED_BYTE, 3,
+     41, "GL_ARB_ES2_compatibility" },
+   { "R8 RED/ubyte", GL_R8, GL_RED, GL_UNSIGNED_BYTE, 1,
+     30, "GL_ARB_texture_rg" },
+   { "R8 RED/float", GL_R8, GL_RED, GL_FLOAT, 4, 30, "GL_ARB_texture_rg" },
+   { "RG16F RG/half", GL_RG16F, GL_RG, GL_HALF_FLOAT, 4, 30, NULL },
+   { "RG16F RG/float", GL_RG16F, GL_RG, GL_FLOAT, 8, 30, NULL },
+   { "RGBA16F RGBA/half", GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, 8, 30, NULL },
+   { "RGBA16F RGBA/float", GL_RGBA16F, GL_RGBA, GL_FLOAT, 16, 30, NULL },
+   { "RGBA32F RGBA/float", GL_RGBA32F, GL_RGBA, GL_FLOAT, 16,
+     30, "GL_ARB_texture_float" },
+   { "RGBA32F RGBA/ubyte", GL_RGBA32F, GL_RGBA, GL_UNSIGNED_BYTE, 4,
+     30, "GL_ARB_texture_float" },
+   { "Z24 Z/uint", GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT,
+     GL_UNSIGNED_INT, 4, 14, NULL },
+   { "Z24 Z/float", GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT,
+     GL_FLOAT, 4, 14, NULL },
+   { "Z24S8 ZS/24_8", GL_DEPTH24_STENCIL8, GL_DEPTH_STENCIL,
+     GL_UNSIGNED_INT_24_8, 4, 30, "GL_EXT_packed_depth_stencil" },
+   { "RGB10_A2 RGBA/2101010_rev", GL_RGB10_A2, GL_RGBA,
+     GL_UNSIGNED_INT_2_10_10_10_REV, 4, 12, NULL },
+   { "RGB10_A2 RGBA/1010102", GL_RGB10_A2, GL_RGBA,
+     GL_UNSIGNED_INT_10_10_10_2, 4, 12, NULL },
+   { "RGB10_A2 RGBA/ubyte", GL_RGB10_A2, GL_RGBA, GL_UNSIGNED_BYTE, 4,
+     0, NULL },
+   { NULL, 0, 0, 0, 0, 0, NULL }
+};
+
+
+/** GL version of the current context as 10 * major + minor */
+static GLuint
+GLVersion(void)
+{
+   static GLuint version = 0;
+
+   if (!version) {
+      const char *str = (const char *) glGetString(GL_VERSION);
+      int major = 1, minor = 0;
+      if (str)
+         sscanf(str, "%d.%d", &major, &minor);
+      version = 10 * major + minor;
+   }
+   return version;
+}
+
+
+GLboolean
+PerfFormatSupported(const struct perf_format *f)
+{
+   if (GLVersion() >= f->gl_version)
+      return GL_TRUE;
+   return f->extension && PerfExtensionSupported(f->extension);
+}
+
+
+GLboolean
+PerfFormatIsDepth(const struct perf_format *f)
+{
+   return f->format == GL_DEPTH_COMPONENT || f->format == GL_DEPTH_STENCIL;
+}
@@ -91,7 +91,7 @@ GenMipmap(unsigned count)
       if (DrawPoint)
          glDrawArrays(GL_POINTS, 0, 1);
    }
-   glFinish();
+   PerfFinish();
 }
 
 
@@ -135,8 +135,11 @@ PerfDraw(void)
 
          perf_printf("   glGenerateMipmap(levels %d..%d): %.2f gens/sec\n",
                      BaseLevel + 1, MaxLevel, rate);
+         PerfRecordResult("GenerateMipmap", rate, "gens/sec",
+                          "size=%dx%d levels=%d..%d", TexWidth, TexHeight,
+                          BaseLevel + 1, MaxLevel);
       }
    }
 
-   exit(0);
+   PerfExit(0);
 }
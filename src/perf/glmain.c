@@ -27,18 +27,32 @@
 
 
 #include <stdio.h>
+#include <string.h>
 #include "glmain.h"
+#include "common.h"
 #include "glut_wrap.h"
+#ifdef PERF_HAVE_EGL
+#include "eglmain.h"
+#endif
 
 
 static int Win;
 static GLfloat Xrot = 0, Yrot = 0, Zrot = 0;
 
+/** Run without a window (EGL pbuffer/surfaceless context)? */
+static GLboolean Headless = GL_FALSE;
+/** Max number of PerfDraw/PerfNextRound rounds when headless, 0 = no limit */
+static unsigned MaxRounds = 0;
+
 
 /** Return time in seconds */
 double
 PerfGetTime(void)
 {
+#ifdef PERF_HAVE_EGL
+   if (Headless)
+      return PerfEglGetTime();
+#endif
    return glutGet(GLUT_ELAPSED_TIME) * 0.001;
 }
 
@@ -46,6 +60,12 @@ PerfGetTime(void)
 void
 PerfSwapBuffers(void)
 {
+#ifdef PERF_HAVE_EGL
+   if (Headless) {
+      PerfEglSwapBuffers();
+      return;
+   }
+#endif
    glutSwapBuffers();
 }
 
@@ -149,9 +169,20 @@ PerfShaderProgram(const char *vertShader, const char *fragShader)
 }
 
 
+static void Reshape(int width, int height);
+
+
 int
 PerfReshapeWindow( unsigned w, unsigned h )
 {
+#ifdef PERF_HAVE_EGL
+   if (Headless) {
+      if (!PerfEglResize(w, h))
+         return 0;
+      Reshape(w, h);
+      return 1;
+   }
+#endif
    if (glutGet(GLUT_SCREEN_WIDTH) < w ||
        glutGet(GLUT_SCREEN_HEIGHT) < h)
       return 0;
@@ -165,10 +196,30 @@ PerfReshapeWindow( unsigned w, unsigned h )
 GLboolean
 PerfExtensionSupported(const char *ext)
 {
+#ifdef PERF_HAVE_EGL
+   if (Headless)
+      return PerfEglExtensionSupported(ext);
+#endif
    return glutExtensionSupported(ext);
 }
 
 
+/** Restore the viewport and matrices set up for the current window size */
+void
+PerfResetView(void)
+{
+   Reshape(WinWidth, WinHeight);
+}
+
+
+const char *
+PerfRendererString(void)
+{
+   const char *renderer = (const char *) glGetString(GL_RENDERER);
+   return renderer ? renderer : "";
+}
+
+
 static void
 Idle(void)
 {
@@ -245,9 +296,79 @@ SpecialKey(int key, int x, int y)
 }
 
 
+/**
+ * Look for -headless / -rounds N and the sample policy options on the
+ * command line (or PERF_HEADLESS in the environment) and remove them so
+ * GLUT doesn't see them.
+ */
+static void
+ParseArgs(int *argc, char *argv[])
+{
+   const char *env = getenv("PERF_HEADLESS");
+   int i, j;
+
+   if (env && env[0] && strcmp(env, "0") != 0)
+      Headless = GL_TRUE;
+
+   for (i = j = 1; i < *argc; i++) {
+      int n = PerfParseOption(*argc - i, argv + i);
+
+      if (n) {
+         i += n - 1;
+      }
+      else if (strcmp(argv[i], "-headless") == 0) {
+         Headless = GL_TRUE;
+      }
+      else if (strcmp(argv[i], "-rounds") == 0 && i + 1 < *argc) {
+         MaxRounds = atoi(argv[++i]);
+      }
+      else {
+         argv[j++] = argv[i];
+      }
+   }
+   *argc = j;
+   argv[j] = NULL;
+}
+
+
+/**
+ * Drive the test without an event loop.  Like the GLUT path, the test
+ * normally calls exit() itself once it has printed its results.
+ */
+static int
+HeadlessMain(void)
+{
+#ifdef PERF_HAVE_EGL
+   unsigned round;
+
+   if (!PerfEglInit(WinWidth, WinHeight))
+      return 1;
+   atexit(PerfEglFini);
+
+   Reshape(WinWidth, WinHeight);
+   PerfInit();
+
+   for (round = 0; MaxRounds == 0 || round < MaxRounds; round++) {
+      PerfDraw();
+      PerfEglSwapBuffers();
+      PerfNextRound();
+   }
+   return 0;
+#else
+   fprintf(stderr, "Error: built without headless (EGL) support\n");
+   return 1;
+#endif
+}
+
+
 int
 main(int argc, char *argv[])
 {
+   ParseArgs(&argc, argv);
+   PerfSetTestName(argv[0]);
+   if (Headless)
+      return HeadlessMain();
+
    glutInit(&argc, argv);
    glutInitWindowSize(WinWidth, WinHeight);
    glutInitDisplayMode(GLUT_RGB | GLUT_DOUBLE | GLUT_DEPTH | GLUT_STENCIL);
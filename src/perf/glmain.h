@@ -24,6 +24,10 @@
 #define GLMAIN_H
 
 
+#ifdef PERF_SUITE_TEST
+#include "perfsuite.h"
+#endif
+
 #define GL_GLEXT_PROTOTYPES
 #include <GL/glew.h>
 #include <stdlib.h>
@@ -52,6 +56,45 @@ PerfReshapeWindow( unsigned w, unsigned h );
 extern GLboolean
 PerfExtensionSupported(const char *ext);
 
+extern const char *
+PerfRendererString(void);
+
+extern void
+PerfResetView(void);
+
+extern GLboolean
+PerfGpuTimerSupported(void);
+
+extern void
+PerfGpuTimerBegin(unsigned sample);
+
+extern void
+PerfGpuTimerEnd(unsigned sample);
+
+extern const double *
+PerfGpuTimerResults(unsigned count);
+
+
+/** A texture internal format with a client format/type, see formats.c */
+struct perf_format
+{
+   const char *name;
+   GLenum internal_format;
+   GLenum format, type;
+   GLuint pixel_size;        /**< bytes per pixel of client data */
+   GLuint gl_version;        /**< 10 * major + minor, 0 = any */
+   const char *extension;    /**< alternative to gl_version, or NULL */
+};
+
+/** Format/type combinations swept by -sweep, terminated by a NULL name */
+extern const struct perf_format PerfFormats[];
+
+extern GLboolean
+PerfFormatSupported(const struct perf_format *f);
+
+extern GLboolean
+PerfFormatIsDepth(const struct perf_format *f);
+
 
 /** Test programs must implement these functions **/
 
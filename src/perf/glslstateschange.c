@@ -150,7 +150,7 @@ Draw(unsigned count)
       glPopMatrix();
 
    }
-   glutSwapBuffers();
+   PerfSwapBuffers();
 }
 
 void
@@ -164,8 +164,9 @@ PerfDraw(void)
 
    rate = PerfMeasureRate(Draw);
    perf_printf("  Immediate mode: %s change/sec\n", PerfHumanFloat(rate));
+   PerfRecordResult("Immediate", rate, "changes/sec", "");
 
-   exit(0);
+   PerfExit(0);
 }
 
 void
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2009  VMware, Inc.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * VMWARE BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+ * AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * GPU-side timing of PerfMeasureRate() samples with GL_TIMESTAMP queries
+ * (GL_ARB_timer_query).
+ *
+ * Each sample gets a pair of timestamp queries.  The pairs live in a
+ * small ring and a result is only read back when its pair is about to
+ * be reused, by which time the GPU has long passed it, so reading
+ * results doesn't stall the pipeline.
+ */
+
+#include "glmain.h"
+
+
+#define RING_SIZE 8
+
+static GLuint Queries[RING_SIZE][2];
+static double *Results = NULL;   /* seconds, per sample */
+static unsigned MaxResults = 0;
+static int Supported = -1;
+
+
+/** Is GPU timing available?  Allocates the queries on first use. */
+GLboolean
+PerfGpuTimerSupported(void)
+{
+   if (Supported < 0) {
+      Supported = GLEW_VERSION_3_3 ||
+         PerfExtensionSupported("GL_ARB_timer_query");
+      if (Supported)
+         glGenQueries(2 * RING_SIZE, &Queries[0][0]);
+   }
+   return Supported;
+}
+
+
+static void
+CollectSample(unsigned sample)
+{
+   const unsigned slot = sample % RING_SIZE;
+   GLuint64 t0 = 0, t1 = 0;
+
+   glGetQueryObjectui64v(Queries[slot][0], GL_QUERY_RESULT, &t0);
+   glGetQueryObjectui64v(Queries[slot][1], GL_QUERY_RESULT, &t1);
+   Results[sample] = (t1 - t0) * 1e-9;
+}
+
+
+/** Start timing sample number 'sample' (counting from 0 per measurement) */
+void
+PerfGpuTimerBegin(unsigned sample)
+{
+   if (sample >= MaxResults) {
+      MaxResults = sample + 64;
+      Results = realloc(Results, MaxResults * sizeof(double));
+   }
+
+   /* this pair is still holding the result of an older sample */
+   if (sample >= RING_SIZE)
+      CollectSample(sample - RING_SIZE);
+
+   glQueryCounter(Queries[sample % RING_SIZE][0], GL_TIMESTAMP);
+}
+
+
+void
+PerfGpuTimerEnd(unsigned sample)
+{
+   glQueryCounter(Queries[sample % RING_SIZE][1], GL_TIMESTAMP);
+}
+
+
+/**
+ * Read back the remaining results after 'count' samples.
+ * Returns an array of per-sample GPU times in seconds.
+ */
+const double *
+PerfGpuTimerResults(unsigned count)
+{
+   unsigned i = count > RING_SIZE ? count - RING_SIZE : 0;
+
+   for (; i < count; i++)
+      CollectSample(i);
+
+   return Results;
+}
@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2009  VMware, Inc.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * VMWARE BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+ * AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * Run several perf tests in one process and one GL context.
+ *
+ * Each test is built a second time with PERF_SUITE_TEST=name (see
+ * perfsuite.h) and registered below.  This file provides the
+ * PerfInit/PerfNextRound/PerfDraw entry points glmain.c expects and
+ * forwards them to the current test.  When a test "exits", the GL state
+ * it changed is rolled back and the next test selected by -filter
+ * starts.
+ */
+
+
+#include <fnmatch.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include "glmain.h"
+#include "common.h"
+#include "perfsuite.h"
+
+
+int WinWidth = 100, WinHeight = 100;
+
+
+struct perf_test
+{
+   const char *name;
+   void (*init)(void);
+   void (*next_round)(void);
+   void (*draw)(void);
+   const int *width, *height;
+};
+
+#define PERF_TEST(name) \
+   extern void name##_PerfInit(void); \
+   extern void name##_PerfNextRound(void); \
+   extern void name##_PerfDraw(void); \
+   extern int name##_WinWidth, name##_WinHeight;
+#include "perfsuite_tests.h"
+#undef PERF_TEST
+
+#define PERF_TEST(name) \
+   { #name, name##_PerfInit, name##_PerfNextRound, name##_PerfDraw, \
+     &name##_WinWidth, &name##_WinHeight },
+static const struct perf_test Tests[] = {
+#include "perfsuite_tests.h"
+};
+#undef PERF_TEST
+
+#define NUM_TESTS (sizeof(Tests) / sizeof(Tests[0]))
+
+
+static int Current = -1;
+static unsigned NumRun = 0, NumFailed = 0;
+static jmp_buf ExitJump;
+static int ExitStatus;
+
+
+/** Replaces exit() in the tests, see perfsuite.h */
+void
+PerfSuiteExit(int status)
+{
+   ExitStatus = status;
+   longjmp(ExitJump, 1);
+}
+
+
+/** Does the -filter pattern select this test? */
+static GLboolean
+TestSelected(const char *name)
+{
+   if (!PerfTestFilter)
+      return GL_TRUE;
+
+   return fnmatch(PerfTestFilter, name, 0) == 0;
+}
+
+
+static void
+SaveState(void)
+{
+   glPushAttrib(GL_ALL_ATTRIB_BITS);
+   glPushClientAttrib(GL_CLIENT_ALL_ATTRIB_BITS);
+   glMatrixMode(GL_TEXTURE);
+   glPushMatrix();
+   glMatrixMode(GL_PROJECTION);
+   glPushMatrix();
+   glMatrixMode(GL_MODELVIEW);
+   glPushMatrix();
+}
+
+
+/**
+ * Undo the state changes of a test.  Bindings which aren't covered by
+ * the attribute stacks are reset to their defaults before popping.
+ *
+ * This only isolates state, not objects: textures, buffers, programs
+ * and FBOs a test created without deleting them stay allocated for the
+ * rest of the run, so later tests may see more memory pressure (and
+ * different driver behaviour) than when run on their own.
+ */
+static void
+RestoreState(void)
+{
+   if (GLEW_VERSION_2_0)
+      glUseProgram(0);
+   if (PerfExtensionSupported("GL_EXT_framebuffer_object"))
+      glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+
+   glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+   if (PerfExtensionSupported("GL_ARB_pixel_buffer_object")) {
+      glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+      glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+   }
+
+   glMatrixMode(GL_TEXTURE);
+   glPopMatrix();
+   glMatrixMode(GL_PROJECTION);
+   glPopMatrix();
+   glMatrixMode(GL_MODELVIEW);
+   glPopMatrix();
+   glPopClientAttrib();
+   glPopAttrib();
+
+   glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+   glActiveTexture(GL_TEXTURE0);
+   glClientActiveTexture(GL_TEXTURE0);
+
+   while (glGetError() != GL_NO_ERROR)
+      ;
+}
+
+
+/** Advance to the next selected test and run its PerfInit */
+static void
+StartNextTest(void)
+{
+   while (++Current < (int) NUM_TESTS) {
+      const struct perf_test *t = &Tests[Current];
+
+      if (!TestSelected(t->name))
+         continue;
+
+      if (!PerfReshapeWindow(*t->width, *t->height)) {
+         perf_printf("%s: skipped, can't make a %dx%d window\n",
+                     t->name, *t->width, *t->height);
+         continue;
+      }
+      PerfResetView();
+
+      perf_printf("%s:\n", t->name);
+      PerfSetTestName(t->name);
+      NumRun++;
+      SaveState();
+
+      if (setjmp(ExitJump) == 0) {
+         t->init();
+         return;
+      }
+
+      /* the test exited from PerfInit (e.g. missing extension) */
+      if (ExitStatus != 0) {
+         perf_printf("%s: failed (status %d)\n", t->name, ExitStatus);
+         NumFailed++;
+      }
+      RestoreState();
+   }
+
+   perf_printf("perfsuite: %u tests run, %u failed\n", NumRun, NumFailed);
+   PerfExit(NumFailed ? 1 : 0);
+}
+
+
+static void
+FinishTest(void)
+{
+   if (ExitStatus != 0) {
+      perf_printf("%s: failed (status %d)\n",
+                  Tests[Current].name, ExitStatus);
+      NumFailed++;
+   }
+   RestoreState();
+   StartNextTest();
+}
+
+
+/** Called from test harness/main */
+void
+PerfInit(void)
+{
+   /* tests pick their modes internally, so only whole tests can be
+    * selected */
+   if (PerfTestFilter && strchr(PerfTestFilter, '/')) {
+      fprintf(stderr, "Error: -filter matches test names only, "
+              "'%s' contains a mode\n", PerfTestFilter);
+      exit(1);
+   }
+
+   StartNextTest();
+}
+
+
+/** Called from test harness/main */
+void
+PerfNextRound(void)
+{
+   if (setjmp(ExitJump) == 0)
+      Tests[Current].next_round();
+   else
+      FinishTest();
+}
+
+
+/** Called from test harness/main */
+void
+PerfDraw(void)
+{
+   if (setjmp(ExitJump) == 0)
+      Tests[Current].draw();
+   else
+      FinishTest();
+}
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2009  VMware, Inc.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * VMWARE BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+ * AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+
+#ifndef PERFSUITE_H
+#define PERFSUITE_H
+
+
+/**
+ * Included by glmain.h when a test is compiled for the perfsuite program
+ * (PERF_SUITE_TEST=name).  Gives the test's entry points and window size
+ * a name_ prefix so all tests can be linked together, and turns the
+ * tests' exit() and PerfExit() calls into a return to the suite runner.
+ */
+
+
+#include <stdlib.h>
+
+
+extern void
+PerfSuiteExit(int status);
+
+
+#ifdef PERF_SUITE_TEST
+
+#define PERF_SUITE_PASTE2(a, b) a##_##b
+#define PERF_SUITE_PASTE(a, b) PERF_SUITE_PASTE2(a, b)
+#define PERF_SUITE_SYM(sym) PERF_SUITE_PASTE(PERF_SUITE_TEST, sym)
+
+#define PerfInit PERF_SUITE_SYM(PerfInit)
+#define PerfNextRound PERF_SUITE_SYM(PerfNextRound)
+#define PerfDraw PERF_SUITE_SYM(PerfDraw)
+#define WinWidth PERF_SUITE_SYM(WinWidth)
+#define WinHeight PERF_SUITE_SYM(WinHeight)
+
+#define exit(status) PerfSuiteExit(status)
+#define PerfExit(status) PerfSuiteExit(status)
+
+#endif /* PERF_SUITE_TEST */
+
+
+#endif /* PERFSUITE_H */
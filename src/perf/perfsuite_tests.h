@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2009  VMware, Inc.  All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * VMWARE BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN
+ * AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/**
+ * List of the tests linked into perfsuite, see perfsuite.c.
+ * Every entry needs a matching libsuite_<name>.la in Makefile.am.
+ * glslstateschange isn't listed since its shader files aren't shipped
+ * and it aborts when they're missing.
+ */
+
+PERF_TEST(copytex)
+PERF_TEST(drawoverhead)
+PERF_TEST(fbobind)
+PERF_TEST(fill)
+PERF_TEST(genmipmap)
+PERF_TEST(readpixels)
+PERF_TEST(swapbuffers)
+PERF_TEST(teximage)
+PERF_TEST(vbo)
+PERF_TEST(vertexrate)
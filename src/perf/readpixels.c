@@ -22,7 +22,10 @@
 /**
  * Measure glReadPixels speed.
  * XXX also read into a PBO?
- * XXX also read from FBOs?
+ *
+ * With -sweep, read from an FBO of each internal format in the
+ * PerfFormats table with its client format/type instead, and print the
+ * results as a format x size matrix.
  *
  * Brian Paul
  * 23 Sep 2009
@@ -91,7 +94,7 @@ ReadPixels(unsigned count)
       glReadPixels(x, y, ReadWidth, ReadHeight,
                    ReadFormat, ReadType, ReadBuffer);
    }
-   glFinish();
+   PerfFinish();
 }
 
 
@@ -121,6 +124,127 @@ static const struct {
 
 
 
+/**
+ * Make an FBO with a WinWidth x WinHeight renderbuffer of the given
+ * format.  Returns 0 if the driver can't render to it.
+ */
+static GLuint
+MakeSweepFBO(const struct perf_format *pf, GLuint *rb)
+{
+   GLuint fbo;
+   GLenum stat;
+
+   glGenFramebuffersEXT(1, &fbo);
+   glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, fbo);
+
+   glGenRenderbuffersEXT(1, rb);
+   glBindRenderbufferEXT(GL_RENDERBUFFER_EXT, *rb);
+   glRenderbufferStorageEXT(GL_RENDERBUFFER_EXT, pf->internal_format,
+                            WinWidth, WinHeight);
+
+   if (PerfFormatIsDepth(pf)) {
+      glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT,
+                                   GL_DEPTH_ATTACHMENT_EXT,
+                                   GL_RENDERBUFFER_EXT, *rb);
+      if (pf->format == GL_DEPTH_STENCIL)
+         glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT,
+                                      GL_STENCIL_ATTACHMENT_EXT,
+                                      GL_RENDERBUFFER_EXT, *rb);
+      glDrawBuffer(GL_NONE);
+      glReadBuffer(GL_NONE);
+   }
+   else {
+      glFramebufferRenderbufferEXT(GL_FRAMEBUFFER_EXT,
+                                   GL_COLOR_ATTACHMENT0_EXT,
+                                   GL_RENDERBUFFER_EXT, *rb);
+      glDrawBuffer(GL_COLOR_ATTACHMENT0_EXT);
+      glReadBuffer(GL_COLOR_ATTACHMENT0_EXT);
+   }
+
+   stat = glCheckFramebufferStatusEXT(GL_FRAMEBUFFER_EXT);
+   glGetError();
+   if (stat != GL_FRAMEBUFFER_COMPLETE_EXT) {
+      glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+      glDeleteFramebuffersEXT(1, &fbo);
+      glDeleteRenderbuffersEXT(1, rb);
+      return 0;
+   }
+
+   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+   return fbo;
+}
+
+
+/**
+ * glReadPixels() from an FBO of each PerfFormats entry at each of Sizes.
+ * Cells the driver can't do are printed as n/a, GL errors as "error".
+ */
+static void
+ReadPixelsSweep(void)
+{
+   int f, sz;
+
+   if (!PerfExtensionSupported("GL_EXT_framebuffer_object")) {
+      perf_printf("readpixels: GL_EXT_framebuffer_object not supported\n");
+      return;
+   }
+
+   perf_printf("glReadPixels from FBO, MB/sec:\n");
+   perf_printf("%-28s", "format");
+   for (sz = 0; Sizes[sz]; sz++)
+      perf_printf(" %9d", Sizes[sz]);
+   perf_printf("\n");
+
+   for (f = 0; PerfFormats[f].name; f++) {
+      const struct perf_format *pf = &PerfFormats[f];
+      GLuint fbo = 0, rb;
+
+      if (PerfFormatSupported(pf))
+         fbo = MakeSweepFBO(pf, &rb);
+
+      perf_printf("%-28s", pf->name);
+      for (sz = 0; Sizes[sz]; sz++) {
+         double rate, mbPerSec;
+         int imgSize;
+
+         if (!fbo) {
+            perf_printf(" %9s", "n/a");
+            continue;
+         }
+
+         ReadFormat = pf->format;
+         ReadType = pf->type;
+         ReadWidth = ReadHeight = Sizes[sz];
+         imgSize = ReadWidth * ReadHeight * pf->pixel_size;
+         ReadBuffer = malloc(imgSize);
+
+         rate = PerfMeasureRate(ReadPixels);
+         mbPerSec = rate * imgSize / (1024.0 * 1024.0);
+         free(ReadBuffer);
+
+         if (glGetError()) {
+            perf_printf(" %9s", "error");
+            continue;
+         }
+
+         perf_printf(" %9.1f", mbPerSec);
+         PerfRecordResult("Sweep_ReadPixels", mbPerSec, "MB/sec",
+                          "format=%s size=%dx%d", pf->name,
+                          ReadWidth, ReadHeight);
+      }
+      perf_printf("\n");
+
+      if (fbo) {
+         glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+         glDeleteFramebuffersEXT(1, &fbo);
+         glDeleteRenderbuffersEXT(1, &rb);
+      }
+   }
+   glDrawBuffer(GL_BACK);
+   glReadBuffer(GL_BACK);
+}
+
+
 /** Called from test harness/main */
 void
 PerfNextRound(void)
@@ -135,6 +259,11 @@ PerfDraw(void)
    double rate, mbPerSec;
    int fmt, sz;
 
+   if (PerfSweep) {
+      ReadPixelsSweep();
+      PerfExit(0);
+   }
+
    /* loop over formats */
    for (fmt = 0; DstFormats[fmt].format; fmt++) {
       ReadFormat = DstFormats[fmt].format;
@@ -160,10 +289,13 @@ PerfDraw(void)
          perf_printf("glReadPixels(%d x %d, %s): %.1f images/sec, %.1f Mpixels/sec\n",
                      ReadWidth, ReadHeight,
                      DstFormats[fmt].name, rate, mbPerSec);
+         PerfRecordResult("ReadPixels", mbPerSec, "MB/sec",
+                          "format=%s size=%dx%d", DstFormats[fmt].name,
+                          ReadWidth, ReadHeight);
 
          free(ReadBuffer);
       }
    }
 
-   exit(0);
+   PerfExit(0);
 }
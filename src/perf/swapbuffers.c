@@ -121,7 +121,7 @@ PerfNextRound(void)
       i++;
    }
    else {
-      exit(0);
+      PerfExit(0);
    }
 }
 
@@ -140,6 +140,8 @@ PerfDraw(void)
                PerfHumanFloat(rate0));
    perf_printf(" %s pixels/second\n",
                PerfHumanFloat(rate0 * real_WinWidth * real_WinHeight));
+   PerfRecordResult("SwapNaked", rate0, "swaps/sec", "size=%dx%d",
+                    real_WinWidth, real_WinHeight);
 
 
 
@@ -149,6 +151,8 @@ PerfDraw(void)
                PerfHumanFloat(rate0));
    perf_printf(" %s pixels/second\n",
                PerfHumanFloat(rate0 * real_WinWidth * real_WinHeight));
+   PerfRecordResult("SwapClear", rate0, "swaps/sec", "size=%dx%d",
+                    real_WinWidth, real_WinHeight);
 
 
    rate0 = PerfMeasureRate(SwapClearPoint);
@@ -157,5 +161,7 @@ PerfDraw(void)
                PerfHumanFloat(rate0));
    perf_printf(" %s pixels/second\n",
                PerfHumanFloat(rate0 * real_WinWidth * real_WinHeight));
+   PerfRecordResult("SwapClearDraw", rate0, "swaps/sec", "size=%dx%d",
+                    real_WinWidth, real_WinHeight);
 }
 
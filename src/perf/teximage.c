@@ -22,10 +22,20 @@
 /**
  * Measure glTex[Sub]Image2D() and glGetTexImage() rate
  *
+ * The PBO modes stream one image per frame through pixel buffer objects
+ * (one PBO, two ping-ponged PBOs, a persistent-mapped ring, and fenced
+ * pack PBOs for readback) and also report how long the CPU was blocked
+ * in buffer maps and fence waits per frame.
+ *
+ * With -sweep, measure glTexSubImage2D() and glGetTexImage() for each
+ * entry of the PerfFormats table at a few sizes instead, and print the
+ * results as a format x size matrix.
+ *
  * Brian Paul
  * 16 Sep 2009
  */
 
+#include <string.h>
 #include "glmain.h"
 #include "common.h"
 
@@ -38,14 +48,29 @@ static GLubyte *TexImage = NULL;
 static GLsizei TexSize;
 static GLenum TexIntFormat, TexSrcFormat, TexSrcType;
 
+static GLsizei ImageBytes;
+
 static const GLboolean DrawPoint = GL_TRUE;
 static const GLboolean TexSubImage4 = GL_FALSE;
 
+/** Pixel buffers for the PBO modes */
+#define NUM_PBOS 3
+
+static GLuint PBO[NUM_PBOS];
+static GLubyte *PBOMap = NULL;     /* persistent mapping of PBO[0] */
+static GLsync Fences[NUM_PBOS];
+static double StallTime;           /* seconds blocked in maps/waits */
+static unsigned StallFrames;
+
 enum {
    MODE_CREATE_TEXIMAGE,
    MODE_TEXIMAGE,
    MODE_TEXSUBIMAGE,
    MODE_GETTEXIMAGE,
+   MODE_PBO_TEXSUBIMAGE,
+   MODE_PBO2_TEXSUBIMAGE,
+   MODE_PBO_RING_TEXSUBIMAGE,
+   MODE_PBO_GETTEXIMAGE,
    MODE_COUNT
 };
 
@@ -54,7 +79,11 @@ static const char *mode_name[MODE_COUNT] =
    "Create_TexImage",
    "TexImage",
    "TexSubImage",
-   "GetTexImage"
+   "GetTexImage",
+   "PBO_TexSubImage",
+   "PBO2_TexSubImage",
+   "PBORing_TexSubImage",
+   "PBO_GetTexImage"
 };
 
 
@@ -116,7 +145,7 @@ CreateUploadTexImage2D(unsigned count)
       if (DrawPoint)
          glDrawArrays(GL_POINTS, 0, 1);
    }
-   glFinish();
+   PerfFinish();
 }
 
 
@@ -136,7 +165,7 @@ UploadTexImage2D(unsigned count)
       if (DrawPoint)
          glDrawArrays(GL_POINTS, 0, 1);
    }
-   glFinish();
+   PerfFinish();
 }
 
 
@@ -185,7 +214,7 @@ UploadTexSubImage2D(unsigned count)
       if (DrawPoint)
          glDrawArrays(GL_POINTS, 0, 1);
    }
-   glFinish();
+   PerfFinish();
 }
 
 
@@ -193,16 +222,255 @@ static void
 GetTexImage2D(unsigned count)
 {
    unsigned i;
-   GLubyte *buf = (GLubyte *) malloc(TexSize * TexSize * 4);
+   GLubyte *buf = (GLubyte *) malloc(ImageBytes);
    for (i = 0; i < count; i++) {
       glGetTexImage(GL_TEXTURE_2D, 0,
                     TexSrcFormat, TexSrcType, buf);
    }
-   glFinish();
+   PerfFinish();
+   free(buf);
+}
+
+
+/** Map the bound buffer, accounting the time as stall time */
+static void *
+MapPBO(GLenum target, GLenum access)
+{
+   const double t0 = PerfGetTime();
+   void *ptr = glMapBufferARB(target, access);
+   StallTime += PerfGetTime() - t0;
+   return ptr;
+}
+
+
+/** Wait for the fence of the given PBO, if any */
+static void
+WaitPBO(unsigned i)
+{
+   if (Fences[i]) {
+      const double t0 = PerfGetTime();
+      while (glClientWaitSync(Fences[i], GL_SYNC_FLUSH_COMMANDS_BIT,
+                              1000000000) == GL_TIMEOUT_EXPIRED)
+         ;
+      StallTime += PerfGetTime() - t0;
+      glDeleteSync(Fences[i]);
+      Fences[i] = 0;
+   }
+}
+
+
+/** Fill a PBO with the next frame's image and upload from it */
+static void
+UploadPBOTexSubImage2D(unsigned count)
+{
+   unsigned i;
+
+   glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, PBO[0]);
+   for (i = 0; i < count; i++) {
+      void *dst = MapPBO(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+      memcpy(dst, TexImage, ImageBytes);
+      glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+
+      glTexSubImage2D(GL_TEXTURE_2D, 0,
+                      0, 0, TexSize, TexSize,
+                      TexSrcFormat, TexSrcType, (void *) 0);
+      if (DrawPoint)
+         glDrawArrays(GL_POINTS, 0, 1);
+   }
+   glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+   StallFrames += count;
+   PerfFinish();
+}
+
+
+/**
+ * Ping-pong between two PBOs: upload the texture from the one filled in
+ * the previous frame while filling the other.
+ */
+static void
+UploadPBO2TexSubImage2D(unsigned count)
+{
+   unsigned i;
+
+   for (i = 0; i < count; i++) {
+      void *dst;
+
+      glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, PBO[(i + 1) & 1]);
+      glTexSubImage2D(GL_TEXTURE_2D, 0,
+                      0, 0, TexSize, TexSize,
+                      TexSrcFormat, TexSrcType, (void *) 0);
+      if (DrawPoint)
+         glDrawArrays(GL_POINTS, 0, 1);
+
+      glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, PBO[i & 1]);
+      dst = MapPBO(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+      memcpy(dst, TexImage, ImageBytes);
+      glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+   }
+   glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+   StallFrames += count;
+   PerfFinish();
+}
+
+
+/**
+ * Write each frame's image into the next segment of a persistently
+ * mapped PBO, fencing a segment after the upload that reads it.
+ */
+static void
+UploadPBORingTexSubImage2D(unsigned count)
+{
+   unsigned i;
+
+   glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, PBO[0]);
+   for (i = 0; i < count; i++) {
+      const unsigned seg = i % NUM_PBOS;
+      const GLsizeiptr offset = seg * ImageBytes;
+
+      WaitPBO(seg);
+      memcpy(PBOMap + offset, TexImage, ImageBytes);
+
+      glTexSubImage2D(GL_TEXTURE_2D, 0,
+                      0, 0, TexSize, TexSize,
+                      TexSrcFormat, TexSrcType, (void *) offset);
+      Fences[seg] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      if (DrawPoint)
+         glDrawArrays(GL_POINTS, 0, 1);
+   }
+   glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+   StallFrames += count;
+   PerfFinish();
+}
+
+
+/** Map a pack PBO once its readback completed and copy the image out */
+static void
+ReadbackPBO(unsigned i, GLubyte *buf)
+{
+   const void *src;
+
+   WaitPBO(i);
+   glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, PBO[i]);
+   src = MapPBO(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB);
+   memcpy(buf, src, ImageBytes);
+   glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+}
+
+
+/**
+ * Asynchronous glGetTexImage(): read into a ring of pack PBOs and only
+ * map each one NUM_PBOS frames later, after its fence signalled.
+ */
+static void
+GetPBOTexImage2D(unsigned count)
+{
+   unsigned i;
+   GLubyte *buf = (GLubyte *) malloc(ImageBytes);
+
+   for (i = 0; i < count; i++) {
+      const unsigned seg = i % NUM_PBOS;
+
+      if (Fences[seg])
+         ReadbackPBO(seg, buf);
+
+      glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, PBO[seg]);
+      glGetTexImage(GL_TEXTURE_2D, 0,
+                    TexSrcFormat, TexSrcType, (void *) 0);
+      Fences[seg] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+   }
+
+   /* collect the readbacks still in flight */
+   for (i = 0; i < NUM_PBOS; i++) {
+      if (Fences[i])
+         ReadbackPBO(i, buf);
+   }
+   glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+   StallFrames += count;
+   PerfFinish();
    free(buf);
 }
 
 
+/** Allocate the pixel buffers for the given PBO mode */
+static void
+BeginPBO(GLint mode)
+{
+   unsigned i;
+
+   glGenBuffersARB(NUM_PBOS, PBO);
+
+   if (mode == MODE_PBO_RING_TEXSUBIMAGE) {
+      const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+                               GL_MAP_COHERENT_BIT;
+      glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, PBO[0]);
+      glBufferStorage(GL_PIXEL_UNPACK_BUFFER_ARB, NUM_PBOS * ImageBytes,
+                      NULL, flags);
+      PBOMap = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER_ARB, 0,
+                                NUM_PBOS * ImageBytes, flags);
+      glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+   }
+   else {
+      const GLboolean pack = mode == MODE_PBO_GETTEXIMAGE;
+      const GLenum target = pack ?
+         GL_PIXEL_PACK_BUFFER_ARB : GL_PIXEL_UNPACK_BUFFER_ARB;
+      const GLenum usage = pack ? GL_STREAM_READ_ARB : GL_STREAM_DRAW_ARB;
+      /* unpack buffers start out holding the image, since the first
+       * ping-pong frame uploads from a buffer it hasn't filled yet
+       */
+      for (i = 0; i < NUM_PBOS; i++) {
+         glBindBufferARB(target, PBO[i]);
+         glBufferDataARB(target, ImageBytes, pack ? NULL : TexImage, usage);
+      }
+      glBindBufferARB(target, 0);
+   }
+
+   StallTime = 0.0;
+   StallFrames = 0;
+}
+
+
+static void
+EndPBO(void)
+{
+   unsigned i;
+
+   for (i = 0; i < NUM_PBOS; i++)
+      WaitPBO(i);
+   if (PBOMap) {
+      glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, PBO[0]);
+      glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+      glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+      PBOMap = NULL;
+   }
+   glDeleteBuffersARB(NUM_PBOS, PBO);
+}
+
+
+/** Can the driver run the given mode? */
+static GLboolean
+ModeSupported(GLint mode)
+{
+   const GLboolean pbo = GLEW_VERSION_2_1 ||
+      PerfExtensionSupported("GL_ARB_pixel_buffer_object");
+   const GLboolean sync = GLEW_VERSION_3_2 ||
+      PerfExtensionSupported("GL_ARB_sync");
+   const GLboolean storage = GLEW_VERSION_4_4 ||
+      PerfExtensionSupported("GL_ARB_buffer_storage");
+
+   switch (mode) {
+   case MODE_PBO_TEXSUBIMAGE:
+   case MODE_PBO2_TEXSUBIMAGE:
+      return pbo;
+   case MODE_PBO_RING_TEXSUBIMAGE:
+      return pbo && sync && storage;
+   case MODE_PBO_GETTEXIMAGE:
+      return pbo && sync;
+   default:
+      return GL_TRUE;
+   }
+}
+
+
 /* XXX any other formats to measure? */
 static const struct {
    GLenum format, type;
@@ -220,6 +488,74 @@ static const struct {
 };
 
 
+static const GLsizei SweepSizes[] = { 64, 256, 1024, 0 };
+
+
+/**
+ * Upload or read back each PerfFormats entry at each of SweepSizes.
+ * Cells the driver can't do are printed as n/a, GL errors as "error".
+ */
+static void
+TexImageSweep(GLboolean readback)
+{
+   const char *mode = readback ? "Sweep_GetTexImage" : "Sweep_TexSubImage";
+   const PerfRateFunc func = readback ? GetTexImage2D : UploadTexSubImage2D;
+   GLint f, sz;
+
+   perf_printf("  %s, MB/sec:\n",
+               readback ? "glGetTexImage" : "glTexSubImage2D");
+   perf_printf("  %-28s", "format");
+   for (sz = 0; SweepSizes[sz]; sz++)
+      perf_printf(" %9d", SweepSizes[sz]);
+   perf_printf("\n");
+
+   for (f = 0; PerfFormats[f].name; f++) {
+      const struct perf_format *pf = &PerfFormats[f];
+
+      perf_printf("  %-28s", pf->name);
+      for (sz = 0; SweepSizes[sz]; sz++) {
+         double rate, mbPerSec;
+
+         if (!PerfFormatSupported(pf)) {
+            perf_printf(" %9s", "n/a");
+            continue;
+         }
+
+         TexSize = SweepSizes[sz];
+         TexIntFormat = pf->internal_format;
+         TexSrcFormat = pf->format;
+         TexSrcType = pf->type;
+         ImageBytes = TexSize * TexSize * pf->pixel_size;
+         TexImage = calloc(1, ImageBytes);
+
+         glTexImage2D(GL_TEXTURE_2D, 0, TexIntFormat,
+                      TexSize, TexSize, 0,
+                      TexSrcFormat, TexSrcType, TexImage);
+         if (glGetError()) {
+            perf_printf(" %9s", "error");
+            free(TexImage);
+            continue;
+         }
+
+         rate = PerfMeasureRate(func);
+         mbPerSec = rate * ImageBytes / (1024.0 * 1024.0);
+         free(TexImage);
+
+         if (glGetError()) {
+            perf_printf(" %9s", "error");
+            continue;
+         }
+
+         perf_printf(" %9.1f", mbPerSec);
+         PerfRecordResult(mode, mbPerSec, "MB/sec", "format=%s size=%dx%d",
+                          pf->name, TexSize, TexSize);
+      }
+      perf_printf("\n");
+   }
+   perf_printf("\n");
+}
+
+
 /** Called from test harness/main */
 void
 PerfNextRound(void)
@@ -235,6 +571,12 @@ PerfDraw(void)
    double rate;
    GLint fmt, mode;
 
+   if (PerfSweep) {
+      TexImageSweep(GL_FALSE);
+      TexImageSweep(GL_TRUE);
+      PerfExit(0);
+   }
+
    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
 
    /* loop over source data formats */
@@ -257,17 +599,24 @@ PerfDraw(void)
                continue;
          }
 
+         if (!ModeSupported(mode)) {
+            perf_printf("  %s: not supported\n", mode_name[mode]);
+            continue;
+         }
+
          /* loop over a defined range of texture sizes, test only the
           * ones which are legal for this driver.
           */
          for (TexSize = minsz; TexSize <= maxsz; TexSize *= 4) {
             double mbPerSec;
+            GLboolean pbo = mode >= MODE_PBO_TEXSUBIMAGE;
 
             if (TexSize <= maxSize) {
                GLint bytesPerImage;
 
                bytesPerImage = TexSize * TexSize * SrcFormats[fmt].texel_size;
                TexImage = malloc(bytesPerImage);
+               ImageBytes = bytesPerImage;
 
                switch (mode) {
                case MODE_TEXIMAGE:
@@ -293,6 +642,31 @@ PerfDraw(void)
                   rate = PerfMeasureRate(GetTexImage2D);
                   break;
 
+               case MODE_PBO_TEXSUBIMAGE:
+               case MODE_PBO2_TEXSUBIMAGE:
+               case MODE_PBO_RING_TEXSUBIMAGE:
+                  glTexImage2D(GL_TEXTURE_2D, 0, TexIntFormat,
+                               TexSize, TexSize, 0,
+                               TexSrcFormat, TexSrcType, NULL);
+                  BeginPBO(mode);
+                  if (mode == MODE_PBO_TEXSUBIMAGE)
+                     rate = PerfMeasureRate(UploadPBOTexSubImage2D);
+                  else if (mode == MODE_PBO2_TEXSUBIMAGE)
+                     rate = PerfMeasureRate(UploadPBO2TexSubImage2D);
+                  else
+                     rate = PerfMeasureRate(UploadPBORingTexSubImage2D);
+                  EndPBO();
+                  break;
+
+               case MODE_PBO_GETTEXIMAGE:
+                  glTexImage2D(GL_TEXTURE_2D, 0, TexIntFormat,
+                               TexSize, TexSize, 0,
+                               TexSrcFormat, TexSrcType, TexImage);
+                  BeginPBO(mode);
+                  rate = PerfMeasureRate(GetPBOTexImage2D);
+                  EndPBO();
+                  break;
+
                default:
                   exit(1);
                }
@@ -314,12 +688,31 @@ PerfDraw(void)
             else {
                rate = 0;
                mbPerSec = 0;
+               pbo = GL_FALSE;
             }
 
-            perf_printf("  %s(%s %d x %d): "
-                        "%.1f images/sec, %.1f MB/sec\n",
-                        mode_name[mode],
-                        SrcFormats[fmt].name, TexSize, TexSize, rate, mbPerSec);
+            if (pbo) {
+               const double stall = StallFrames ?
+                  1000.0 * StallTime / StallFrames : 0.0;
+               perf_printf("  %s(%s %d x %d): "
+                           "%.1f images/sec, %.1f MB/sec, "
+                           "stall %.3f ms/frame\n",
+                           mode_name[mode],
+                           SrcFormats[fmt].name, TexSize, TexSize, rate,
+                           mbPerSec, stall);
+               PerfRecordCost(mode_name[mode], stall, "ms/frame",
+                              "format=%s size=%dx%d timing=stall",
+                              SrcFormats[fmt].name, TexSize, TexSize);
+            }
+            else
+               perf_printf("  %s(%s %d x %d): "
+                           "%.1f images/sec, %.1f MB/sec\n",
+                           mode_name[mode],
+                           SrcFormats[fmt].name, TexSize, TexSize, rate,
+                           mbPerSec);
+            PerfRecordResult(mode_name[mode], mbPerSec, "MB/sec",
+                             "format=%s size=%dx%d", SrcFormats[fmt].name,
+                             TexSize, TexSize);
          }
 
          if (SrcFormats[fmt].full_test) 
@@ -327,5 +720,5 @@ PerfDraw(void)
       }
    }
 
-   exit(0);
+   PerfExit(0);
 }
@@ -23,6 +23,11 @@
  * Measure VBO upload speed.
  * That is, measure glBufferDataARB() and glBufferSubDataARB().
  *
+ * Also measure the usual streaming strategies for dynamic geometry:
+ * buffer orphaning, glMapBufferRange() with INVALIDATE/UNSYNCHRONIZED,
+ * a fenced ring buffer and a persistent/coherent mapping from
+ * GL_ARB_buffer_storage.
+ *
  * Brian Paul
  * 16 Sep 2009
  */
@@ -48,6 +53,17 @@ static const GLboolean BufferSubDataInHalves = GL_TRUE;
 
 static const GLfloat Vertex0[2] = { 0.0, 0.0 };
 
+/* The streaming tests write to a buffer of RING_SEGMENTS * VBOSize bytes,
+ * one segment per upload, so the GPU can read one segment while the CPU
+ * writes the next.
+ */
+#define RING_SEGMENTS 3
+
+static GLuint StreamVBO;
+static GLubyte *StreamMap = NULL;   /* persistent mapping of StreamVBO */
+static GLsync Fences[RING_SEGMENTS];
+static unsigned Segment;
+
 
 /** Called from test harness/main */
 void
@@ -83,7 +99,7 @@ UploadVBO(unsigned count)
       src += VBOSize;
       src %= DATA_SIZE;
    }
-   glFinish();
+   PerfFinish();
 }
 
 
@@ -104,7 +120,7 @@ UploadSubVBO(unsigned count)
       src += SubSize;
       src %= DATA_SIZE;
    }
-   glFinish();
+   PerfFinish();
 }
 
 
@@ -129,7 +145,7 @@ BatchUploadSubVBO(unsigned count)
       src += SubSize;
       src %= DATA_SIZE;
    }
-   glFinish();
+   PerfFinish();
 }
 
 
@@ -155,7 +171,229 @@ CreateDrawDestroyVBO(unsigned count)
       /* destroy */
       glDeleteBuffersARB(1, &vbo);
    }
-   glFinish();
+   PerfFinish();
+}
+
+
+/**
+ * Orphan the buffer's storage with glBufferData(NULL) so the driver can
+ * hand out fresh memory instead of waiting for pending draws, then fill
+ * it with glBufferSubData().
+ */
+static void
+OrphanSubVBO(unsigned count)
+{
+   unsigned i;
+   unsigned src = 0;
+
+   for (i = 0; i < count; i++) {
+      glBufferDataARB(GL_ARRAY_BUFFER, VBOSize, NULL, GL_STREAM_DRAW_ARB);
+      glBufferSubDataARB(GL_ARRAY_BUFFER, 0, VBOSize, VBOData + src);
+      glDrawArrays(GL_POINTS, 0, 1);
+
+      src += VBOSize;
+      src %= DATA_SIZE;
+   }
+   PerfFinish();
+}
+
+
+/** Map the whole buffer with GL_MAP_INVALIDATE_BUFFER_BIT and fill it */
+static void
+MapInvalidateVBO(unsigned count)
+{
+   unsigned i;
+   unsigned src = 0;
+
+   for (i = 0; i < count; i++) {
+      void *dst = glMapBufferRange(GL_ARRAY_BUFFER, 0, VBOSize,
+                                   GL_MAP_WRITE_BIT |
+                                   GL_MAP_INVALIDATE_BUFFER_BIT);
+      memcpy(dst, VBOData + src, VBOSize);
+      glUnmapBuffer(GL_ARRAY_BUFFER);
+      glDrawArrays(GL_POINTS, 0, 1);
+
+      src += VBOSize;
+      src %= DATA_SIZE;
+   }
+   PerfFinish();
+}
+
+
+/**
+ * Append to StreamVBO with unsynchronized maps and orphan it when
+ * wrapping around, like D3D's NO_OVERWRITE/DISCARD locks.
+ */
+static void
+MapUnsynchronizedVBO(unsigned count)
+{
+   unsigned i;
+   unsigned src = 0;
+
+   for (i = 0; i < count; i++) {
+      const GLintptr offset = Segment * VBOSize;
+      const GLbitfield access = Segment == 0 ?
+         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT :
+         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+         GL_MAP_UNSYNCHRONIZED_BIT;
+      void *dst = glMapBufferRange(GL_ARRAY_BUFFER, offset, VBOSize, access);
+
+      memcpy(dst, VBOData + src, VBOSize);
+      glUnmapBuffer(GL_ARRAY_BUFFER);
+      glDrawArrays(GL_POINTS, offset / sizeof(Vertex0), 1);
+
+      Segment = (Segment + 1) % RING_SEGMENTS;
+      src += VBOSize;
+      src %= DATA_SIZE;
+   }
+   PerfFinish();
+}
+
+
+/** Wait until the GPU is done reading the given ring segment */
+static void
+WaitSegment(unsigned seg)
+{
+   if (Fences[seg]) {
+      while (glClientWaitSync(Fences[seg], GL_SYNC_FLUSH_COMMANDS_BIT,
+                              1000000000) == GL_TIMEOUT_EXPIRED)
+         ;
+      glDeleteSync(Fences[seg]);
+      Fences[seg] = 0;
+   }
+}
+
+
+/**
+ * Never orphan; fence each segment after drawing from it and wait for
+ * the fence before writing the segment again.
+ */
+static void
+FencedRingVBO(unsigned count)
+{
+   unsigned i;
+   unsigned src = 0;
+
+   for (i = 0; i < count; i++) {
+      const GLintptr offset = Segment * VBOSize;
+      void *dst;
+
+      WaitSegment(Segment);
+      dst = glMapBufferRange(GL_ARRAY_BUFFER, offset, VBOSize,
+                             GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+                             GL_MAP_UNSYNCHRONIZED_BIT);
+      memcpy(dst, VBOData + src, VBOSize);
+      glUnmapBuffer(GL_ARRAY_BUFFER);
+      glDrawArrays(GL_POINTS, offset / sizeof(Vertex0), 1);
+      Fences[Segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+      Segment = (Segment + 1) % RING_SEGMENTS;
+      src += VBOSize;
+      src %= DATA_SIZE;
+   }
+   PerfFinish();
+}
+
+
+/** Like FencedRingVBO() but writing through a persistent, coherent map */
+static void
+PersistentRingVBO(unsigned count)
+{
+   unsigned i;
+   unsigned src = 0;
+
+   for (i = 0; i < count; i++) {
+      const GLintptr offset = Segment * VBOSize;
+
+      WaitSegment(Segment);
+      memcpy(StreamMap + offset, VBOData + src, VBOSize);
+      glDrawArrays(GL_POINTS, offset / sizeof(Vertex0), 1);
+      Fences[Segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+      Segment = (Segment + 1) % RING_SEGMENTS;
+      src += VBOSize;
+      src %= DATA_SIZE;
+   }
+   PerfFinish();
+}
+
+
+/** Create StreamVBO for the current VBOSize */
+static void
+BeginStream(GLboolean persistent)
+{
+   const GLsizeiptr size = RING_SEGMENTS * VBOSize;
+
+   glGenBuffersARB(1, &StreamVBO);
+   glBindBufferARB(GL_ARRAY_BUFFER_ARB, StreamVBO);
+   if (persistent) {
+      const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+                               GL_MAP_COHERENT_BIT;
+      glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+      StreamMap = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+   }
+   else {
+      glBufferDataARB(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW_ARB);
+   }
+   glVertexPointer(2, GL_FLOAT, sizeof(Vertex0), (void *) 0);
+   Segment = 0;
+}
+
+
+static void
+EndStream(void)
+{
+   unsigned i;
+
+   for (i = 0; i < RING_SEGMENTS; i++)
+      WaitSegment(i);
+   if (StreamMap) {
+      glUnmapBuffer(GL_ARRAY_BUFFER);
+      StreamMap = NULL;
+   }
+   glDeleteBuffersARB(1, &StreamVBO);
+
+   glBindBufferARB(GL_ARRAY_BUFFER_ARB, VBO);
+   glVertexPointer(2, GL_FLOAT, sizeof(Vertex0), (void *) 0);
+}
+
+
+/** GL features needed by some of the streaming tests */
+#define NEED_MAP_RANGE  0x1
+#define NEED_SYNC       0x2
+#define NEED_STORAGE    0x4
+
+struct stream_mode
+{
+   const char *name;
+   PerfRateFunc func;
+   unsigned needs;
+   GLboolean ring;        /**< uses StreamVBO rather than VBO */
+};
+
+static const struct stream_mode StreamModes[] = {
+   { "Orphan", OrphanSubVBO, 0, GL_FALSE },
+   { "MapInvalidate", MapInvalidateVBO, NEED_MAP_RANGE, GL_FALSE },
+   { "MapUnsynchronized", MapUnsynchronizedVBO, NEED_MAP_RANGE, GL_TRUE },
+   { "FencedRing", FencedRingVBO, NEED_MAP_RANGE | NEED_SYNC, GL_TRUE },
+   { "PersistentRing", PersistentRingVBO, NEED_SYNC | NEED_STORAGE, GL_TRUE },
+   { NULL, NULL, 0, GL_FALSE }
+};
+
+
+static unsigned
+StreamFeatures(void)
+{
+   unsigned features = 0;
+
+   if (GLEW_VERSION_3_0 || PerfExtensionSupported("GL_ARB_map_buffer_range"))
+      features |= NEED_MAP_RANGE;
+   if (GLEW_VERSION_3_2 || PerfExtensionSupported("GL_ARB_sync"))
+      features |= NEED_SYNC;
+   if (GLEW_VERSION_4_4 || PerfExtensionSupported("GL_ARB_buffer_storage"))
+      features |= NEED_STORAGE;
+
+   return features;
 }
 
 
@@ -179,7 +417,8 @@ void
 PerfDraw(void)
 {
    double rate, mbPerSec;
-   int i, sz;
+   int i, sz, m;
+   unsigned features;
 
    /* Load VBOData buffer with duplicated Vertex0.
     */
@@ -199,6 +438,8 @@ PerfDraw(void)
       mbPerSec = rate * VBOSize / (1024.0 * 1024.0);
       perf_printf("  glBufferDataARB(size = %d): %.1f MB/sec\n",
                   VBOSize, mbPerSec);
+      PerfRecordResult("BufferData", mbPerSec, "MB/sec",
+                       "size=%d", VBOSize);
    }
 
    /* glBufferSubDataARB()
@@ -209,6 +450,8 @@ PerfDraw(void)
       mbPerSec = rate * VBOSize / (1024.0 * 1024.0);
       perf_printf("  glBufferSubDataARB(size = %d): %.1f MB/sec\n",
                   VBOSize, mbPerSec);
+      PerfRecordResult("BufferSubData", mbPerSec, "MB/sec",
+                       "size=%d", VBOSize);
    }
 
    /* Batch upload
@@ -222,6 +465,8 @@ PerfDraw(void)
       mbPerSec = rate * SubSize / (1024.0 * 1024.0);
       perf_printf("  glBufferSubDataARB(size = %d, VBOSize = %d): %.1f MB/sec\n",
                   SubSize, VBOSize, mbPerSec);
+      PerfRecordResult("BufferSubData", mbPerSec, "MB/sec",
+                       "size=%d vbosize=%d", SubSize, VBOSize);
    }
 
    for (sz = 0; Sizes[sz] < VBOSize; sz++) {
@@ -230,6 +475,8 @@ PerfDraw(void)
       mbPerSec = rate * SubSize / (1024.0 * 1024.0);
       perf_printf("  glBufferSubDataARB(size = %d, VBOSize = %d), batched: %.1f MB/sec\n",
                   SubSize, VBOSize, mbPerSec);
+      PerfRecordResult("BatchBufferSubData", mbPerSec, "MB/sec",
+                       "size=%d vbosize=%d", SubSize, VBOSize);
    }
 
    /* Create/Draw/Destroy
@@ -240,7 +487,44 @@ PerfDraw(void)
       mbPerSec = rate * VBOSize / (1024.0 * 1024.0);
       perf_printf("  VBO Create/Draw/Destroy(size = %d): %.1f MB/sec, %.1f draws/sec\n",
                   VBOSize, mbPerSec, rate);
+      PerfRecordResult("CreateDrawDestroy", mbPerSec, "MB/sec",
+                       "size=%d", VBOSize);
+   }
+
+   /* Streaming strategies
+    */
+   glBindBufferARB(GL_ARRAY_BUFFER_ARB, VBO);
+   glVertexPointer(2, GL_FLOAT, sizeof(Vertex0), (void *) 0);
+   features = StreamFeatures();
+
+   for (m = 0; StreamModes[m].name; m++) {
+      const struct stream_mode *mode = &StreamModes[m];
+
+      if (mode->needs & ~features) {
+         perf_printf("  %s: not supported\n", mode->name);
+         continue;
+      }
+
+      for (sz = 0; Sizes[sz]; sz++) {
+         SubSize = VBOSize = Sizes[sz];
+         if (mode->ring)
+            BeginStream((mode->needs & NEED_STORAGE) != 0);
+         else
+            glBufferDataARB(GL_ARRAY_BUFFER, VBOSize, NULL,
+                            GL_STREAM_DRAW_ARB);
+
+         rate = PerfMeasureRate(mode->func);
+
+         if (mode->ring)
+            EndStream();
+
+         mbPerSec = rate * VBOSize / (1024.0 * 1024.0);
+         perf_printf("  %s(size = %d): %.1f MB/sec\n",
+                     mode->name, VBOSize, mbPerSec);
+         PerfRecordResult(mode->name, mbPerSec, "MB/sec",
+                          "size=%d", VBOSize);
+      }
    }
 
-   exit(0);
+   PerfExit(0);
 }
@@ -132,7 +132,7 @@ DrawImmediate(unsigned count)
       }
       glEnd();
    }
-   glFinish();
+   PerfFinish();
    PerfSwapBuffers();
 }
 
@@ -147,7 +147,7 @@ DrawArraysMem(unsigned count)
    for (i = 0; i < count; i++) {
       glDrawArrays(GL_POINTS, 0, NumVerts);
    }
-   glFinish();
+   PerfFinish();
    PerfSwapBuffers();
 }
 
@@ -162,7 +162,7 @@ DrawArraysVBO(unsigned count)
    for (i = 0; i < count; i++) {
       glDrawArrays(GL_POINTS, 0, NumVerts);
    }
-   glFinish();
+   PerfFinish();
    PerfSwapBuffers();
 }
 
@@ -177,7 +177,7 @@ DrawElementsMem(unsigned count)
    for (i = 0; i < count; i++) {
       glDrawElements(GL_POINTS, NumVerts, GL_UNSIGNED_INT, Elements);
    }
-   glFinish();
+   PerfFinish();
    PerfSwapBuffers();
 }
 
@@ -192,7 +192,7 @@ DrawElementsBO(unsigned count)
    for (i = 0; i < count; i++) {
       glDrawElements(GL_POINTS, NumVerts, GL_UNSIGNED_INT, (void *) 0);
    }
-   glFinish();
+   PerfFinish();
    PerfSwapBuffers();
 }
 
@@ -208,7 +208,7 @@ DrawRangeElementsMem(unsigned count)
       glDrawRangeElements(GL_POINTS, 0, NumVerts - 1,
                           NumVerts, GL_UNSIGNED_INT, Elements);
    }
-   glFinish();
+   PerfFinish();
    PerfSwapBuffers();
 }
 
@@ -224,7 +224,7 @@ DrawRangeElementsBO(unsigned count)
       glDrawRangeElements(GL_POINTS, 0, NumVerts - 1,
                           NumVerts, GL_UNSIGNED_INT, (void *) 0);
    }
-   glFinish();
+   PerfFinish();
    PerfSwapBuffers();
 }
 
@@ -247,30 +247,37 @@ PerfDraw(void)
    rate = PerfMeasureRate(DrawImmediate);
    rate *= NumVerts;
    perf_printf("  Immediate mode: %s verts/sec\n", PerfHumanFloat(rate));
+   PerfRecordResult("Immediate", rate, "verts/sec", "verts=%d", NumVerts);
 
    rate = PerfMeasureRate(DrawArraysMem);
    rate *= NumVerts;
    perf_printf("  glDrawArrays: %s verts/sec\n", PerfHumanFloat(rate));
+   PerfRecordResult("DrawArrays", rate, "verts/sec", "verts=%d", NumVerts);
 
    rate = PerfMeasureRate(DrawArraysVBO);
    rate *= NumVerts;
    perf_printf("  VBO glDrawArrays: %s verts/sec\n", PerfHumanFloat(rate));
+   PerfRecordResult("VBODrawArrays", rate, "verts/sec", "verts=%d", NumVerts);
 
    rate = PerfMeasureRate(DrawElementsMem);
    rate *= NumVerts;
    perf_printf("  glDrawElements: %s verts/sec\n", PerfHumanFloat(rate));
+   PerfRecordResult("DrawElements", rate, "verts/sec", "verts=%d", NumVerts);
 
    rate = PerfMeasureRate(DrawElementsBO);
    rate *= NumVerts;
    perf_printf("  VBO glDrawElements: %s verts/sec\n", PerfHumanFloat(rate));
+   PerfRecordResult("VBODrawElements", rate, "verts/sec", "verts=%d", NumVerts);
 
    rate = PerfMeasureRate(DrawRangeElementsMem);
    rate *= NumVerts;
    perf_printf("  glDrawRangeElements: %s verts/sec\n", PerfHumanFloat(rate));
+   PerfRecordResult("DrawRangeElements", rate, "verts/sec", "verts=%d", NumVerts);
 
    rate = PerfMeasureRate(DrawRangeElementsBO);
    rate *= NumVerts;
    perf_printf("  VBO glDrawRangeElements: %s verts/sec\n", PerfHumanFloat(rate));
+   PerfRecordResult("VBODrawRangeElements", rate, "verts/sec", "verts=%d", NumVerts);
 
-   exit(0);
+   PerfExit(0);
 }